@@ -11,6 +11,7 @@
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include "legoProfile.h"
 
 bool d3d::InitD3D(
 	HINSTANCE hInstance,
@@ -155,6 +156,7 @@ int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
 	{
 		if(::PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
 		{
+			LEGO_PROFILE_SCOPE("messages");
 			::TranslateMessage(&msg);
 			::DispatchMessage(&msg);
 		}
@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoBalls.cpp
+//
+// Desc: Structure-of-arrays ball container.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoBalls.h"
+
+void lego::BallArray::clear(void)
+{
+	m_posX.clear();
+	m_posY.clear();
+	m_posZ.clear();
+	m_velX.clear();
+	m_velZ.clear();
+	m_alive.clear();
+	m_active.clear();
+	m_activeSlot.clear();
+	m_type.clear();
+}
+
+void lego::BallArray::reserve(int count)
+{
+	m_posX.reserve(count);
+	m_posY.reserve(count);
+	m_posZ.reserve(count);
+	m_velX.reserve(count);
+	m_velZ.reserve(count);
+	m_alive.reserve(count);
+	m_active.reserve(count);
+	m_activeSlot.reserve(count);
+	m_type.reserve(count);
+}
+
+int lego::BallArray::add(float x, float y, float z, SphereType type)
+{
+	m_posX.push_back(x);
+	m_posY.push_back(y);
+	m_posZ.push_back(z);
+	m_velX.push_back(0.0f);
+	m_velZ.push_back(0.0f);
+	m_alive.push_back(1);
+	m_activeSlot.push_back((int)m_active.size());
+	m_active.push_back(size() - 1);
+	m_type.push_back(type);
+	return size() - 1;
+}
+
+void lego::BallArray::setAlive(int i, bool alive)
+{
+	if (isAlive(i) == alive)
+		return;
+	m_alive[i] = alive ? 1 : 0;
+
+	if (alive) {
+		m_activeSlot[i] = (int)m_active.size();
+		m_active.push_back(i);
+	}
+	else {
+		// the last active ball takes the place of the dead one
+		int slot = m_activeSlot[i];
+		int last = m_active.back();
+		m_active[slot] = last;
+		m_activeSlot[last] = slot;
+		m_active.pop_back();
+		m_activeSlot[i] = -1;
+	}
+}
+
+void lego::BallArray::hitByWall(const Wall& wall)
+{
+	for (int k = 0; k < (int)m_active.size(); k++) {
+		int i = m_active[k];
+		wall.hitBy(m_posX[i], m_posZ[i], m_velX[i], m_velZ[i]);
+	}
+}
+
+void lego::BallArray::saveAlive(AliveState& state) const
+{
+	state.alive = m_alive;
+	state.active = m_active;
+	state.activeSlot = m_activeSlot;
+}
+
+void lego::BallArray::restoreAlive(const AliveState& state)
+{
+	m_alive = state.alive;
+	m_active = state.active;
+	m_activeSlot = state.activeSlot;
+}
@@ -0,0 +1,91 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoBalls.h
+//
+// Desc: Structure-of-arrays ball container. Positions, velocities and the
+//       alive flag are kept in separate contiguous arrays so that the
+//       collision loops walk 4 bytes per ball per field instead of whole
+//       objects. Anything the physics loop does not touch (the type of the
+//       ball) is kept apart as cold data. Render data never lives here.
+//
+//       A ball keeps its index for life, so indices are stable handles.
+//       The alive ones are also listed densely in the active set, from which
+//       a dead ball is swap-removed in O(1): whatever only cares about the
+//       living walks getActiveCount() balls, not size().
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoBallsH__
+#define __legoBallsH__
+
+#include "legoPhysics.h"
+#include <vector>
+
+namespace lego
+{
+	class BallArray {
+	public:
+		BallArray(void) {}
+
+		void clear(void);
+		void reserve(int count);
+		// returns the index of the new ball
+		int add(float x, float y, float z, SphereType type);
+		int size(void) const { return (int)m_posX.size(); }
+
+		// hot data
+		const float* getPositionX(void) const { return m_posX.empty() ? 0 : &m_posX[0]; }
+		const float* getPositionY(void) const { return m_posY.empty() ? 0 : &m_posY[0]; }
+		const float* getPositionZ(void) const { return m_posZ.empty() ? 0 : &m_posZ[0]; }
+		const float* getVelocityX(void) const { return m_velX.empty() ? 0 : &m_velX[0]; }
+		const float* getVelocityZ(void) const { return m_velZ.empty() ? 0 : &m_velZ[0]; }
+		const unsigned char* getAliveFlags(void) const { return m_alive.empty() ? 0 : &m_alive[0]; }
+
+		Vector3 getCenter(int i) const { return Vector3(m_posX[i], m_posY[i], m_posZ[i]); }
+		void setCenter(int i, float x, float y, float z) { m_posX[i] = x; m_posY[i] = y; m_posZ[i] = z; }
+		float getVelocity_X(int i) const { return m_velX[i]; }
+		float getVelocity_Z(int i) const { return m_velZ[i]; }
+		void setPower(int i, float vx, float vz) { m_velX[i] = vx; m_velZ[i] = vz; }
+
+		bool isAlive(int i) const { return m_alive[i] != 0; }
+		void setAlive(int i, bool alive);
+		int getAliveCount(void) const { return (int)m_active.size(); }
+
+		// indices of the alive balls, in no particular order
+		int getActiveCount(void) const { return (int)m_active.size(); }
+		const int* getActiveBalls(void) const { return m_active.empty() ? 0 : &m_active[0]; }
+
+		// cold data
+		SphereType getType(int i) const { return m_type[i]; }
+
+		// walls push balls back inside the table, same rule as Wall::hitBy
+		void hitByWall(const Wall& wall);
+
+		// what setAlive() changes, to save and restore a game: bricks never
+		// move, so their positions and velocities stay with the level
+		struct AliveState
+		{
+			std::vector<unsigned char>	alive;
+			std::vector<int>			active;
+			std::vector<int>			activeSlot;
+		};
+		void saveAlive(AliveState& state) const;
+		// the array must hold the balls state was saved from
+		void restoreAlive(const AliveState& state);
+
+	private:
+		std::vector<float>			m_posX;
+		std::vector<float>			m_posY;
+		std::vector<float>			m_posZ;
+		std::vector<float>			m_velX;
+		std::vector<float>			m_velZ;
+		std::vector<unsigned char>	m_alive;
+
+		std::vector<int>			m_active;		// alive balls, dense
+		std::vector<int>			m_activeSlot;	// ball -> place in m_active, -1 if dead
+
+		std::vector<SphereType>		m_type;
+	};
+}
+
+#endif // __legoBallsH__
@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoBatch.cpp
+//
+// Desc: Batch simulation of many independent worlds across all cores.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoBatch.h"
+#include "legoProfile.h"
+#include <chrono>
+
+static bool chooseInput(bool roundStarted, float redX, float greyX, lego::InputType& input)
+{
+	if (!roundStarted) {
+		input = lego::INPUT_LAUNCH;
+		return true;
+	}
+
+	if (redX < greyX - KEYSTEP)
+		input = lego::INPUT_LEFT;
+	else if (redX > greyX + KEYSTEP)
+		input = lego::INPUT_RIGHT;
+	else
+		return false;
+	return true;
+}
+
+bool lego::autopilotInput(const Game& game, InputType& input)
+{
+	return chooseInput(game.isRoundStarted(), game.getRedBall().getCenter().x, game.getGreyBall().getCenter().x, input);
+}
+
+bool lego::autopilotInput(const RenderState& state, InputType& input)
+{
+	return chooseInput(state.isRoundStarted, state.redCenter.x, state.greyCenter.x, input);
+}
+
+void lego::autopilot(Game& game)
+{
+	InputType input;
+	if (autopilotInput(game, input))
+		applyInput(game, input);
+}
+
+lego::World::World(void)
+{
+	m_eventDriven = false;
+	m_steps = m_games = m_events = 0;
+}
+
+void lego::World::setup(const float* positions, int count)
+{
+	m_game.setup(positions, count);
+	m_steps = m_events = 0;
+	m_games = 1;
+}
+
+void lego::World::step(float timeDelta)
+{
+	if (m_game.isGameEnded()) {
+		m_game.restart();
+		m_games++;
+	}
+	autopilot(m_game);
+	if (m_eventDriven)
+		m_events += m_game.fastForward(timeDelta);
+	else
+		m_game.update(timeDelta);
+	m_steps++;
+}
+
+lego::BatchSimulator::BatchSimulator(ThreadPool& pool)
+	: m_pool(pool)
+{
+}
+
+lego::BatchSimulator::~BatchSimulator(void)
+{
+	clear();
+}
+
+void lego::BatchSimulator::clear(void)
+{
+	for (size_t i = 0; i < m_worlds.size(); i++)
+		delete m_worlds[i];
+	m_worlds.clear();
+}
+
+void lego::BatchSimulator::setup(int worlds, const float* positions, int count)
+{
+	clear();
+
+	// each world is allocated and set up by the thread likely to step it
+	m_worlds.resize(worlds, 0);
+	m_pool.parallelFor(worlds, 1, [this, positions, count](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			m_worlds[i] = new World;
+			m_worlds[i]->setup(positions, count);
+		}
+	});
+}
+
+void lego::BatchSimulator::setContinuousCollision(bool enable)
+{
+	for (size_t i = 0; i < m_worlds.size(); i++)
+		m_worlds[i]->setContinuousCollision(enable);
+}
+
+void lego::BatchSimulator::setMultiBall(int count)
+{
+	for (size_t i = 0; i < m_worlds.size(); i++)
+		m_worlds[i]->setMultiBall(count);
+}
+
+void lego::BatchSimulator::setFixedPoint(bool enable)
+{
+	for (size_t i = 0; i < m_worlds.size(); i++)
+		m_worlds[i]->setFixedPoint(enable);
+}
+
+void lego::BatchSimulator::setEventDriven(bool enable)
+{
+	for (size_t i = 0; i < m_worlds.size(); i++)
+		m_worlds[i]->setEventDriven(enable);
+}
+
+lego::BatchStats lego::BatchSimulator::run(long steps, float timeDelta)
+{
+	const int worlds = getWorldCount();
+
+	// a task steps its worlds all the way through, so a world stays in one
+	// core's cache. several tasks per thread let stealing even out worlds
+	// that end up costlier than others.
+	int grain = worlds / (m_pool.getThreadCount() * 8);
+	if (grain < 1)
+		grain = 1;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	m_pool.parallelFor(worlds, grain, [this, steps, timeDelta](int begin, int end) {
+		LEGO_PROFILE_SCOPE("worlds");
+		for (int i = begin; i < end; i++) {
+			World* world = m_worlds[i];
+			for (long s = 0; s < steps; s++)
+				world->step(timeDelta);
+		}
+	});
+
+	BatchStats stats;
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.worlds = worlds;
+	stats.steps = stats.games = stats.events = 0;
+	stats.score = 0;
+	stats.hash = 2166136261u;
+	for (int i = 0; i < worlds; i++) {
+		stats.steps += steps;
+		stats.games += m_worlds[i]->getGames();
+		stats.events += m_worlds[i]->getEvents();
+		stats.score += m_worlds[i]->getGame().getScore();
+		stats.hash = (stats.hash ^ hashGame(m_worlds[i]->getGame())) * 16777619u;
+	}
+	return stats;
+}
@@ -0,0 +1,97 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoBatch.h
+//
+// Desc: Batch simulation of many independent worlds across all cores, for
+//       soak tests and throughput measurements. A world is a Game played
+//       by the autopilot; worlds share nothing but the read-only level
+//       layout, so they can be stepped on any thread.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoBatchH__
+#define __legoBatchH__
+
+#include "legoGame.h"
+#include "legoReplay.h"
+#include "legoThreadPool.h"
+#include <vector>
+
+namespace lego
+{
+	// move the grey ball one key step towards the red ball, like a player
+	// would, and launch the red ball whenever no round is running. false
+	// if no key would be pressed this step.
+	bool autopilotInput(const Game& game, InputType& input);
+	// the same from a snapshot of the game
+	bool autopilotInput(const RenderState& state, InputType& input);
+	void autopilot(Game& game);
+
+	class World {
+	public:
+		World(void);
+
+		void setup(const float* positions, int count);
+
+		void setContinuousCollision(bool enable) { m_game.setContinuousCollision(enable); }
+		void setMultiBall(int count) { m_game.setMultiBall(count); }
+		void setFixedPoint(bool enable) { m_game.setFixedPoint(enable); }
+		// step with Game::fastForward instead of Game::update
+		void setEventDriven(bool enable) { m_eventDriven = enable; }
+
+		// one autopilot move and one update, restarting the game once over
+		void step(float timeDelta);
+
+		const Game& getGame(void) const { return m_game; }
+		long getSteps(void) const { return m_steps; }
+		long getGames(void) const { return m_games; }
+		long getEvents(void) const { return m_events; }
+
+	private:
+		Game	m_game;
+		bool	m_eventDriven;
+		long	m_steps;
+		long	m_games;
+		long	m_events;
+	};
+
+	struct BatchStats
+	{
+		int			worlds;
+		long		steps;		// summed over all worlds
+		long		games;
+		long		events;
+		long long	score;		// final score of every world, summed
+		// hashGame of every world, hashed in world order. in fixed-point
+		// mode it is the same on every machine for the same run.
+		unsigned int	hash;
+		double		seconds;
+	};
+
+	class BatchSimulator {
+	public:
+		explicit BatchSimulator(ThreadPool& pool);
+		~BatchSimulator(void);
+
+		void setup(int worlds, const float* positions, int count);
+		void setContinuousCollision(bool enable);
+		void setMultiBall(int count);
+		void setFixedPoint(bool enable);
+		void setEventDriven(bool enable);
+
+		// advances every world by steps steps of timeDelta
+		BatchStats run(long steps, float timeDelta);
+
+		int getWorldCount(void) const { return (int)m_worlds.size(); }
+		const World& getWorld(int i) const { return *m_worlds[i]; }
+
+	private:
+		ThreadPool&				m_pool;
+		// one allocation per world, so neighbours don't share cache lines
+		std::vector<World*>		m_worlds;
+
+		void clear(void);
+	};
+}
+
+#endif // __legoBatchH__
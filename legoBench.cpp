@@ -0,0 +1,575 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoBench.cpp
+//
+// Desc: Benchmarks of the physics primitives and of whole simulation steps
+//       over scenes of 20, 1k and 100k bricks and 1 to 1k moving balls,
+//       with and without a thread pool, of fast-forwarded spans, and of
+//       software rendered frames.
+//       Every benchmark is sampled several times and reported as the
+//       median time per operation, as JSON so runs can be kept and
+//       compared.
+//
+//       usage: legoBench [-f filter] [-t seconds] [-o results.json]
+//                        [-c baseline.json] [-r percent]
+//
+//       -f  only run the benchmarks whose name contains filter
+//       -t  time spent on each benchmark, 0.5 seconds by default
+//       -o  write the JSON there instead of to stdout
+//       -c  compare with an earlier JSON output. the exit code is 1 if a
+//           benchmark got slower by more than -r percent, 10 by default.
+//
+//       the summary and the comparison go to stderr.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoGame.h"
+#include "legoBatch.h"
+#include "legoBroadphase.h"
+#include "legoCollide.h"
+#include "legoSoftRender.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// time spent in setup work inside a benchmark body, like restarting a
+// finished game, is taken out of the measurement
+class Stopwatch {
+public:
+	Stopwatch(void) : m_excluded(0.0) {}
+
+	void pause(void) { m_pausedAt = Clock::now(); }
+	void resume(void) { m_excluded += std::chrono::duration<double>(Clock::now() - m_pausedAt).count(); }
+	double getExcluded(void) const { return m_excluded; }
+
+private:
+	Clock::time_point	m_pausedAt;
+	double				m_excluded;
+};
+
+// body runs iterations operations
+typedef std::function<void(long iterations, Stopwatch& watch)> BenchBody;
+
+struct BenchResult
+{
+	std::string	name;
+	long		ops;		// per sample
+	double		nsPerOp;	// median of the samples
+	double		minNsPerOp;
+};
+
+static const int benchSamples = 5;
+
+// results are folded in here so the optimizer can't drop the work
+static volatile float g_sink;
+
+static double sample(const BenchBody& body, long iterations)
+{
+	Stopwatch watch;
+	Clock::time_point start = Clock::now();
+	body(iterations, watch);
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	return std::max(0.0, elapsed - watch.getExcluded());
+}
+
+static BenchResult measure(const std::string& name, const BenchBody& body, double seconds)
+{
+	// grow the sample until it takes a fair share of the time budget
+	const double target = seconds / (benchSamples + 1);
+	long iterations = 1;
+	double elapsed = sample(body, iterations);
+	while (elapsed < target && iterations < (1L << 40)) {
+		double scale = elapsed > 0.0 ? target / elapsed * 1.2 : 10.0;
+		iterations = (long)(iterations * std::min(10.0, std::max(2.0, scale)));
+		elapsed = sample(body, iterations);
+	}
+
+	std::vector<double> times;
+	for (int i = 0; i < benchSamples; i++)
+		times.push_back(sample(body, iterations) * 1e9 / iterations);
+	std::sort(times.begin(), times.end());
+
+	BenchResult result;
+	result.name = name;
+	result.ops = iterations;
+	result.nsPerOp = times[benchSamples / 2];
+	result.minNsPerOp = times[0];
+	return result;
+}
+
+// -----------------------------------------------------------------------------
+// scenes
+// -----------------------------------------------------------------------------
+
+static const int brickScenes[] = { 20, 1000, 100000 };
+static const int ballScenes[] = { 1, 10, 1000 };
+static const char* const collisionKernels[] = { "scalar", "sse2", "avx2" };
+// bricks of the level the step/balls scenes play on: enough for 1k balls
+// to take a while to clear, few enough that they aren't always in a brick
+static const int ballSceneBricks = 10000;
+// simulated seconds in one fastForward operation
+static const float fastForwardSpan = 10.0f;
+
+static void getLayout(int bricks, std::vector<float>& layout)
+{
+	if (bricks == lego::totalBalls)
+		layout.assign(&lego::spherePos[0][0], &lego::spherePos[0][0] + lego::totalBalls * 2);
+	else
+		lego::makeBrickLayout(bricks, layout);
+}
+
+// fixed pseudo random numbers in [0, 1), so every run sees the same scene
+static float nextRandom(unsigned int& state)
+{
+	state = state * 1664525u + 1013904223u;
+	return (state >> 8) * (1.0f / 16777216.0f);
+}
+
+// balls spread over the table, moving in all directions at launch speed
+static void makeBalls(int count, std::vector<lego::Sphere>& balls)
+{
+	unsigned int seed = 12345;
+	balls.resize(count);
+	for (int i = 0; i < count; i++) {
+		float x = (nextRandom(seed) - 0.5f) * (lego::horizontalBarWidth - 1.0f);
+		float z = (nextRandom(seed) - 0.5f) * (lego::verticalBarDepth - 1.0f);
+		float angle = nextRandom(seed) * 2.0f * (float)PI;
+		balls[i].setType(lego::SPHERE_RED);
+		balls[i].setCenter(x, (float)M_RADIUS, z);
+		balls[i].setPower(REDBALLSPEED * cosf(angle), REDBALLSPEED * sinf(angle));
+	}
+}
+
+// plays a multi-ball game until count balls, give or take a tenth, are in
+// play and keeps that state, so the balls are spread out the way the game
+// spreads them rather than bunched up where they were released
+static void warmUpBalls(int count, lego::GameState& state)
+{
+	std::vector<float> layout;
+	getLayout(ballSceneBricks, layout);
+	lego::Game game;
+	game.setup(&layout[0], ballSceneBricks);
+	// few balls per power-up, or one hit releases many more than count
+	game.setMultiBall(count > 1 ? 1 + count / 200 : 0);
+	for (long s = 0; s < 1000000; s++) {
+		int balls = game.getExtraBallCount() + 1;
+		if (balls >= count && balls <= count + count / 10)
+			break;
+		if (game.isGameEnded())
+			game.restart();
+		lego::autopilot(game);
+		game.update(0.001f);
+	}
+	game.saveState(state);
+}
+
+static std::string sceneName(const char* bench, const char* key, int value)
+{
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "%s/%s=%d", bench, key, value);
+	return buffer;
+}
+
+// -----------------------------------------------------------------------------
+// benchmarks
+// -----------------------------------------------------------------------------
+
+static void addBenchmarks(std::vector<std::pair<std::string, BenchBody> >& benches)
+{
+	size_t i;
+
+	// one Sphere::ballUpdate per ball per operation
+	for (i = 0; i < sizeof(ballScenes) / sizeof(ballScenes[0]); i++) {
+		int count = ballScenes[i];
+		benches.push_back(std::make_pair(sceneName("ballUpdate", "balls", count),
+			BenchBody([count](long iterations, Stopwatch&) {
+				std::vector<lego::Sphere> balls;
+				makeBalls(count, balls);
+				long steps = (iterations + count - 1) / count;
+				for (long s = 0; s < steps; s++) {
+					for (int b = 0; b < count; b++)
+						balls[b].ballUpdate(0.001f);
+				}
+				g_sink = balls[0].getCenter().x;
+			})));
+	}
+
+	// Sphere::hitBy of the red ball against every brick of the level, one
+	// test per operation. a brick is destroyed when it's hit, so after the
+	// first pass this is the cost of the miss, by far the common case.
+	for (i = 0; i < sizeof(brickScenes) / sizeof(brickScenes[0]); i++) {
+		int count = brickScenes[i];
+		benches.push_back(std::make_pair(sceneName("sphereHitBy", "bricks", count),
+			BenchBody([count](long iterations, Stopwatch& watch) {
+				watch.pause();
+				std::vector<float> layout;
+				getLayout(count, layout);
+				std::vector<lego::Sphere> bricks(count);
+				for (int b = 0; b < count; b++) {
+					bricks[b].setType(lego::SPHERE_BRICK);
+					bricks[b].setCenter(layout[b * 2], (float)M_RADIUS, layout[b * 2 + 1]);
+				}
+				lego::Sphere red;
+				red.setType(lego::SPHERE_RED);
+				red.setCenter(0.0f, (float)M_RADIUS, 2.0f);
+				red.setPower(0.0, REDBALLSPEED);
+				watch.resume();
+
+				int hits = 0;
+				long passes = (iterations + count - 1) / count;
+				for (long p = 0; p < passes; p++) {
+					for (int b = 0; b < count; b++)
+						hits += bricks[b].hitBy(red);
+				}
+				g_sink = (float)hits;
+			})));
+	}
+
+	// findTouchingBricks of the red ball over the whole level with each
+	// kernel the cpu has, one ball-brick pair per operation: the same
+	// test as sphereHitBy above, 16 pairs at a time
+	const char* fastest = lego::getCollisionKernel();
+	for (size_t k = 0; k < sizeof(collisionKernels) / sizeof(collisionKernels[0]); k++) {
+		const char* kernel = collisionKernels[k];
+		if (!lego::setCollisionKernel(kernel))
+			continue;
+		for (i = 0; i < sizeof(brickScenes) / sizeof(brickScenes[0]); i++) {
+			int count = brickScenes[i];
+			benches.push_back(std::make_pair(sceneName("touching", "bricks", count) + "/" + kernel,
+				BenchBody([count, kernel, fastest](long iterations, Stopwatch& watch) {
+					watch.pause();
+					std::vector<float> layout;
+					getLayout(count, layout);
+					lego::Game game;
+					game.setup(&layout[0], count);
+					std::vector<int> hits;
+					lego::setCollisionKernel(kernel);
+					watch.resume();
+
+					int found = 0;
+					long passes = (iterations + count - 1) / count;
+					for (long p = 0; p < passes; p++)
+						found += lego::findTouchingBricks(game.getBricks(), 0.0f, (float)M_RADIUS, 2.0f, lego::touchDistance, hits);
+					g_sink = (float)found;
+					lego::setCollisionKernel(fastest);
+				})));
+		}
+	}
+	lego::setCollisionKernel(fastest);
+
+	// Wall::hitBy of every ball against every wall, one test per operation
+	for (i = 0; i < sizeof(ballScenes) / sizeof(ballScenes[0]); i++) {
+		int count = ballScenes[i];
+		benches.push_back(std::make_pair(sceneName("wallHitBy", "balls", count),
+			BenchBody([count](long iterations, Stopwatch& watch) {
+				watch.pause();
+				lego::Game game;
+				game.setup();
+				std::vector<lego::Sphere> balls;
+				makeBalls(count, balls);
+				watch.resume();
+
+				int hits = 0;
+				long passes = (iterations + count * lego::totalWalls - 1) / (count * lego::totalWalls);
+				for (long p = 0; p < passes; p++) {
+					for (int b = 0; b < count; b++) {
+						lego::Vector3 c = balls[b].getCenter();
+						for (int w = 0; w < lego::totalWalls; w++) {
+							float x = c.x, z = c.z;
+							float vx = (float)balls[b].getVelocity_X(), vz = (float)balls[b].getVelocity_Z();
+							hits += game.getWall(w).hitBy(x, z, vx, vz);
+						}
+					}
+				}
+				g_sink = (float)hits;
+			})));
+	}
+
+	// sweep-and-prune pass over moving balls, one pass per operation. the
+	// walls reflect the balls and the line sends them back up, so they stay
+	// spread over the table instead of piling up at its edges.
+	for (i = 0; i < sizeof(ballScenes) / sizeof(ballScenes[0]); i++) {
+		int count = ballScenes[i];
+		benches.push_back(std::make_pair(sceneName("broadphase", "balls", count),
+			BenchBody([count](long iterations, Stopwatch& watch) {
+				watch.pause();
+				lego::Game game;
+				game.setup();
+				std::vector<lego::Sphere> balls;
+				makeBalls(count, balls);
+				std::vector<float> x(count), z(count);
+				lego::SweepAndPrune sap;
+				watch.resume();
+
+				int pairs = 0;
+				for (long it = 0; it < iterations; it++) {
+					for (int b = 0; b < count; b++) {
+						balls[b].ballUpdate(0.001f);
+						lego::Vector3 c = balls[b].getCenter();
+						float vx = (float)balls[b].getVelocity_X(), vz = (float)balls[b].getVelocity_Z();
+						for (int w = 0; w < lego::totalWalls; w++)
+							game.getWall(w).hitBy(c.x, c.z, vx, vz);
+						if (c.z <= -lego::ballLimitZ && vz < 0.0f)
+							vz = -vz;
+						balls[b].setCenter(c.x, c.y, c.z);
+						balls[b].setPower(vx, vz);
+						x[b] = c.x;
+						z[b] = c.z;
+					}
+					sap.update(&x[0], &z[0], count, (float)M_RADIUS);
+					pairs += sap.getPairCount();
+				}
+				g_sink = (float)pairs;
+			})));
+	}
+
+	// what Display() used to do every frame: the autopilot's input and one
+	// Game::update. finished games are restarted off the clock.
+	for (i = 0; i < sizeof(brickScenes) / sizeof(brickScenes[0]); i++) {
+		int count = brickScenes[i];
+		benches.push_back(std::make_pair(sceneName("step", "bricks", count),
+			BenchBody([count](long iterations, Stopwatch& watch) {
+				watch.pause();
+				std::vector<float> layout;
+				getLayout(count, layout);
+				lego::Game game;
+				game.setup(&layout[0], count);
+				watch.resume();
+
+				for (long it = 0; it < iterations; it++) {
+					if (game.isGameEnded()) {
+						watch.pause();
+						game.restart();
+						watch.resume();
+					}
+					lego::autopilot(game);
+					game.update(0.001f);
+				}
+				g_sink = (float)game.getScore();
+			})));
+	}
+
+	// Game::update with about 1, 10 and 1k balls in play on a 10k brick
+	// level, one step per operation, with the extra balls moved on the
+	// calling thread or on a pool. the game is put back to the warmed up
+	// state, off the clock, when it ends or the number of balls drifts off
+	// by more than a factor of two.
+	for (i = 0; i < sizeof(ballScenes) / sizeof(ballScenes[0]); i++) {
+		int count = ballScenes[i];
+		for (int threaded = 0; threaded < 2; threaded++) {
+			std::shared_ptr<lego::GameState> warm = std::make_shared<lego::GameState>();
+			benches.push_back(std::make_pair(sceneName("step", "balls", count) + (threaded ? "/pool" : ""),
+				BenchBody([count, threaded, warm](long iterations, Stopwatch& watch) {
+					watch.pause();
+					if (warm->isEmpty())
+						warmUpBalls(count, *warm);
+					lego::ThreadPool pool;
+					lego::Game game;
+					game.restoreState(*warm);
+					game.setThreadPool(threaded ? &pool : 0);
+					watch.resume();
+
+					for (long it = 0; it < iterations; it++) {
+						int balls = game.getExtraBallCount() + 1;
+						if (game.isGameEnded() || balls < count / 2 || balls > count * 2) {
+							watch.pause();
+							game.restoreState(*warm);
+							watch.resume();
+						}
+						lego::autopilot(game);
+						game.update(0.001f);
+					}
+					g_sink = (float)game.getScore();
+				})));
+		}
+	}
+
+	// Game::fastForward over fastForwardSpan seconds from a launch, one span
+	// per operation. nothing moves the grey ball in between, so a span ends
+	// early once the red ball is past the line.
+	for (i = 0; i < sizeof(brickScenes) / sizeof(brickScenes[0]); i++) {
+		int count = brickScenes[i];
+		benches.push_back(std::make_pair(sceneName("fastForward", "bricks", count),
+			BenchBody([count](long iterations, Stopwatch& watch) {
+				watch.pause();
+				std::vector<float> layout;
+				getLayout(count, layout);
+				lego::Game game;
+				game.setup(&layout[0], count);
+				watch.resume();
+
+				int events = 0;
+				for (long it = 0; it < iterations; it++) {
+					watch.pause();
+					if (game.isGameEnded())
+						game.restart();
+					lego::autopilot(game);
+					watch.resume();
+					events += game.fastForward(fastForwardSpan);
+				}
+				g_sink = (float)events;
+			})));
+	}
+
+	// one 1024x768 frame of the software renderer on all cores. 100k
+	// bricks are left out, that's tens of millions of triangles a frame.
+	for (i = 0; i < 2; i++) {
+		int count = brickScenes[i];
+		benches.push_back(std::make_pair(sceneName("render", "bricks", count),
+			BenchBody([count](long iterations, Stopwatch& watch) {
+				watch.pause();
+				std::vector<float> layout;
+				getLayout(count, layout);
+				lego::Game game;
+				game.setup(&layout[0], count);
+				lego::ThreadPool pool;
+				lego::SoftRenderer renderer(pool);
+				watch.resume();
+
+				for (long it = 0; it < iterations; it++)
+					renderer.render(game);
+				g_sink = (float)renderer.getPixels()[0];
+			})));
+	}
+}
+
+// -----------------------------------------------------------------------------
+// JSON
+// -----------------------------------------------------------------------------
+
+static void writeJson(FILE* file, const std::vector<BenchResult>& results)
+{
+	fprintf(file, "{\n");
+	fprintf(file, "  \"kernel\": \"%s\",\n", lego::getCollisionKernel());
+	fprintf(file, "  \"samples\": %d,\n", benchSamples);
+	fprintf(file, "  \"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		fprintf(file, "    { \"name\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f }%s\n",
+			r.name.c_str(), r.ops, r.nsPerOp, r.minNsPerOp, i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n");
+	fprintf(file, "}\n");
+}
+
+// reads back the name and ns_per_op of every benchmark written by writeJson
+static bool readJson(const char* path, std::vector<BenchResult>& results)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+	std::string text;
+	char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, n);
+	fclose(file);
+
+	results.clear();
+	size_t pos = 0;
+	while ((pos = text.find("\"name\": \"", pos)) != std::string::npos) {
+		pos += 9;
+		size_t end = text.find('"', pos);
+		size_t value = text.find("\"ns_per_op\": ", end);
+		if (end == std::string::npos || value == std::string::npos)
+			return false;
+
+		BenchResult r;
+		r.name = text.substr(pos, end - pos);
+		r.ops = 0;
+		r.nsPerOp = atof(text.c_str() + value + 13);
+		r.minNsPerOp = r.nsPerOp;
+		results.push_back(r);
+		pos = value;
+	}
+	return true;
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-f filter] [-t seconds] [-o results.json] [-c baseline.json] [-r percent]\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+	const char* filter = "";
+	double seconds = 0.5;
+	const char* outPath = 0;
+	const char* baselinePath = 0;
+	double threshold = 10.0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			outPath = argv[++i];
+		else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			baselinePath = argv[++i];
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			threshold = atof(argv[++i]);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (seconds <= 0.0 || threshold < 0.0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<BenchResult> baseline;
+	if (baselinePath && !readJson(baselinePath, baseline)) {
+		fprintf(stderr, "%s: can't read baseline %s\n", argv[0], baselinePath);
+		return 1;
+	}
+
+	std::vector<std::pair<std::string, BenchBody> > benches;
+	addBenchmarks(benches);
+
+	std::vector<BenchResult> results;
+	int regressions = 0;
+	for (size_t i = 0; i < benches.size(); i++) {
+		if (benches[i].first.find(filter) == std::string::npos)
+			continue;
+		BenchResult r = measure(benches[i].first, benches[i].second, seconds);
+		results.push_back(r);
+
+		fprintf(stderr, "%-32s %12.2f ns/op", r.name.c_str(), r.nsPerOp);
+		for (size_t b = 0; b < baseline.size(); b++) {
+			if (baseline[b].name != r.name || baseline[b].nsPerOp <= 0.0)
+				continue;
+			double change = (r.nsPerOp / baseline[b].nsPerOp - 1.0) * 100.0;
+			bool regressed = change > threshold;
+			regressions += regressed;
+			fprintf(stderr, "  baseline %12.2f  %+7.1f%%%s", baseline[b].nsPerOp, change, regressed ? "  REGRESSION" : "");
+			break;
+		}
+		fprintf(stderr, "\n");
+	}
+
+	FILE* out = stdout;
+	if (outPath && (out = fopen(outPath, "w")) == NULL) {
+		fprintf(stderr, "%s: can't write %s\n", argv[0], outPath);
+		return 1;
+	}
+	writeJson(out, results);
+	if (out != stdout)
+		fclose(out);
+
+	if (regressions > 0) {
+		fprintf(stderr, "%d benchmark(s) slower than the baseline by more than %.1f%%\n", regressions, threshold);
+		return 1;
+	}
+	return 0;
+}
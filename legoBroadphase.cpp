@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoBroadphase.cpp
+//
+// Desc: Sweep-and-prune broadphase for moving balls.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoBroadphase.h"
+#include <algorithm>
+#include <cmath>
+
+// stable counting sort of in by a (or b) into out, for indices below count
+static void countingSort(const std::vector<lego::BroadPair>& in, std::vector<lego::BroadPair>& out,
+	std::vector<int>& starts, int count, bool byA)
+{
+	starts.assign(count + 1, 0);
+	for (size_t p = 0; p < in.size(); p++)
+		starts[(byA ? in[p].a : in[p].b) + 1]++;
+	for (int i = 0; i < count; i++)
+		starts[i + 1] += starts[i];
+	out.resize(in.size());
+	for (size_t p = 0; p < in.size(); p++)
+		out[starts[byA ? in[p].a : in[p].b]++] = in[p];
+}
+
+void lego::SweepAndPrune::update(const float* x, const float* z, int count, float radius, int only)
+{
+	int i, j;
+
+	if ((int)m_entries.size() != count) {
+		// balls were added or removed, start over
+		m_entries.resize(count);
+		for (i = 0; i < count; i++) {
+			m_entries[i].x = x[i];
+			m_entries[i].index = i;
+		}
+		std::sort(m_entries.begin(), m_entries.end(),
+			[](const Entry& a, const Entry& b) { return a.x < b.x; });
+	}
+	else {
+		// temporal coherence: last frame's order is almost right
+		for (i = 0; i < count; i++)
+			m_entries[i].x = x[m_entries[i].index];
+		for (i = 1; i < count; i++) {
+			Entry e = m_entries[i];
+			for (j = i - 1; j >= 0 && e.x < m_entries[j].x; j--)
+				m_entries[j + 1] = m_entries[j];
+			m_entries[j + 1] = e;
+		}
+	}
+
+	// sweep along x, prune on z
+	const float reach = 2 * radius;
+	m_pairs.clear();
+	if (only >= 0) {
+		// the neighbours of one ball, on both sides of it
+		for (i = 0; m_entries[i].index != only; i++) {}
+		const Entry& a = m_entries[i];
+		for (int step = -1; step <= 1; step += 2) {
+			for (j = i + step; j >= 0 && j < count && fabsf(m_entries[j].x - a.x) <= reach; j += step) {
+				const Entry& b = m_entries[j];
+				if (fabsf(z[b.index] - z[a.index]) <= reach) {
+					BroadPair pair;
+					pair.a = std::min(a.index, b.index);
+					pair.b = std::max(a.index, b.index);
+					m_pairs.push_back(pair);
+				}
+			}
+		}
+	}
+	else {
+		for (i = 0; i < count; i++) {
+			const Entry& a = m_entries[i];
+			for (j = i + 1; j < count && m_entries[j].x - a.x <= reach; j++) {
+				const Entry& b = m_entries[j];
+				if (fabsf(z[b.index] - z[a.index]) <= reach) {
+					BroadPair pair;
+					pair.a = std::min(a.index, b.index);
+					pair.b = std::max(a.index, b.index);
+					m_pairs.push_back(pair);
+				}
+			}
+		}
+	}
+
+	// the order of the pairs must not depend on the history of the sort.
+	// by b, then stably by a: (a, b) order in time linear in the pairs,
+	// where a comparison sort is what costs most once balls bunch up
+	countingSort(m_pairs, m_sorted, m_starts, count, false);
+	countingSort(m_sorted, m_pairs, m_starts, count, true);
+}
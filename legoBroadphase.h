@@ -0,0 +1,55 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoBroadphase.h
+//
+// Desc: Sweep-and-prune broadphase for moving balls. Balls are kept sorted
+//       along x between frames, so with coherent motion the insertion sort
+//       that restores the order is close to linear. Overlapping intervals
+//       on x are then checked on z and reported as candidate pairs.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoBroadphaseH__
+#define __legoBroadphaseH__
+
+#include <vector>
+
+namespace lego
+{
+	// two balls that may touch, a < b
+	struct BroadPair
+	{
+		int a;
+		int b;
+	};
+
+	class SweepAndPrune {
+	public:
+		SweepAndPrune(void) {}
+
+		// positions of count balls of the given radius. when count changes
+		// the order is rebuilt from scratch, otherwise last frame's order
+		// is reused. with only >= 0, just the pairs of that ball are found.
+		void update(const float* x, const float* z, int count, float radius, int only = -1);
+
+		// candidate pairs of the last update, sorted by (a, b)
+		const std::vector<BroadPair>& getPairs(void) const { return m_pairs; }
+		int getPairCount(void) const { return (int)m_pairs.size(); }
+
+		void clear(void) { m_entries.clear(); m_pairs.clear(); m_sorted.clear(); }
+
+	private:
+		struct Entry
+		{
+			float	x;
+			int		index;
+		};
+
+		std::vector<Entry>		m_entries;	// balls sorted by x
+		std::vector<BroadPair>	m_pairs;
+		std::vector<BroadPair>	m_sorted;	// scratch
+		std::vector<int>		m_starts;	// scratch
+	};
+}
+
+#endif // __legoBroadphaseH__
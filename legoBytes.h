@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoBytes.h
+//
+// Desc: Little endian and varint encoding of the binary formats (replay
+//       logs, state streams), byte by byte so they read the same on any
+//       cpu.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoBytesH__
+#define __legoBytesH__
+
+#include <cstring>
+#include <vector>
+
+namespace lego
+{
+	inline void writeU32(std::vector<unsigned char>& out, unsigned int v)
+	{
+		for (int i = 0; i < 4; i++)
+			out.push_back((unsigned char)(v >> (8 * i)));
+	}
+
+	inline void writeF32(std::vector<unsigned char>& out, float f)
+	{
+		unsigned int v;
+		memcpy(&v, &f, sizeof(v));
+		writeU32(out, v);
+	}
+
+	inline void writeVarint(std::vector<unsigned char>& out, unsigned int v)
+	{
+		while (v >= 0x80) {
+			out.push_back((unsigned char)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((unsigned char)v);
+	}
+
+	// small negative numbers as small varints: 0, -1, 1, -2, 2 ...
+	inline void writeSigned(std::vector<unsigned char>& out, int v)
+	{
+		writeVarint(out, ((unsigned int)v << 1) ^ (unsigned int)(v >> 31));
+	}
+
+	// reads from a byte range, any overrun turns the reader bad for good
+	class ByteReader {
+	public:
+		ByteReader(const unsigned char* data, size_t size) : m_data(data), m_size(size), m_pos(0), m_bad(false) {}
+
+		bool good(void) const { return !m_bad; }
+		bool atEnd(void) const { return m_pos == m_size; }
+		// bytes read so far
+		size_t getPosition(void) const { return m_pos; }
+
+		unsigned char readU8(void)
+		{
+			if (m_pos >= m_size) {
+				m_bad = true;
+				return 0;
+			}
+			return m_data[m_pos++];
+		}
+
+		unsigned int readU32(void)
+		{
+			unsigned int v = 0;
+			for (int i = 0; i < 4; i++)
+				v |= (unsigned int)readU8() << (8 * i);
+			return v;
+		}
+
+		float readF32(void)
+		{
+			unsigned int v = readU32();
+			float f;
+			memcpy(&f, &v, sizeof(f));
+			return f;
+		}
+
+		unsigned int readVarint(void)
+		{
+			unsigned int v = 0;
+			for (int shift = 0; shift < 35; shift += 7) {
+				unsigned char b = readU8();
+				v |= (unsigned int)(b & 0x7f) << shift;
+				if (!(b & 0x80))
+					return v;
+			}
+			m_bad = true;
+			return 0;
+		}
+
+		int readSigned(void)
+		{
+			unsigned int v = readVarint();
+			return (int)(v >> 1) ^ -(int)(v & 1);
+		}
+
+	private:
+		const unsigned char*	m_data;
+		size_t					m_size;
+		size_t					m_pos;
+		bool					m_bad;
+	};
+}
+
+#endif // __legoBytesH__
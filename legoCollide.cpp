@@ -0,0 +1,236 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoCollide.cpp
+//
+// Desc: Batched ball-vs-brick intersection kernels and their runtime dispatch.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoCollide.h"
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LEGO_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// AVX2 code is compiled per function so the rest of the build keeps the baseline ISA
+#if defined(LEGO_X86) && (defined(__GNUC__) || defined(__clang__))
+#define LEGO_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LEGO_TARGET_AVX2
+#endif
+
+typedef unsigned int (*BlockKernel)(
+	const float* bx, const float* by, const float* bz,
+	const unsigned char* alive, int count,
+	float x, float y, float z, float reachSq);
+
+// -----------------------------------------------------------------------------
+// Kernels
+// -----------------------------------------------------------------------------
+
+static unsigned int intersectBlockScalar(
+	const float* bx, const float* by, const float* bz,
+	const unsigned char* alive, int count,
+	float x, float y, float z, float reachSq)
+{
+	unsigned int mask = 0;
+	for (int i = 0; i < count; i++) {
+		float dx = bx[i] - x;
+		float dy = by[i] - y;
+		float dz = bz[i] - z;
+		if (alive[i] && dx * dx + dy * dy + dz * dz <= reachSq)
+			mask |= 1u << i;
+	}
+	return mask;
+}
+
+#ifdef LEGO_X86
+
+static unsigned int intersectBlockSse2(
+	const float* bx, const float* by, const float* bz,
+	const unsigned char* alive, int count,
+	float x, float y, float z, float reachSq)
+{
+	if (count != lego::collideBlockSize)
+		return intersectBlockScalar(bx, by, bz, alive, count, x, y, z, reachSq);
+
+	const __m128 px = _mm_set1_ps(x);
+	const __m128 py = _mm_set1_ps(y);
+	const __m128 pz = _mm_set1_ps(z);
+	const __m128 reach = _mm_set1_ps(reachSq);
+	const __m128i zero = _mm_setzero_si128();
+
+	// 16 alive flags widened to four vectors of 32 bit lanes
+	__m128i flags8 = _mm_loadu_si128((const __m128i*)alive);
+	__m128i flags16lo = _mm_unpacklo_epi8(flags8, zero);
+	__m128i flags16hi = _mm_unpackhi_epi8(flags8, zero);
+	__m128i flags32[4] = {
+		_mm_unpacklo_epi16(flags16lo, zero), _mm_unpackhi_epi16(flags16lo, zero),
+		_mm_unpacklo_epi16(flags16hi, zero), _mm_unpackhi_epi16(flags16hi, zero)
+	};
+
+	unsigned int mask = 0;
+	for (int j = 0; j < 4; j++) {
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(bx + j * 4), px);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(by + j * 4), py);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(bz + j * 4), pz);
+		__m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 hit = _mm_cmple_ps(distSq, reach);
+		__m128 live = _mm_castsi128_ps(_mm_cmpgt_epi32(flags32[j], zero));
+		mask |= (unsigned int)_mm_movemask_ps(_mm_and_ps(hit, live)) << (j * 4);
+	}
+	return mask;
+}
+
+LEGO_TARGET_AVX2
+static unsigned int intersectBlockAvx2(
+	const float* bx, const float* by, const float* bz,
+	const unsigned char* alive, int count,
+	float x, float y, float z, float reachSq)
+{
+	if (count != lego::collideBlockSize)
+		return intersectBlockScalar(bx, by, bz, alive, count, x, y, z, reachSq);
+
+	const __m256 px = _mm256_set1_ps(x);
+	const __m256 py = _mm256_set1_ps(y);
+	const __m256 pz = _mm256_set1_ps(z);
+	const __m256 reach = _mm256_set1_ps(reachSq);
+	const __m256i zero = _mm256_setzero_si256();
+
+	unsigned int mask = 0;
+	for (int j = 0; j < 2; j++) {
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(bx + j * 8), px);
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(by + j * 8), py);
+		__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(bz + j * 8), pz);
+		__m256 distSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+		__m256 hit = _mm256_cmp_ps(distSq, reach, _CMP_LE_OQ);
+
+		__m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(alive + j * 8)));
+		__m256 live = _mm256_castsi256_ps(_mm256_cmpgt_epi32(flags, zero));
+		mask |= (unsigned int)_mm256_movemask_ps(_mm256_and_ps(hit, live)) << (j * 8);
+	}
+	return mask;
+}
+
+static bool cpuHasAvx2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	// the OS has to save the ymm registers too
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // LEGO_X86
+
+// -----------------------------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------------------------
+
+struct KernelEntry
+{
+	const char*	name;
+	BlockKernel	kernel;
+	bool		supported;
+};
+
+static KernelEntry* getKernelTable(int* count)
+{
+	static KernelEntry table[] = {
+#ifdef LEGO_X86
+		{ "avx2", intersectBlockAvx2, cpuHasAvx2() },
+		{ "sse2", intersectBlockSse2, true },
+#endif
+		{ "scalar", intersectBlockScalar, true },
+	};
+	*count = sizeof(table) / sizeof(table[0]);
+	return table;
+}
+
+// the first supported entry of the table is the fastest one
+static KernelEntry* findFastestKernel(void)
+{
+	int count;
+	KernelEntry* table = getKernelTable(&count);
+	for (int i = 0; i < count; i++) {
+		if (table[i].supported)
+			return &table[i];
+	}
+	return &table[count - 1];
+}
+
+// set by setCollisionKernel(), 0 picks the fastest one
+static KernelEntry* g_kernel = 0;
+
+static KernelEntry* getKernel(void)
+{
+	// worlds may be stepped from several threads at once, so the default
+	// is picked by a thread-safe static rather than written to g_kernel
+	static KernelEntry* fastest = findFastestKernel();
+	return g_kernel != 0 ? g_kernel : fastest;
+}
+
+const char* lego::getCollisionKernel(void)
+{
+	return getKernel()->name;
+}
+
+bool lego::setCollisionKernel(const char* name)
+{
+	int count;
+	KernelEntry* table = getKernelTable(&count);
+	for (int i = 0; i < count; i++) {
+		if (strcmp(table[i].name, name) == 0 && table[i].supported) {
+			g_kernel = &table[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+unsigned int lego::intersectBlock(
+	const float* bx, const float* by, const float* bz,
+	const unsigned char* alive, int count,
+	float x, float y, float z, float reachSq)
+{
+	return getKernel()->kernel(bx, by, bz, alive, count, x, y, z, reachSq);
+}
+
+int lego::findTouchingBricks(const BallArray& bricks, float x, float y, float z, float reach, std::vector<int>& hits)
+{
+	BlockKernel kernel = getKernel()->kernel;
+	const float* bx = bricks.getPositionX();
+	const float* by = bricks.getPositionY();
+	const float* bz = bricks.getPositionZ();
+	const unsigned char* alive = bricks.getAliveFlags();
+	const int count = bricks.size();
+	const float reachSq = reach * reach;
+
+	hits.clear();
+	for (int first = 0; first < count; first += collideBlockSize) {
+		int n = count - first < collideBlockSize ? count - first : collideBlockSize;
+		unsigned int mask = kernel(bx + first, by + first, bz + first, alive + first, n, x, y, z, reachSq);
+		for (int i = 0; mask != 0; i++, mask >>= 1) {
+			if (mask & 1)
+				hits.push_back(first + i);
+		}
+	}
+	return (int)hits.size();
+}
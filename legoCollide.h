@@ -0,0 +1,40 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoCollide.h
+//
+// Desc: Batched ball-vs-brick intersection tests. A ball is tested against
+//       16 bricks at a time using squared distances, with SSE2 / AVX2
+//       kernels picked at runtime and a scalar fallback for other CPUs.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoCollideH__
+#define __legoCollideH__
+
+#include "legoBalls.h"
+#include <vector>
+
+namespace lego
+{
+	const int collideBlockSize = 16;
+
+	// tests the ball at (x, y, z) against count (<= 16) bricks and returns a
+	// mask with bit i set if brick i is alive and closer than sqrt(reachSq)
+	unsigned int intersectBlock(
+		const float* bx, const float* by, const float* bz,
+		const unsigned char* alive, int count,
+		float x, float y, float z, float reachSq);
+
+	// finds every alive brick touching a ball at (x, y, z). the indices are
+	// written to hits in increasing order, returns how many were found.
+	int findTouchingBricks(const BallArray& bricks, float x, float y, float z, float reach, std::vector<int>& hits);
+
+	// name of the kernel in use: "avx2", "sse2" or "scalar"
+	const char* getCollisionKernel(void);
+
+	// force a kernel, e.g. to compare them. false if the cpu lacks it.
+	// not to be called while worlds are being stepped on other threads.
+	bool setCollisionKernel(const char* name);
+}
+
+#endif // __legoCollideH__
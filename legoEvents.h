@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoEvents.h
+//
+// Desc: Priority queue of predicted collision events, for the event-driven
+//       simulation mode. An event carries the collision count of its ball
+//       at prediction time; once the ball has collided again the event is
+//       stale and is dropped when it reaches the top of the queue.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoEventsH__
+#define __legoEventsH__
+
+#include <queue>
+#include <vector>
+
+namespace lego
+{
+	enum EventType
+	{
+		EVENT_WALL,		// ball reaches a wall
+		EVENT_BRICK,	// ball reaches a brick
+		EVENT_BALL,		// ball reaches another ball, e.g. the grey one
+		EVENT_LOST		// ball crosses the line behind the grey ball
+	};
+
+	struct SimEvent
+	{
+		float			time;		// absolute simulation time
+		EventType		type;
+		int				target;		// wall, brick or ball index
+		unsigned int	stamp;		// collision count of the ball when predicted
+	};
+
+	class EventQueue {
+	public:
+		void push(float time, EventType type, int target, unsigned int stamp)
+		{
+			SimEvent e;
+			e.time = time;
+			e.type = type;
+			e.target = target;
+			e.stamp = stamp;
+			m_heap.push(e);
+		}
+
+		// drops events predicted before the ball's last collision, then
+		// returns false if nothing valid is left
+		bool top(unsigned int stamp, SimEvent& e)
+		{
+			while (!m_heap.empty() && m_heap.top().stamp != stamp)
+				m_heap.pop();
+			if (m_heap.empty())
+				return false;
+			e = m_heap.top();
+			return true;
+		}
+
+		void pop(void) { m_heap.pop(); }
+		void clear(void) { m_heap = Heap(); }
+		bool empty(void) const { return m_heap.empty(); }
+
+	private:
+		struct Later
+		{
+			bool operator()(const SimEvent& a, const SimEvent& b) const { return a.time > b.time; }
+		};
+		typedef std::priority_queue<SimEvent, std::vector<SimEvent>, Later> Heap;
+
+		Heap m_heap;
+	};
+}
+
+#endif // __legoEventsH__
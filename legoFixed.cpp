@@ -0,0 +1,239 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoFixed.cpp
+//
+// Desc: Fixed-point ball / wall / brick rules. Each one follows its float
+//       twin in legoPhysics.cpp step by step.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoFixed.h"
+#include <algorithm>
+
+static const lego::Fixed fixedPi = lego::toFixed(3.14159265f);
+static const lego::Fixed fixedHalfPi = fixedPi / 2;
+static const lego::Fixed fixedWallThickness = lego::toFixed(lego::wallThickness);
+// how far off a wall a ball is put back
+static const lego::Fixed fixedWallGap = lego::toFixed(0.05f);
+
+static lego::Fixed clampSpeed(lego::Fixed v)
+{
+	return std::min(std::max(v, -lego::fixedMaxSpeed), lego::fixedMaxSpeed);
+}
+
+// the distance a ball moving at v covers in time
+static lego::Fixed moveBy(lego::Fixed v, lego::Fixed64 time)
+{
+	return lego::saturate(((lego::Fixed64)lego::fixedMul(lego::fixedTimeScale, v) * time) >> 32);
+}
+
+// x from -pi/2 to pi/2, taylor series to x^11
+static lego::Fixed sinQuarter(lego::Fixed x)
+{
+	using lego::fixedMul;
+	using lego::fixedOne;
+	lego::Fixed x2 = fixedMul(x, x);
+	lego::Fixed r = fixedOne;
+	r = fixedOne - fixedMul(x2, r) / 110;
+	r = fixedOne - fixedMul(x2, r) / 72;
+	r = fixedOne - fixedMul(x2, r) / 42;
+	r = fixedOne - fixedMul(x2, r) / 20;
+	r = fixedOne - fixedMul(x2, r) / 6;
+	return fixedMul(x, r);
+}
+
+// x from -pi to pi
+static lego::Fixed sinHalf(lego::Fixed x)
+{
+	if (x > fixedHalfPi)
+		x = fixedPi - x;
+	else if (x < -fixedHalfPi)
+		x = -fixedPi - x;
+	return sinQuarter(x);
+}
+
+void lego::fixedSinCos(Fixed angle, Fixed& sine, Fixed& cosine)
+{
+	sine = sinHalf(angle);
+	Fixed shifted = angle + fixedHalfPi;
+	if (shifted > fixedPi)
+		shifted -= 2 * fixedPi;
+	cosine = sinHalf(shifted);
+}
+
+bool lego::fixedSpheresIntersect(Fixed dx, Fixed dy, Fixed dz)
+{
+	// farther on any axis, and the squares can't overflow below
+	if (fixedAbs(dx) > fixedTouchDistance || fixedAbs(dy) > fixedTouchDistance || fixedAbs(dz) > fixedTouchDistance)
+		return false;
+	Fixed64 distance = (Fixed64)dx * dx + (Fixed64)dy * dy + (Fixed64)dz * dz;
+	return distance <= (Fixed64)fixedTouchDistance * fixedTouchDistance;
+}
+
+void lego::fixedBounceOffBrick(Sphere& ball, Fixed brickVX, Fixed brickVZ)
+{
+	Fixed vx = toFixed(ball.getVelocity_X());
+	Fixed vz = toFixed(ball.getVelocity_Z());
+	// Q32.32 over Q16.16
+	Fixed64 product = (Fixed64)(vx + brickVX) * vx;
+	Fixed vXAfterCollision = vz == 0 ? (product < 0 ? fixedMin : fixedMax) : saturate(product / vz);
+	Fixed vZAfterCollision = vz + brickVZ;
+	ball.setPower(toFloat(clampSpeed(-vXAfterCollision)), toFloat(clampSpeed(-vZAfterCollision)));
+}
+
+bool lego::fixedBounceBalls(Sphere& a, Sphere& b)
+{
+	Vector3 ca = a.getCenter(), cb = b.getCenter();
+	Fixed dx = toFixed(cb.x) - toFixed(ca.x);
+	Fixed dz = toFixed(cb.z) - toFixed(ca.z);
+	if (!fixedSpheresIntersect(dx, toFixed(cb.y) - toFixed(ca.y), dz))
+		return false;
+	Fixed avx = toFixed(a.getVelocity_X()), avz = toFixed(a.getVelocity_Z());
+	Fixed bvx = toFixed(b.getVelocity_X()), bvz = toFixed(b.getVelocity_Z());
+	// Q32.32; the centers are within a touch distance and the speeds
+	// within fixedMaxSpeed, so neither overflows
+	Fixed64 approach = (Fixed64)dx * (bvx - avx) + (Fixed64)dz * (bvz - avz);
+	Fixed64 distance = (Fixed64)dx * dx + (Fixed64)dz * dz;
+	if (approach >= 0 || distance == 0)
+		return false;
+
+	Fixed k = saturate(approach * fixedOne / distance);
+	Fixed kx = fixedMul(k, dx), kz = fixedMul(k, dz);
+	a.setPower(toFloat(clampSpeed(avx + kx)), toFloat(clampSpeed(avz + kz)));
+	b.setPower(toFloat(clampSpeed(bvx - kx)), toFloat(clampSpeed(bvz - kz)));
+	return true;
+}
+
+bool lego::fixedHitBy(Sphere& sphere, Sphere& ball)
+{
+	Vector3 a = sphere.getCenter();
+	Vector3 b = ball.getCenter();
+	if (!fixedSpheresIntersect(toFixed(a.x) - toFixed(b.x), toFixed(a.y) - toFixed(b.y), toFixed(a.z) - toFixed(b.z)))
+		return false;
+	sphere.wake();
+	ball.wake();
+
+	// if one of the balls intersected is yellow, then destroy that and save the other ball.
+	if (sphere.getType() == SPHERE_BRICK) {
+		fixedBounceOffBrick(ball, toFixed(sphere.getVelocity_X()), toFixed(sphere.getVelocity_Z()));
+		sphere.setCenter(a.x, -500.0f, a.z);
+		return true;
+	}
+	else if (ball.getType() == SPHERE_BRICK) {
+		fixedBounceOffBrick(sphere, toFixed(ball.getVelocity_X()), toFixed(ball.getVelocity_Z()));
+		ball.setCenter(a.x, -500.0f, a.z);
+		return true;
+	}
+	// else, it is collision of grey and red balls.
+	else if (ball.getType() == SPHERE_RED) {
+		ball.setPower(ball.getVelocity_X(), -ball.getVelocity_Z());
+	}
+	return false;
+}
+
+void lego::fixedBallUpdate(Sphere& ball, Fixed64 timeDiff)
+{
+	if (!ball.isAwake())
+		return;
+
+	Vector3 cord = ball.getCenter();
+	Fixed vx = toFixed(ball.getVelocity_X());
+	Fixed vz = toFixed(ball.getVelocity_Z());
+
+	if (fixedAbs(vx) > fixedSleepSpeed || fixedAbs(vz) > fixedSleepSpeed) {
+		Fixed tX = saturate((Fixed64)toFixed(cord.x) + moveBy(vx, timeDiff));
+		Fixed tZ = saturate((Fixed64)toFixed(cord.z) + moveBy(vz, timeDiff));
+
+		// correction of position of ball, necessary when a ball collides with a wall
+		if (tX >= fixedBallLimitX)
+			tX = fixedBallLimitX;
+		else if (tX <= -fixedBallLimitX)
+			tX = -fixedBallLimitX;
+		else if (tZ <= -fixedBallLimitZ)
+			tZ = -fixedBallLimitZ;
+		else if (tZ >= fixedBallLimitZ)
+			tZ = fixedBallLimitZ;
+
+		ball.setCenter(toFloat(tX), cord.y, toFloat(tZ));
+	}
+	else { ball.setPower(0, 0); }	// falls asleep
+}
+
+bool lego::fixedWallHitBy(const Wall& wall, Fixed& x, Fixed& z, Fixed& vx, Fixed& vz)
+{
+	Fixed wallX = toFixed(wall.getPositionX());
+	Fixed wallZ = toFixed(wall.getPositionZ());
+	Fixed width = toFixed(wall.getWidth());
+	Fixed depth = toFixed(wall.getDepth());
+
+	// reflect the ball.
+	if (width > depth) {
+		if (fixedAbs(z - wallZ) > fixedRadius + depth / 2)
+			return false;
+		vz = -vz;
+		z = wallZ - fixedWallThickness - fixedRadius - fixedWallGap;
+	}
+	else if (depth > width) {
+		if (fixedAbs(x - wallX) > fixedRadius + width / 2)
+			return false;
+		Fixed offset = fixedWallThickness / 2 + fixedRadius + fixedWallGap;
+		x = wallX > 0 ? wallX - offset : wallX + offset;
+		vx = -vx;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+bool lego::fixedWallHitBy(const Wall& wall, Sphere& ball)
+{
+	Vector3 center = ball.getCenter();
+	Fixed x = toFixed(center.x);
+	Fixed z = toFixed(center.z);
+	Fixed vx = toFixed(ball.getVelocity_X());
+	Fixed vz = toFixed(ball.getVelocity_Z());
+	if (!fixedWallHitBy(wall, x, z, vx, vz))
+		return false;
+	ball.setPower(toFloat(vx), toFloat(vz));
+	ball.setCenter(toFloat(x), center.y, toFloat(z));
+	return true;
+}
+
+void lego::fixedHitByWall(BallArray& balls, const Wall& wall)
+{
+	const int* active = balls.getActiveBalls();
+	for (int k = 0; k < balls.getActiveCount(); k++) {
+		int i = active[k];
+		Vector3 center = balls.getCenter(i);
+		Fixed x = toFixed(center.x);
+		Fixed z = toFixed(center.z);
+		Fixed vx = toFixed(balls.getVelocity_X(i));
+		Fixed vz = toFixed(balls.getVelocity_Z(i));
+		if (fixedWallHitBy(wall, x, z, vx, vz)) {
+			balls.setPower(i, toFloat(vx), toFloat(vz));
+			balls.setCenter(i, toFloat(x), center.y, toFloat(z));
+		}
+	}
+}
+
+int lego::fixedSubSteps(const Sphere& ball, Fixed64 timeDiff, int maxSteps)
+{
+	if (!ball.isAwake())
+		return 1;
+	Fixed speed = std::max(fixedAbs(toFixed(ball.getVelocity_X())), fixedAbs(toFixed(ball.getVelocity_Z())));
+	Fixed64 length = moveBy(speed, timeDiff);
+	return (int)std::min<Fixed64>(length / fixedRadius + 1, maxSteps);
+}
+
+void lego::fixedFilterBricks(const BallArray& bricks, Fixed x, Fixed y, Fixed z, std::vector<int>& hits)
+{
+	size_t kept = 0;
+	for (size_t h = 0; h < hits.size(); h++) {
+		Vector3 brick = bricks.getCenter(hits[h]);
+		if (fixedSpheresIntersect(toFixed(brick.x) - x, toFixed(brick.y) - y, toFixed(brick.z) - z))
+			hits[kept++] = hits[h];
+	}
+	hits.resize(kept);
+	std::sort(hits.begin(), hits.end());
+}
@@ -0,0 +1,104 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoFixed.h
+//
+// Desc: Fixed-point arithmetic, and the ball / wall / brick rules of
+//       legoPhysics.h done with it, for Game::setFixedPoint().
+//
+//       The float rules give the same results only where the compiler
+//       evaluates every expression the same way: x87 excess precision,
+//       fused multiply-adds and the libm's sinf / cosf all change the last
+//       bits, and a game amplifies any bit into a different outcome. These
+//       rules use nothing but integer arithmetic, so every machine and
+//       every build steps a game to the same bits, given the same level
+//       data and inputs.
+//
+//       Positions and velocities are Q16.16. Times and squared distances,
+//       which need the range or the precision, are Q32.32. Sphere still
+//       stores floats: velocities are kept within fixedMaxSpeed, and every
+//       Q16.16 value below 256 converts to a float and back exactly, so the
+//       floats are exact images of the integers and the renderers, the
+//       state hash and the replay logs need no change.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoFixedH__
+#define __legoFixedH__
+
+#include "legoPhysics.h"
+#include "legoBalls.h"
+#include <vector>
+
+namespace lego
+{
+	typedef int Fixed;			// Q16.16
+	typedef long long Fixed64;	// Q32.32
+
+	const int fixedShift = 16;
+	const Fixed fixedOne = 1 << fixedShift;
+	const Fixed fixedMax = 0x7fffffff;
+	const Fixed fixedMin = -fixedMax;
+
+	// truncates, and saturates outside the range
+	constexpr Fixed toFixed(float v)
+	{
+		return v >= 32767.0f ? fixedMax : v <= -32767.0f ? fixedMin : (Fixed)(v * (float)fixedOne);
+	}
+	inline float toFloat(Fixed v) { return (float)v / fixedOne; }
+
+	constexpr Fixed saturate(Fixed64 v)
+	{
+		return v > fixedMax ? fixedMax : v < fixedMin ? fixedMin : (Fixed)v;
+	}
+	constexpr Fixed fixedMul(Fixed a, Fixed b) { return saturate(((Fixed64)a * b) >> fixedShift); }
+	constexpr Fixed fixedAbs(Fixed v) { return v < 0 ? -v : v; }
+
+	// seconds to Q32.32, 0 to 8, which keeps a move within 64 bits
+	inline Fixed64 toFixed64(float seconds)
+	{
+		double v = seconds > 8.0f ? 8.0 : seconds < 0.0f ? 0.0 : (double)seconds;
+		return (Fixed64)(v * 4294967296.0);
+	}
+
+	// the rules' constants, folded at compile time from the float ones
+	const Fixed fixedRadius = toFixed(ballRadius);
+	const Fixed fixedTouchDistance = toFixed(touchDistance);
+	// from the Q16.16 sizes, so that a ball held at the limit touches the
+	// wall exactly, as it does with the float rules
+	const Fixed fixedBallLimitX = toFixed(horizontalBarWidth) / 2 - toFixed(wallThickness) / 2 - fixedRadius;
+	const Fixed fixedBallLimitZ = toFixed(verticalBarDepth) / 2 - toFixed(wallThickness) / 2 - fixedRadius;
+	const Fixed fixedLostZ = toFixed(-4.0f + ballRadius);
+	const Fixed fixedTimeScale = toFixed(ballTimeScale);
+	const Fixed fixedSleepSpeed = toFixed(sleepSpeed);
+	const Fixed fixedKeyStep = toFixed((float)KEYSTEP);
+	// faster balls are slowed down to this on each axis
+	const Fixed fixedMaxSpeed = 255 * fixedOne;
+
+	// sine and cosine of an angle in radians, polynomials on [-pi, pi]
+	void fixedSinCos(Fixed angle, Fixed& sine, Fixed& cosine);
+
+	// the rules of legoPhysics.h
+	bool fixedSpheresIntersect(Fixed dx, Fixed dy, Fixed dz);
+	void fixedBounceOffBrick(Sphere& ball, Fixed brickVX, Fixed brickVZ);
+	// as bounceBalls
+	bool fixedBounceBalls(Sphere& a, Sphere& b);
+	// as Sphere::hitBy, true when a brick was destroyed
+	bool fixedHitBy(Sphere& sphere, Sphere& ball);
+	// as Sphere::ballUpdate, for a Q32.32 time
+	void fixedBallUpdate(Sphere& ball, Fixed64 timeDiff);
+	// as Wall::hitBy, true if the ball touched the wall
+	bool fixedWallHitBy(const Wall& wall, Fixed& x, Fixed& z, Fixed& vx, Fixed& vz);
+	bool fixedWallHitBy(const Wall& wall, Sphere& ball);
+	// as BallArray::hitByWall
+	void fixedHitByWall(BallArray& balls, const Wall& wall);
+
+	// how many steps split a move of ball over timeDiff so that no step is
+	// longer than a radius, at most maxSteps
+	int fixedSubSteps(const Sphere& ball, Fixed64 timeDiff, int maxSteps);
+
+	// keeps out of hits the bricks that don't touch (x, y, z) and sorts the
+	// rest by index, the order the float query returns them in
+	void fixedFilterBricks(const BallArray& bricks, Fixed x, Fixed y, Fixed z, std::vector<int>& hits);
+}
+
+#endif // __legoFixedH__
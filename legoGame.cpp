@@ -0,0 +1,814 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoGame.cpp
+//
+// Desc: Game rules of Virtual Lego, independent of any renderer.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoGame.h"
+#include "legoFixed.h"
+#include "legoProfile.h"
+#include "legoThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+const float lego::spherePos[lego::totalBalls][2] = {
+	{-2.f, 4.0f} , {-1.5f,4.0f} , {0.0f,4.0f} , {1.5f,4.0f}, {2.0f,4.0f},
+	{-2.f,3.0f} , {-1.0f,3.0f} , {0.0f,3.0f} , {1.0f,3.0f}, {2.0f,3.0f},
+	{-2.f,2.0f} , {-1.0f,2.0f} , {0.0f,2.0f} , {1.0f,2.0f}, {2.0f,2.0f},
+	{-2.f,1.0f} , {-1.5f,1.0f} , {0.0f,1.0f} , {1.5f,1.0f}, {2.0f,1.0f},
+};
+
+void lego::makeBrickLayout(int count, std::vector<float>& positions)
+{
+	const float minX = -2.5f, maxX = 2.5f;
+	const float minZ = 0.5f, maxZ = 4.1f;
+
+	positions.clear();
+	if (count <= 0)
+		return;
+	positions.reserve(count * 2);
+
+	// in Q16.16, so every compiler and cpu lays out the same level, which
+	// the fixed-point mode needs. the columns are spaced about as the rows.
+	const long long width = toFixed(maxX) - toFixed(minX);
+	const long long depth = toFixed(maxZ) - toFixed(minZ);
+	int columns = 1;
+	while ((long long)columns * columns * depth < count * width)
+		columns++;
+	int rows = (count + columns - 1) / columns;
+	for (int i = 0; i < count; i++) {
+		int column = i % columns, row = i / columns;
+		positions.push_back(toFloat(toFixed(minX) + (columns > 1 ? (Fixed)(width * column / (columns - 1)) : 0)));
+		positions.push_back(toFloat(toFixed(maxZ) - (rows > 1 ? (Fixed)(depth * row / (rows - 1)) : 0)));
+	}
+}
+
+void lego::makeWalls(Wall walls[totalWalls])
+{
+	// create walls and set the position. note that there are four walls
+	walls[0].create(horizontalBarWidth, wallThickness);
+	walls[0].setPosition(0.0f, verticalBarDepth / 2);
+	walls[1].create(wallThickness, verticalBarDepth);
+	walls[1].setPosition(horizontalBarWidth / 2, 0.0f);
+	walls[2].create(wallThickness, verticalBarDepth);
+	walls[2].setPosition(-horizontalBarWidth / 2, 0.0f);
+}
+
+// epochs of the destroyed brick lists of every game, so a render state
+// filled from one game is never taken as up to date with another's
+static std::atomic<unsigned int> g_destroyedEpochs(0);
+
+lego::Game::Game(void)
+{
+	m_life = 5;
+	m_score = 0;
+	m_isRoundStarted = false;
+	m_isGameEnded = false;
+	m_continuousCollision = true;
+	m_fixedPoint = false;
+	m_sleepingSteps = 0;
+	m_multiBall = 0;
+	m_pool = 0;
+	m_redStamp = 0;
+	m_destroyedEpoch = 0;
+}
+
+void lego::Game::setFixedPoint(bool enable)
+{
+	if (enable == m_fixedPoint)
+		return;
+	m_fixedPoint = enable;
+	// the bricks were pushed out of the walls by the other mode's rule
+	if (m_level) {
+		std::vector<float> layout = m_level->layout;
+		setup(layout.empty() ? 0 : &layout[0], (int)layout.size() / 2);
+	}
+}
+
+void lego::Game::setup(void)
+{
+	setup(&spherePos[0][0], totalBalls);
+}
+
+void lego::Game::createWalls(void)
+{
+	makeWalls(m_walls);
+}
+
+void lego::Game::setup(const float* positions, int count)
+{
+	createWalls();
+
+	// bricks never move by themselves, so pushing them out of the walls once
+	// here keeps them put for the whole level and the grid stays valid.
+	std::shared_ptr<BrickLevel> level = std::make_shared<BrickLevel>();
+	level->layout.assign(positions, positions + count * 2);
+	level->bricks.reserve(count);
+	for (int i = 0; i < count; i++) {
+		level->bricks.add(positions[i * 2], (float)M_RADIUS, positions[i * 2 + 1], SPHERE_BRICK);
+	}
+	for (int i = 0; i < totalWalls; i++) {
+		if (m_fixedPoint)
+			fixedHitByWall(level->bricks, m_walls[i]);
+		else
+			level->bricks.hitByWall(m_walls[i]);
+	}
+	level->grid.build(level->bricks, 4 * (float)M_RADIUS);
+	m_level = level;
+
+	m_redBall.setType(SPHERE_RED);
+	m_greyBall.setType(SPHERE_GREY);
+	restart();
+}
+
+void lego::Game::restart(void)
+{
+	m_life = 5;
+	m_score = 0;
+	m_isRoundStarted = false;
+	m_isGameEnded = false;
+	resetAllPositions();
+}
+
+// reset all position
+void lego::Game::resetAllPositions(void)
+{
+	resetBricks();
+	resetRedAndGreyBalls();
+}
+
+// every brick of the level alive again
+void lego::Game::resetBricks(void)
+{
+	if (m_level) {
+		m_bricks = m_level->bricks;
+		m_brickGrid = m_level->grid;
+	}
+	else {
+		m_bricks.clear();
+		m_brickGrid.build(m_bricks, 4 * (float)M_RADIUS);
+	}
+	m_destroyed.clear();
+	m_destroyedEpoch = ++g_destroyedEpochs;
+}
+
+void lego::Game::setStatus(int life, int score, bool roundStarted, bool gameEnded)
+{
+	m_life = life;
+	m_score = score;
+	m_isRoundStarted = roundStarted;
+	m_isGameEnded = gameEnded;
+}
+
+void lego::Game::removeBrick(int i)
+{
+	if (!m_bricks.isAlive(i))
+		return;
+	m_bricks.setAlive(i, false);
+	m_brickGrid.remove(i);
+	m_destroyed.push_back(i);
+}
+
+void lego::Game::placeBalls(const Vector3& red, const Vector3& grey, const Vector3* extra, int count)
+{
+	m_redBall.setCenter(red.x, red.y, red.z);
+	m_greyBall.setCenter(grey.x, grey.y, grey.z);
+	m_extraBalls.resize(count);
+	for (int i = 0; i < count; i++) {
+		m_extraBalls[i].setType(SPHERE_RED);
+		m_extraBalls[i].setCenter(extra[i].x, extra[i].y, extra[i].z);
+	}
+}
+
+void lego::Game::saveState(GameState& state) const
+{
+	GameState::Header& header = state.m_header;
+	header.redBall = m_redBall;
+	header.greyBall = m_greyBall;
+	header.life = m_life;
+	header.score = m_score;
+	header.isRoundStarted = m_isRoundStarted;
+	header.isGameEnded = m_isGameEnded;
+	header.continuousCollision = m_continuousCollision;
+	header.fixedPoint = m_fixedPoint;
+	header.sleepingSteps = m_sleepingSteps;
+	header.multiBall = m_multiBall;
+	header.redStamp = m_redStamp;
+
+	state.m_level = m_level;
+	m_bricks.saveAlive(state.m_bricks);
+	m_brickGrid.saveLive(state.m_grid);
+	state.m_extraBalls = m_extraBalls;
+	state.m_powerUps = m_powerUps;
+}
+
+void lego::Game::restoreState(const GameState& state)
+{
+	if (m_level != state.m_level) {
+		// a game of another level, or none yet: take on the shared one
+		createWalls();
+		m_level = state.m_level;
+		resetBricks();
+	}
+
+	const GameState::Header& header = state.m_header;
+	m_redBall = header.redBall;
+	m_greyBall = header.greyBall;
+	m_life = header.life;
+	m_score = header.score;
+	m_isRoundStarted = header.isRoundStarted;
+	m_isGameEnded = header.isGameEnded;
+	m_continuousCollision = header.continuousCollision;
+	m_fixedPoint = header.fixedPoint;
+	m_sleepingSteps = header.sleepingSteps;
+	m_multiBall = header.multiBall;
+	m_redStamp = header.redStamp;
+
+	if (m_level) {
+		m_bricks.restoreAlive(state.m_bricks);
+		m_brickGrid.restoreLive(state.m_grid);
+	}
+	m_extraBalls = state.m_extraBalls;
+	m_powerUps = state.m_powerUps;
+
+	// the state doesn't keep the order they went in, which nothing needs
+	m_destroyed.clear();
+	for (int i = 0; i < m_bricks.size(); i++) {
+		if (!m_bricks.isAlive(i))
+			m_destroyed.push_back(i);
+	}
+	m_destroyedEpoch = ++g_destroyedEpochs;
+}
+
+void lego::Game::saveRenderState(RenderState& state) const
+{
+	if (state.level != m_level)
+		state.level = m_level;
+	state.redCenter = m_redBall.getCenter();
+	state.greyCenter = m_greyBall.getCenter();
+	state.extraCenters.resize(m_extraBalls.size());
+	for (size_t i = 0; i < m_extraBalls.size(); i++)
+		state.extraCenters[i] = m_extraBalls[i].getCenter();
+	state.life = m_life;
+	state.score = m_score;
+	state.isRoundStarted = m_isRoundStarted;
+	state.isGameEnded = m_isGameEnded;
+
+	// the list only grows within an epoch, so what state lacks is its end
+	if (state.destroyedEpoch != m_destroyedEpoch || state.destroyed.size() > m_destroyed.size()) {
+		state.destroyed = m_destroyed;
+		state.destroyedEpoch = m_destroyedEpoch;
+	}
+	else {
+		state.destroyed.insert(state.destroyed.end(), m_destroyed.begin() + state.destroyed.size(), m_destroyed.end());
+	}
+}
+
+size_t lego::GameState::getMemoryUsage(void) const
+{
+	return sizeof(*this)
+		+ m_bricks.alive.capacity() * sizeof(unsigned char)
+		+ (m_bricks.active.capacity() + m_bricks.activeSlot.capacity()) * sizeof(int)
+		+ m_grid.cellLive.capacity() * sizeof(int)
+		+ (m_grid.itemX.capacity() + m_grid.itemY.capacity() + m_grid.itemZ.capacity()) * sizeof(float)
+		+ m_grid.itemAlive.capacity() * sizeof(unsigned char)
+		+ (m_grid.itemBrick.capacity() + m_grid.brickItem.capacity()) * sizeof(int)
+		+ m_extraBalls.capacity() * sizeof(Sphere)
+		+ m_powerUps.capacity() * sizeof(Vector3);
+}
+
+void lego::Game::resetRedAndGreyBalls(void)
+{
+	m_extraBalls.clear();
+	m_powerUps.clear();
+
+	m_redBall.setCenter(.0f, (float)M_RADIUS, initialRedBallPosZ);
+	m_redBall.setPower(0.0, 0.0);
+
+	m_greyBall.setCenter(.0f, (float)M_RADIUS, initialGreyBallPosZ);
+	m_greyBall.setPower(0.0, 0.0);
+}
+
+void lego::Game::launchRedBall(void)
+{
+	// start game on space key down
+	if (m_life > 0 && !m_isRoundStarted && !m_isGameEnded) {
+		m_redBall.setPower(REDBALLSPEED, REDBALLSPEED);
+		m_isRoundStarted = true;
+	}
+}
+
+void lego::Game::moveGreyBallLeft(void)
+{
+	if (m_isGameEnded)
+		return;
+	if (m_fixedPoint) {
+		moveGreyBallFixed(-1);
+		return;
+	}
+	Vector3 ballCenter = m_greyBall.getCenter();
+	if ((ballCenter.x - KEYSTEP) > (m_walls[2].getPositionX() + m_walls[2].getWidth() / 2)) {
+		m_greyBall.setCenter((float)(ballCenter.x - KEYSTEP), ballCenter.y, ballCenter.z);
+		m_greyBall.setVelocity_X((float)(-KEYSTEP * 5));
+	}
+}
+
+void lego::Game::moveGreyBallRight(void)
+{
+	if (m_isGameEnded)
+		return;
+	if (m_fixedPoint) {
+		moveGreyBallFixed(1);
+		return;
+	}
+	Vector3 ballCenter = m_greyBall.getCenter();
+	if ((ballCenter.x + KEYSTEP) < (m_walls[1].getPositionX() - m_walls[1].getWidth() / 2)) {
+		m_greyBall.setCenter((float)(ballCenter.x + KEYSTEP), ballCenter.y, ballCenter.z);
+		m_greyBall.setVelocity_X((float)(KEYSTEP * 5));
+	}
+}
+
+void lego::Game::moveGreyBallFixed(int direction)
+{
+	Vector3 ballCenter = m_greyBall.getCenter();
+	Fixed x = toFixed(ballCenter.x) + direction * fixedKeyStep;
+	bool inside = direction < 0
+		? x > toFixed(m_walls[2].getPositionX()) + toFixed(m_walls[2].getWidth()) / 2
+		: x < toFixed(m_walls[1].getPositionX()) - toFixed(m_walls[1].getWidth()) / 2;
+	if (inside) {
+		m_greyBall.setCenter(toFloat(x), ballCenter.y, ballCenter.z);
+		m_greyBall.setVelocity_X(toFloat(direction * fixedKeyStep * 5));
+	}
+}
+
+void lego::Game::update(float timeDelta)
+{
+	LEGO_PROFILE_SCOPE("simulate");
+
+	// positions were reset when the game ended, nothing moves any more
+	if (m_isGameEnded)
+		return;
+
+	if (!m_redBall.isAwake()) {
+		// at rest, e.g. waiting for a launch: nothing to move, and the walls
+		// and bricks can't reach it. only a contact wakes it up.
+		m_sleepingSteps++;
+		if (m_isRoundStarted)
+			collideMovingBalls(true);
+	}
+	else if (m_fixedPoint) {
+		// the last piece takes what the division leaves
+		Fixed64 time = toFixed64(timeDelta);
+		int steps = fixedSubSteps(m_redBall, time, maxSubSteps);
+		for (int sub = 0; sub < steps; sub++) {
+			if (!stepRedBallFixed(time / steps + (sub + 1 == steps ? time % steps : 0)))
+				break;
+		}
+	}
+	else if (!m_continuousCollision) {
+		stepRedBall(timeDelta);
+	}
+	else {
+		// move the red ball from contact to contact, so a large timeDelta
+		// can't carry it through a brick or the grey ball
+		float remaining = timeDelta;
+		for (int sub = 0; remaining > 0.0f; sub++) {
+			float fraction = sub + 1 < maxSubSteps ? timeOfImpact(remaining) : 1.0f;
+			float stepTime = fraction >= 1.0f ? remaining : remaining * fraction;
+			remaining -= stepTime;
+			if (!stepRedBall(stepTime))
+				break;
+		}
+	}
+
+	// extra balls take one discrete step; balls released on the way join
+	// in on the next update
+	if (m_isRoundStarted) {
+		if (!m_extraBalls.empty())
+			stepExtraBalls(timeDelta);
+		if (m_isRoundStarted)
+			releasePowerUps();
+	}
+
+	// if no lives or no bricks left, all rounds are ended
+	if (m_life <= 0 || m_bricks.getAliveCount() == 0) {
+		m_isGameEnded = true;
+		resetAllPositions();
+	}
+}
+
+int lego::Game::fastForward(float duration, int maxEvents)
+{
+	LEGO_PROFILE_SCOPE("fast forward");
+	int events = 0;
+	float now = 0.0f;
+
+	if (m_isGameEnded)
+		return 0;
+	// events are only predicted for the red ball, with the float rules
+	if (!m_extraBalls.empty() || m_fixedPoint) {
+		update(duration);
+		return 0;
+	}
+
+	m_events.clear();
+	while (now < duration && m_isRoundStarted && events < maxEvents) {
+		predictEvents(now, duration);
+
+		SimEvent e;
+		if (!m_events.top(m_redStamp, e) || e.time >= duration) {
+			// nothing else happens before the end
+			stepRedBall(duration - now);
+			break;
+		}
+		m_events.pop();
+
+		// move to the contact and let the regular rules resolve it
+		bool going = stepRedBall(e.time - now);
+		now = e.time;
+		m_redStamp++;
+		events++;
+		if (!going)
+			break;
+	}
+
+	if (m_isRoundStarted)
+		releasePowerUps();
+
+	// if no lives or no bricks left, all rounds are ended
+	if (m_life <= 0 || m_bricks.getAliveCount() == 0) {
+		m_isGameEnded = true;
+		resetAllPositions();
+	}
+	return events;
+}
+
+void lego::Game::predictEvents(float now, float end)
+{
+	int i;
+	const float remaining = end - now;
+	Vector3 red = m_redBall.getCenter();
+	float dx = (float)(ballTimeScale * remaining * m_redBall.getVelocity_X());
+	float dz = (float)(ballTimeScale * remaining * m_redBall.getVelocity_Z());
+	if (dx == 0.0f && dz == 0.0f)
+		return;
+
+	// walls, the line behind the grey ball and the grey ball bound the move
+	float horizon = 1.0f;
+	for (i = 0; i < totalWalls; i++) {
+		float t = m_walls[i].sweep(red.x, red.z, dx, dz);
+		if (t < 1.0f) {
+			m_events.push(now + t * remaining, EVENT_WALL, i, m_redStamp);
+			horizon = std::min(horizon, t);
+		}
+	}
+	const float lostZ = -4.0f + (float)M_RADIUS;
+	if (dz < 0.0f) {
+		float t = (lostZ - contactSlop - red.z) / dz;
+		if (t < 1.0f) {
+			m_events.push(now + std::max(t, 0.0f) * remaining, EVENT_LOST, 0, m_redStamp);
+			horizon = std::min(horizon, t);
+		}
+	}
+	const float reach = 2 * (float)M_RADIUS;
+	Vector3 grey = m_greyBall.getCenter();
+	float greyT = sweepSphere(red.x, red.z, dx, dz, grey.x, grey.z, reach);
+	if (greyT < 1.0f) {
+		m_events.push(now + greyT * remaining, EVENT_BALL, 1, m_redStamp);
+		horizon = std::min(horizon, greyT);
+	}
+
+	// bricks, one cell-sized piece of the path at a time. the first brick
+	// found in a piece is the first one on the path, so the walk stops there.
+	float length = sqrtf(dx * dx + dz * dz) * horizon;
+	int pieces = std::max(1, (int)ceilf(length / (2 * reach)));
+	float bestT = 2.0f;
+	int bestBrick = -1;
+	for (int k = 0; k < pieces && bestT > horizon * k / pieces; k++) {
+		float t0 = horizon * k / pieces;
+		float t1 = horizon * (k + 1) / pieces;
+		float x0 = red.x + dx * t0, x1 = red.x + dx * t1;
+		float z0 = red.z + dz * t0, z1 = red.z + dz * t1;
+		m_brickGrid.collect(std::min(x0, x1) - reach, std::min(z0, z1) - reach,
+			std::max(x0, x1) + reach, std::max(z0, z1) + reach, m_hits);
+		for (size_t h = 0; h < m_hits.size(); h++) {
+			Vector3 brick = m_bricks.getCenter(m_hits[h]);
+			float t = sweepSphere(red.x, red.z, dx, dz, brick.x, brick.z, reach);
+			// ties to the lowest index, whatever order the cells list bricks in
+			if (t < bestT || (t == bestT && m_hits[h] < bestBrick)) {
+				bestT = t;
+				bestBrick = m_hits[h];
+			}
+		}
+	}
+	if (bestBrick >= 0 && bestT <= horizon)
+		m_events.push(now + bestT * remaining, EVENT_BRICK, bestBrick, m_redStamp);
+}
+
+float lego::Game::timeOfImpact(float timeDelta)
+{
+	int i;
+	Vector3 red = m_redBall.getCenter();
+	float dx = (float)(ballTimeScale * timeDelta * m_redBall.getVelocity_X());
+	float dz = (float)(ballTimeScale * timeDelta * m_redBall.getVelocity_Z());
+	if (dx == 0.0f && dz == 0.0f)
+		return 1.0f;
+
+	float first = 1.0f;
+	for (i = 0; i < totalWalls; i++) {
+		first = std::min(first, m_walls[i].sweep(red.x, red.z, dx, dz));
+	}
+
+	// every brick in the cells the move passes over
+	const float reach = 2 * (float)M_RADIUS;
+	m_brickGrid.collect(
+		std::min(red.x, red.x + dx) - reach, std::min(red.z, red.z + dz) - reach,
+		std::max(red.x, red.x + dx) + reach, std::max(red.z, red.z + dz) + reach,
+		m_hits);
+	for (size_t h = 0; h < m_hits.size(); h++) {
+		Vector3 brick = m_bricks.getCenter(m_hits[h]);
+		first = std::min(first, sweepSphere(red.x, red.z, dx, dz, brick.x, brick.z, reach));
+	}
+
+	if (m_isRoundStarted) {
+		Vector3 grey = m_greyBall.getCenter();
+		first = std::min(first, sweepSphere(red.x, red.z, dx, dz, grey.x, grey.z, reach));
+	}
+	return first;
+}
+
+bool lego::Game::stepRedBall(float timeDelta)
+{
+	int i;
+
+	// update the red ball
+	Vector3 redballStart = m_redBall.getCenter();
+	m_redBall.ballUpdate(timeDelta);
+	Vector3 redballCenter = m_redBall.getCenter();
+	if (redballCenter.z <= -4.0f + M_RADIUS) {
+		m_redBall.setPower(0.0, 0.0);
+		m_life--;
+		m_isRoundStarted = false;
+
+		// reset positions
+		if (m_life < 1) {
+			resetAllPositions();
+		}
+		else {
+			resetRedAndGreyBalls();
+		}
+		return false;
+	}
+
+	// check whether the red ball hit the walls.
+	for (i = 0; i < totalWalls; i++) {
+		m_walls[i].hitBy(m_redBall);
+	}
+
+	// check whether any brick was hit by the red ball, looking only at the
+	// cells covered by its move. hitting a brick only changes the velocity
+	// of the ball, so all hits can be found up front.
+	const float reach = 2 * (float)M_RADIUS;
+	Vector3 red = m_redBall.getCenter();
+	int count = m_brickGrid.query(
+		std::min(redballStart.x, red.x) - reach, std::min(redballStart.z, red.z) - reach,
+		std::max(redballStart.x, red.x) + reach, std::max(redballStart.z, red.z) + reach,
+		red.x, red.y, red.z, reach, m_hits);
+	for (int h = 0; h < count; h++) {
+		if (!destroyBrick(m_hits[h], m_redBall))
+			return false;
+	}
+
+	if (m_isRoundStarted)
+		collideMovingBalls(true);
+	return m_isRoundStarted;
+}
+
+bool lego::Game::stepRedBallFixed(long long timeDelta)
+{
+	int i;
+
+	// update the red ball
+	Vector3 redballStart = m_redBall.getCenter();
+	fixedBallUpdate(m_redBall, timeDelta);
+	Vector3 redballCenter = m_redBall.getCenter();
+	if (toFixed(redballCenter.z) <= fixedLostZ) {
+		m_redBall.setPower(0.0, 0.0);
+		m_life--;
+		m_isRoundStarted = false;
+
+		// reset positions
+		if (m_life < 1) {
+			resetAllPositions();
+		}
+		else {
+			resetRedAndGreyBalls();
+		}
+		return false;
+	}
+
+	// check whether the red ball hit the walls.
+	for (i = 0; i < totalWalls; i++) {
+		fixedWallHitBy(m_walls[i], m_redBall);
+	}
+
+	// the grid only picks the candidates, with a margin wide enough that
+	// rounding can't leave one out; the test itself is done in fixed point
+	const float margin = 4 * (float)M_RADIUS;
+	Vector3 red = m_redBall.getCenter();
+	m_brickGrid.collect(
+		std::min(redballStart.x, red.x) - margin, std::min(redballStart.z, red.z) - margin,
+		std::max(redballStart.x, red.x) + margin, std::max(redballStart.z, red.z) + margin,
+		m_hits);
+	fixedFilterBricks(m_bricks, toFixed(red.x), toFixed(red.y), toFixed(red.z), m_hits);
+	for (size_t h = 0; h < m_hits.size(); h++) {
+		if (!destroyBrick(m_hits[h], m_redBall))
+			return false;
+	}
+
+	if (m_isRoundStarted)
+		collideMovingBalls(true);
+	return m_isRoundStarted;
+}
+
+bool lego::Game::destroyBrick(int i, Sphere& ball)
+{
+	// destroy the brick and send the ball back
+	if (m_fixedPoint)
+		fixedBounceOffBrick(ball, toFixed(m_bricks.getVelocity_X(i)), toFixed(m_bricks.getVelocity_Z(i)));
+	else
+		bounceOffBrick(ball, m_bricks.getVelocity_X(i), m_bricks.getVelocity_Z(i));
+	m_bricks.setAlive(i, false);
+	m_brickGrid.remove(i);
+	m_destroyed.push_back(i);
+	if (m_multiBall > 0 && i % powerUpSpacing == 0)
+		m_powerUps.push_back(ball.getCenter());
+
+	m_score += 10;
+	if (m_bricks.getAliveCount() == 0) {
+		m_redBall.setPower(0.0, 0.0);
+		m_isRoundStarted = false;
+		m_isGameEnded = true;
+		m_extraBalls.clear();
+		return false;
+	}
+	return true;
+}
+
+// the new balls fan out over the upper quarter circle, so none heads
+// straight back to the line or runs along it
+void lego::Game::releasePowerUps(void)
+{
+	const float speed = (float)(REDBALLSPEED * sqrt(2.0));
+	for (size_t p = 0; p < m_powerUps.size(); p++) {
+		for (int k = 0; k < m_multiBall && (int)m_extraBalls.size() < maxExtraBalls; k++) {
+			float angle = (float)(PI / 4 + PI / 2 * (k + 1) / (m_multiBall + 1));
+			Sphere ball;
+			ball.setType(SPHERE_RED);
+			ball.setCenter(m_powerUps[p].x, m_powerUps[p].y, m_powerUps[p].z);
+			if (m_fixedPoint) {
+				// sinf and cosf differ from one libm to the next
+				const Fixed fixedSpeed = toFixed((float)(REDBALLSPEED * 1.41421356));
+				Fixed fixedAngle = toFixed((float)PI) / 4 + toFixed((float)PI) / 2 * (k + 1) / (m_multiBall + 1);
+				Fixed sine, cosine;
+				fixedSinCos(fixedAngle, sine, cosine);
+				ball.setPower(toFloat(fixedMul(fixedSpeed, cosine)), toFloat(fixedMul(fixedSpeed, sine)));
+			}
+			else {
+				ball.setPower(speed * cosf(angle), speed * sinf(angle));
+			}
+			m_extraBalls.push_back(ball);
+		}
+	}
+	m_powerUps.clear();
+}
+
+// the part of an extra ball's step that only touches the ball itself, run
+// on any thread: move it, bounce it off the walls, find the bricks it
+// touches. the bricks and the grid are only read.
+void lego::Game::moveExtraBall(int b, float timeDelta)
+{
+	Sphere& ball = m_extraBalls[b];
+	Vector3 start = ball.getCenter();
+	if (m_fixedPoint)
+		fixedBallUpdate(ball, toFixed64(timeDelta));
+	else
+		ball.ballUpdate(timeDelta);
+	Vector3 center = ball.getCenter();
+
+	m_extraLost[b] = m_fixedPoint ? toFixed(center.z) <= fixedLostZ : center.z <= -4.0f + M_RADIUS;
+	if (m_extraLost[b]) {
+		m_extraHits[b].clear();
+		return;
+	}
+	for (int i = 0; i < totalWalls; i++) {
+		if (m_fixedPoint)
+			fixedWallHitBy(m_walls[i], ball);
+		else
+			m_walls[i].hitBy(ball);
+	}
+
+	const float reach = 2 * (float)M_RADIUS;
+	center = ball.getCenter();
+	if (m_fixedPoint) {
+		// as in stepRedBallFixed
+		const float margin = 2 * reach;
+		m_brickGrid.collect(
+			std::min(start.x, center.x) - margin, std::min(start.z, center.z) - margin,
+			std::max(start.x, center.x) + margin, std::max(start.z, center.z) + margin,
+			m_extraHits[b]);
+		fixedFilterBricks(m_bricks, toFixed(center.x), toFixed(center.y), toFixed(center.z), m_extraHits[b]);
+		return;
+	}
+	m_brickGrid.query(
+		std::min(start.x, center.x) - reach, std::min(start.z, center.z) - reach,
+		std::max(start.x, center.x) + reach, std::max(start.z, center.z) + reach,
+		center.x, center.y, center.z, reach, m_extraHits[b]);
+}
+
+void lego::Game::stepExtraBalls(float timeDelta)
+{
+	LEGO_PROFILE_SCOPE("extra balls");
+	const int count = (int)m_extraBalls.size();
+	m_extraHits.resize(count);
+	m_extraLost.resize(count);
+
+	// below a few dozen balls the threads cost more than they save
+	const int parallelBalls = 64;
+	if (m_pool != 0 && count >= parallelBalls) {
+		int grain = std::max(16, count / (m_pool->getThreadCount() * 4 + 1));
+		m_pool->parallelFor(count, grain, [this, timeDelta](int begin, int end) {
+			LEGO_PROFILE_SCOPE("move balls");
+			for (int b = begin; b < end; b++)
+				moveExtraBall(b, timeDelta);
+		});
+	}
+	else {
+		for (int b = 0; b < count; b++)
+			moveExtraBall(b, timeDelta);
+	}
+
+	// apply the hits in ball order. a brick touched by several balls goes
+	// to the first of them; the others pass through where it was.
+	int kept = 0;
+	for (int b = 0; b < count; b++) {
+		if (m_extraLost[b])
+			continue;
+		Sphere& ball = m_extraBalls[b];
+		const std::vector<int>& hits = m_extraHits[b];
+		for (size_t h = 0; h < hits.size(); h++) {
+			if (m_bricks.isAlive(hits[h]) && !destroyBrick(hits[h], ball))
+				return;
+		}
+		m_extraBalls[kept++] = ball;
+	}
+	m_extraBalls.resize(kept);
+
+	// then the balls meet, in the order of the broadphase's pairs; the red
+	// ball met them on its own steps already
+	collideMovingBalls(false);
+}
+
+void lego::Game::collideMovingBalls(bool redBall)
+{
+	// the red ball is 0, so a pair holds it when a is 0
+	m_moving.clear();
+	m_moving.push_back(&m_redBall);
+	m_moving.push_back(&m_greyBall);
+	for (size_t i = 0; i < m_extraBalls.size(); i++)
+		m_moving.push_back(&m_extraBalls[i]);
+	const int count = (int)m_moving.size();
+	m_movingX.resize(count);
+	m_movingZ.resize(count);
+	for (int i = 0; i < count; i++) {
+		m_movingX[i] = m_moving[i]->getCenter().x;
+		m_movingZ[i] = m_moving[i]->getCenter().z;
+	}
+	// a margin over the radius, so the fixed-point test sees every contact
+	m_broadphase.update(&m_movingX[0], &m_movingZ[0], count, ballRadius + contactSlop, redBall ? 0 : -1);
+
+	const std::vector<BroadPair>& pairs = m_broadphase.getPairs();
+	for (size_t p = 0; p < pairs.size(); p++) {
+		if (!redBall && pairs[p].a == 0)
+			continue;
+		Sphere* a = m_moving[pairs[p].a];
+		Sphere* b = m_moving[pairs[p].b];
+		Sphere* grey = b == &m_greyBall ? b : a == &m_greyBall ? a : 0;
+		Sphere* other = grey == a ? b : a;
+		if (grey != 0) {
+			if (m_fixedPoint)
+				fixedHitBy(*grey, *other);
+			else
+				grey->hitBy(*other);
+		}
+		else if (m_fixedPoint) {
+			fixedBounceBalls(*a, *b);
+		}
+		else {
+			bounceBalls(*a, *b);
+		}
+	}
+}
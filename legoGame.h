@@ -0,0 +1,296 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoGame.h
+//
+// Desc: Game state of Virtual Lego (bricks, walls, red and grey balls,
+//       life and score) and the per-frame update that used to live in
+//       Display(). Renderers only read from it; input only goes through
+//       launchRedBall() / moveGreyBallLeft() / moveGreyBallRight().
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoGameH__
+#define __legoGameH__
+
+#include "legoPhysics.h"
+#include "legoBalls.h"
+#include "legoBroadphase.h"
+#include "legoGrid.h"
+#include "legoEvents.h"
+#include <memory>
+#include <vector>
+
+namespace lego
+{
+	// There are 20 balls
+	// initialize the position (coordinate) of each ball
+	const int totalBalls = 20;
+	extern const float spherePos[totalBalls][2];
+
+	const int totalWalls = 3;
+	const int maxSubSteps = 16;
+
+	// in multi-ball mode every powerUpSpacing-th brick of a level holds a
+	// power-up, and no more than maxExtraBalls extra balls are in play
+	const int powerUpSpacing = 5;
+	const int maxExtraBalls = 1024;
+
+	class ThreadPool;
+	class GameState;
+	struct RenderState;
+
+	// the part of a level that doesn't change while it's played. built by
+	// Game::setup() and shared, never copied, by the game, its saved states
+	// and every game they are restored into.
+	struct BrickLevel
+	{
+		std::vector<float>	layout;		// (x, z) pairs as loaded
+		BallArray			bricks;		// all alive, pushed out of the walls
+		BrickGrid			grid;		// over all of them
+	};
+
+	// fills positions with count (x, z) pairs spread evenly over the upper
+	// half of the table, for levels bigger than the default one
+	void makeBrickLayout(int count, std::vector<float>& positions);
+	// the walls of the table, where every game has them
+	void makeWalls(Wall walls[totalWalls]);
+
+	class Game {
+	public:
+		Game(void);
+
+		// put every ball and wall at its initial position, full lives.
+		// without arguments the default level of spherePos is loaded,
+		// otherwise positions holds count (x, z) pairs.
+		void setup(void);
+		void setup(const float* positions, int count);
+		// new game on the level already loaded
+		void restart(void);
+		void resetAllPositions(void);
+		void resetRedAndGreyBalls(void);
+		// every brick of the level alive again
+		void resetBricks(void);
+
+		// for a game that only shows one played elsewhere, e.g. received
+		// from a stream (see legoStream.h): each sets a part of the scene as
+		// it is there, and no rule runs on it
+		void setStatus(int life, int score, bool roundStarted, bool gameEnded);
+		// brick i is gone, as when hit but without scoring
+		void removeBrick(int i);
+		// the extra balls are count red balls at extra
+		void placeBalls(const Vector3& red, const Vector3& grey, const Vector3* extra, int count);
+
+		// what a frame shows of the game. costs the moving balls and the
+		// bricks destroyed since state was last filled from this game, not
+		// the whole level.
+		void saveRenderState(RenderState& state) const;
+
+		// snapshots for rollouts: state receives everything that changes
+		// while the level is played, a few flat arrays whose size doesn't
+		// depend on how long the game ran. the level itself is shared, not
+		// copied, but the bricks' alive set and the brick grid are: a
+		// destroyed brick is swapped out of its cell, which reorders the
+		// grid's item positions too. that is about 30 bytes a brick, 300 KB
+		// for 10000 bricks, each way. restoring into any other game, even a
+		// fresh one, forks it: from there both evolve exactly alike under
+		// the same input. the thread pool setting stays with each game.
+		void saveState(GameState& state) const;
+		void restoreState(const GameState& state);
+
+		// player input
+		void launchRedBall(void);
+		void moveGreyBallLeft(void);
+		void moveGreyBallRight(void);
+
+		// timeDelta represents the time between the current frame and the last frame.
+		void update(float timeDelta);
+
+		// with continuous collision (the default) the red ball is stopped at
+		// every contact within a frame, up to maxSubSteps times, so large
+		// timeDeltas don't let it tunnel through bricks. without it only the
+		// position at the end of the frame is tested.
+		void setContinuousCollision(bool enable) { m_continuousCollision = enable; }
+		bool getContinuousCollision(void) const { return m_continuousCollision; }
+
+		// fixed-point mode: the balls are stepped with the integer rules of
+		// legoFixed.h, which give bit-identical results on every machine and
+		// build, so runs elsewhere can be checked by their state hash alone.
+		// a step is split so the red ball moves at most a radius at a time,
+		// up to maxSubSteps, instead of going from contact to contact. the
+		// outcome differs from the float modes'. the bricks are pushed out
+		// of the walls with the integer rule too, so changing the mode on a
+		// level that is set up sets it up again and restarts the game. off
+		// by default.
+		void setFixedPoint(bool enable);
+		bool getFixedPoint(void) const { return m_fixedPoint; }
+
+		// multi-ball mode: destroying a brick that holds a power-up releases
+		// count extra red balls where the ball that hit it is. extra balls
+		// break bricks and score like the red ball, simply vanish past the
+		// line, and are gone when the round ends. 0 (the default) turns the
+		// mode off.
+		void setMultiBall(int count) { m_multiBall = count; }
+		int getMultiBall(void) const { return m_multiBall; }
+
+		// extra balls are moved and tested against the bricks in parallel on
+		// pool; their hits are then applied one ball after the other in ball
+		// order, so the outcome is the same with any number of threads, or
+		// without a pool (the default)
+		void setThreadPool(ThreadPool* pool) { m_pool = pool; }
+
+		// event-driven alternative to update(): between contacts the red ball
+		// moves in a straight line, so instead of stepping through frames the
+		// next contact is computed analytically and the ball jumps right to
+		// it. same rules as update() with continuous collision, without
+		// input in between, but the ball gets to each contact in one move
+		// rather than in many steps, so the positions agree only up to
+		// float rounding, and over a long run a game can play out
+		// differently. returns the events handled.
+		// while extra balls are in play, or in fixed-point mode, it falls
+		// back to update().
+		int fastForward(float duration, int maxEvents = 1000000);
+
+		// update() calls that found the red ball asleep and skipped it
+		long getSleepingSteps(void) const { return m_sleepingSteps; }
+
+		int getLife(void) const { return m_life; }
+		int getScore(void) const { return m_score; }
+		bool isRoundStarted(void) const { return m_isRoundStarted; }
+		bool isGameEnded(void) const { return m_isGameEnded; }
+		// the game ended with lives left, which only clearing every brick does
+		bool isLevelCleared(void) const { return m_isGameEnded && m_life > 0; }
+
+		int getBrickCount(void) const { return m_bricks.size(); }
+		// the (x, z) pairs the level was loaded from
+		const float* getBrickLayout(void) const { return m_level && !m_level->layout.empty() ? &m_level->layout[0] : 0; }
+		const BallArray& getBricks(void) const { return m_bricks; }
+		const Wall& getWall(int i) const { return m_walls[i]; }
+		const Sphere& getRedBall(void) const { return m_redBall; }
+		const Sphere& getGreyBall(void) const { return m_greyBall; }
+		int getExtraBallCount(void) const { return (int)m_extraBalls.size(); }
+		const Sphere& getExtraBall(int i) const { return m_extraBalls[i]; }
+
+	private:
+		Wall	m_walls[totalWalls];
+		BallArray	m_bricks;
+		std::shared_ptr<const BrickLevel>	m_level;
+		BrickGrid	m_brickGrid;		// built when the level is loaded
+		std::vector<int>	m_hits;		// scratch list of bricks touched this frame
+		SweepAndPrune	m_broadphase;	// pairs among the moving balls
+		// scratch for it: red, grey, then the extra balls
+		std::vector<Sphere*>	m_moving;
+		std::vector<float>		m_movingX, m_movingZ;
+		Sphere	m_redBall;
+		Sphere	m_greyBall;
+
+		int		m_life;
+		int		m_score;
+		bool	m_isRoundStarted;
+		bool	m_isGameEnded;
+		bool	m_continuousCollision;
+		bool	m_fixedPoint;
+		long	m_sleepingSteps;
+
+		int		m_multiBall;
+		ThreadPool*	m_pool;
+		std::vector<Sphere>	m_extraBalls;
+		// filled in parallel, one entry per extra ball: the bricks it touches
+		// and whether it crossed the line
+		std::vector<std::vector<int> >	m_extraHits;
+		std::vector<unsigned char>		m_extraLost;
+		std::vector<Vector3>	m_powerUps;		// where balls are released this step
+		// bricks destroyed since the bricks were last reset, in that order.
+		// the list starts over, and gets a new epoch, when they are reset
+		// or restored.
+		std::vector<int>	m_destroyed;
+		unsigned int		m_destroyedEpoch;
+
+		// earliest contact of the red ball within a move of timeDelta, as a fraction
+		float timeOfImpact(float timeDelta);
+		// moves the red ball and resolves its contacts, false once the round is over
+		bool stepRedBall(float timeDelta);
+		// the same with the fixed-point rules, for a Q32.32 time
+		bool stepRedBallFixed(long long timeDelta);
+		// direction -1 for left, 1 for right
+		void moveGreyBallFixed(int direction);
+		// contacts among the red, grey and extra balls found by the
+		// broadphase: those of the red ball, or all the others. the grey
+		// ball reflects any ball, two red ones bounce off each other.
+		void collideMovingBalls(bool redBall);
+		// destroys brick i, hit by ball. false once the last brick is gone.
+		bool destroyBrick(int i, Sphere& ball);
+		void releasePowerUps(void);
+		void stepExtraBalls(float timeDelta);
+		void moveExtraBall(int b, float timeDelta);
+
+		EventQueue		m_events;
+		unsigned int	m_redStamp;		// collisions of the red ball so far
+
+		// queues the next contacts of the red ball between now and end
+		void predictEvents(float now, float end);
+		void createWalls(void);
+	};
+
+	// what Game::saveState() fills in. reuse one for the same level and no
+	// memory is allocated after the first save.
+	class GameState {
+	public:
+		GameState(void) {}
+
+		bool isEmpty(void) const { return !m_level; }
+		int getLife(void) const { return m_header.life; }
+		int getScore(void) const { return m_header.score; }
+		// bytes held by this state alone, without the shared level
+		size_t getMemoryUsage(void) const;
+
+	private:
+		// the scalars, copied as one block
+		struct Header
+		{
+			Sphere			redBall;
+			Sphere			greyBall;
+			int				life;
+			int				score;
+			bool			isRoundStarted;
+			bool			isGameEnded;
+			bool			continuousCollision;
+			bool			fixedPoint;
+			long			sleepingSteps;
+			int				multiBall;
+			unsigned int	redStamp;
+		};
+
+		Header		m_header;
+		std::shared_ptr<const BrickLevel>	m_level;
+		BallArray::AliveState	m_bricks;
+		BrickGrid::LiveState	m_grid;
+		std::vector<Sphere>		m_extraBalls;
+		std::vector<Vector3>	m_powerUps;
+
+		friend class Game;
+	};
+
+	// what Game::saveRenderState() fills in: all a frame and the HUD read
+	// of a game. the bricks are those of the shared level but the
+	// destroyed ones. keep filling one from the same game and it is
+	// brought up to date instead of copied again.
+	struct RenderState
+	{
+		RenderState(void) : life(0), score(0), isRoundStarted(false), isGameEnded(false), destroyedEpoch(0) {}
+
+		bool isLevelCleared(void) const { return isGameEnded && life > 0; }
+
+		std::shared_ptr<const BrickLevel>	level;
+		std::vector<int>	destroyed;		// indices into level->bricks
+		Vector3			redCenter;
+		Vector3			greyCenter;
+		std::vector<Vector3>	extraCenters;
+		int				life;
+		int				score;
+		bool			isRoundStarted;
+		bool			isGameEnded;
+		unsigned int	destroyedEpoch;		// of the game's list destroyed follows
+	};
+}
+
+#endif // __legoGameH__
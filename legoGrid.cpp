@@ -0,0 +1,206 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoGrid.cpp
+//
+// Desc: Static uniform grid over the bricks of a level.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoGrid.h"
+#include "legoCollide.h"
+#include <algorithm>
+#include <cmath>
+
+lego::BrickGrid::BrickGrid(void)
+{
+	m_originX = m_originZ = 0.0f;
+	m_cellSize = 1.0f;
+	m_columns = m_rows = 0;
+}
+
+void lego::BrickGrid::clear(void)
+{
+	m_columns = m_rows = 0;
+	m_cellStart.clear();
+	m_cellLive.clear();
+	m_itemX.clear();
+	m_itemY.clear();
+	m_itemZ.clear();
+	m_itemAlive.clear();
+	m_itemBrick.clear();
+	m_brickItem.clear();
+}
+
+int lego::BrickGrid::cellOf(float x, float z) const
+{
+	int column = (int)floorf((x - m_originX) / m_cellSize);
+	int row = (int)floorf((z - m_originZ) / m_cellSize);
+	column = std::max(0, std::min(m_columns - 1, column));
+	row = std::max(0, std::min(m_rows - 1, row));
+	return row * m_columns + column;
+}
+
+void lego::BrickGrid::build(const BallArray& bricks, float cellSize)
+{
+	int i;
+	const int count = bricks.size();
+
+	clear();
+	m_cellSize = cellSize;
+	m_brickItem.assign(count, -1);
+
+	// bounds of the alive bricks
+	float minX = 0, minZ = 0, maxX = 0, maxZ = 0;
+	bool any = false;
+	for (i = 0; i < count; i++) {
+		if (!bricks.isAlive(i))
+			continue;
+		Vector3 c = bricks.getCenter(i);
+		if (!any) {
+			minX = maxX = c.x;
+			minZ = maxZ = c.z;
+			any = true;
+		}
+		minX = std::min(minX, c.x);	maxX = std::max(maxX, c.x);
+		minZ = std::min(minZ, c.z);	maxZ = std::max(maxZ, c.z);
+	}
+	if (!any)
+		return;
+
+	m_originX = minX;
+	m_originZ = minZ;
+	m_columns = (int)((maxX - minX) / cellSize) + 1;
+	m_rows = (int)((maxZ - minZ) / cellSize) + 1;
+
+	// counting sort of the bricks by cell
+	const int cells = m_columns * m_rows;
+	m_cellStart.assign(cells + 1, 0);
+	m_cellLive.assign(cells, 0);
+	for (i = 0; i < count; i++) {
+		if (bricks.isAlive(i)) {
+			Vector3 c = bricks.getCenter(i);
+			m_cellLive[cellOf(c.x, c.z)]++;
+		}
+	}
+	for (i = 0; i < cells; i++)
+		m_cellStart[i + 1] = m_cellStart[i] + m_cellLive[i];
+
+	const int items = m_cellStart[cells];
+	m_itemX.resize(items);
+	m_itemY.resize(items);
+	m_itemZ.resize(items);
+	m_itemAlive.assign(items, 1);
+	m_itemBrick.resize(items);
+
+	std::vector<int> next(m_cellStart.begin(), m_cellStart.end() - 1);
+	for (i = 0; i < count; i++) {
+		if (!bricks.isAlive(i))
+			continue;
+		Vector3 c = bricks.getCenter(i);
+		int item = next[cellOf(c.x, c.z)]++;
+		m_itemX[item] = c.x;
+		m_itemY[item] = c.y;
+		m_itemZ[item] = c.z;
+		m_itemBrick[item] = i;
+		m_brickItem[i] = item;
+	}
+}
+
+void lego::BrickGrid::remove(int brick)
+{
+	if (brick < 0 || brick >= (int)m_brickItem.size())
+		return;
+	int item = m_brickItem[brick];
+	if (item < 0 || !m_itemAlive[item])
+		return;
+
+	// swap with the last alive item of the cell
+	int cell = cellOf(m_itemX[item], m_itemZ[item]);
+	int last = m_cellStart[cell] + --m_cellLive[cell];
+	if (item != last) {
+		std::swap(m_itemX[item], m_itemX[last]);
+		std::swap(m_itemY[item], m_itemY[last]);
+		std::swap(m_itemZ[item], m_itemZ[last]);
+		std::swap(m_itemBrick[item], m_itemBrick[last]);
+		m_brickItem[m_itemBrick[item]] = item;
+		m_brickItem[brick] = last;
+	}
+	m_itemAlive[last] = 0;
+}
+
+void lego::BrickGrid::saveLive(LiveState& state) const
+{
+	state.cellLive = m_cellLive;
+	state.itemX = m_itemX;
+	state.itemY = m_itemY;
+	state.itemZ = m_itemZ;
+	state.itemAlive = m_itemAlive;
+	state.itemBrick = m_itemBrick;
+	state.brickItem = m_brickItem;
+}
+
+void lego::BrickGrid::restoreLive(const LiveState& state)
+{
+	m_cellLive = state.cellLive;
+	m_itemX = state.itemX;
+	m_itemY = state.itemY;
+	m_itemZ = state.itemZ;
+	m_itemAlive = state.itemAlive;
+	m_itemBrick = state.itemBrick;
+	m_brickItem = state.brickItem;
+}
+
+void lego::BrickGrid::collect(float minX, float minZ, float maxX, float maxZ, std::vector<int>& bricks) const
+{
+	bricks.clear();
+	if (m_columns == 0)
+		return;
+
+	int first = cellOf(minX, minZ);
+	int last = cellOf(maxX, maxZ);
+	for (int row = first / m_columns; row <= last / m_columns; row++) {
+		for (int column = first % m_columns; column <= last % m_columns; column++) {
+			int cell = row * m_columns + column;
+			int end = m_cellStart[cell] + m_cellLive[cell];
+			for (int item = m_cellStart[cell]; item < end; item++)
+				bricks.push_back(m_itemBrick[item]);
+		}
+	}
+}
+
+int lego::BrickGrid::query(float minX, float minZ, float maxX, float maxZ,
+	float x, float y, float z, float reach, std::vector<int>& hits) const
+{
+	hits.clear();
+	if (m_columns == 0)
+		return 0;
+
+	const float reachSq = reach * reach;
+	int first = cellOf(minX, minZ);
+	int last = cellOf(maxX, maxZ);
+	int firstColumn = first % m_columns, lastColumn = last % m_columns;
+	int firstRow = first / m_columns, lastRow = last / m_columns;
+
+	for (int row = firstRow; row <= lastRow; row++) {
+		for (int column = firstColumn; column <= lastColumn; column++) {
+			int cell = row * m_columns + column;
+			if (m_cellLive[cell] == 0)
+				continue;
+
+			int end = m_cellStart[cell] + m_cellLive[cell];
+			for (int item = m_cellStart[cell]; item < end; item += collideBlockSize) {
+				int n = std::min(collideBlockSize, end - item);
+				unsigned int mask = intersectBlock(&m_itemX[item], &m_itemY[item], &m_itemZ[item],
+					&m_itemAlive[item], n, x, y, z, reachSq);
+				for (int i = 0; mask != 0; i++, mask >>= 1) {
+					if (mask & 1)
+						hits.push_back(m_itemBrick[item + i]);
+				}
+			}
+		}
+	}
+
+	// same order as a linear scan over the bricks
+	std::sort(hits.begin(), hits.end());
+	return (int)hits.size();
+}
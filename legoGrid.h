@@ -0,0 +1,81 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoGrid.h
+//
+// Desc: Static uniform grid over the bricks of a level. Built once when the
+//       level is loaded; bricks are stored cell by cell so a query only
+//       touches the few cells a ball overlaps, whatever the brick count.
+//       A destroyed brick is swapped out of its cell's live range in O(1),
+//       so queries never look at it again.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoGridH__
+#define __legoGridH__
+
+#include "legoBalls.h"
+#include <vector>
+
+namespace lego
+{
+	class BrickGrid {
+	public:
+		BrickGrid(void);
+
+		// index every alive brick. cellSize should be about twice the
+		// distance at which a ball touches a brick.
+		void build(const BallArray& bricks, float cellSize);
+		void clear(void);
+
+		// brick was destroyed, drop it from its cell
+		void remove(int brick);
+
+		// what remove() changes, to save and restore a game
+		struct LiveState
+		{
+			std::vector<int>			cellLive;
+			std::vector<float>			itemX, itemY, itemZ;
+			std::vector<unsigned char>	itemAlive;
+			std::vector<int>			itemBrick;
+			std::vector<int>			brickItem;
+		};
+		void saveLive(LiveState& state) const;
+		// the grid must be built over the bricks state was saved from
+		void restoreLive(const LiveState& state);
+
+		// writes to bricks every alive brick in the cells overlapping the
+		// rectangle (minX, minZ) - (maxX, maxZ), without any distance test
+		void collect(float minX, float minZ, float maxX, float maxZ, std::vector<int>& bricks) const;
+
+		// writes to hits the index of every brick closer than reach to
+		// (x, y, z), looking only at the cells overlapping the rectangle
+		// (minX, minZ) - (maxX, maxZ). hits come out in increasing order.
+		int query(float minX, float minZ, float maxX, float maxZ,
+			float x, float y, float z, float reach, std::vector<int>& hits) const;
+
+		int getCellCount(void) const { return m_columns * m_rows; }
+
+	private:
+		float	m_originX, m_originZ;
+		float	m_cellSize;
+		int		m_columns, m_rows;
+
+		// cell c owns items [m_cellStart[c], m_cellStart[c + 1]), the alive
+		// ones first: [m_cellStart[c], m_cellStart[c] + m_cellLive[c])
+		std::vector<int>			m_cellStart;
+		std::vector<int>			m_cellLive;
+
+		// bricks copied in cell order, so a cell is one contiguous block
+		std::vector<float>			m_itemX;
+		std::vector<float>			m_itemY;
+		std::vector<float>			m_itemZ;
+		std::vector<unsigned char>	m_itemAlive;
+		std::vector<int>			m_itemBrick;
+
+		std::vector<int>			m_brickItem;	// brick -> item, -1 if not indexed
+
+		int cellOf(float x, float z) const;
+	};
+}
+
+#endif // __legoGridH__
@@ -0,0 +1,676 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoHeadless.cpp
+//
+// Desc: Runs Virtual Lego without a window. The grey ball is driven by a
+//       simple autopilot that follows the red ball, and the red ball is
+//       relaunched whenever a round ends, so the game can be soaked for
+//       any number of steps and its throughput measured.
+//
+//       usage: legoHeadless [-n steps] [-t timeDelta] [-b bricks] [-l level]
+//                           [-m balls] [-e] [-d] [-x] [-T] [-w worlds] [-j threads]
+//                           [-o log] [-r log] [-p frame.ppm] [-P trace.json]
+//                           [-F rollouts] [-W stream] [-S socket] [-V stream]
+//
+//       -b  play a generated level of that many bricks instead of the
+//           default level of 20 bricks
+//       -l  play a binary level file, see legoMakeLevel
+//       -m  multi-ball mode: every power-up releases that many balls
+//       -e  event-driven: every step jumps from contact to contact
+//           through timeDelta with Game::fastForward
+//       -d  discrete: test contacts only at the end of each step
+//       -x  fixed point: step with the integer rules of legoFixed.h, so
+//           the final state hash is the same on every machine and build
+//       -T  run the game on a simulation thread in lock-step with the
+//           autopilot, which reads every snapshot and posts input through
+//           the queue as the game window does; the log is the one -o
+//           records without -T. combine with -o to check it with -r.
+//       -w  step that many independent worlds in parallel, each for
+//           the given number of steps, and report the aggregate rate
+//       -j  worker threads for -w and -m, one per core by default
+//       -o  record the input of the session to a replay log
+//       -r  replay a log recorded here or by the game at full speed and
+//           check that it ends in the recorded state
+//       -p  render the last state with the software renderer at 1024x768
+//       -P  profile the run: print the time spent in every zone and write
+//           the zones as a Chrome trace, see legoProfile.h
+//       -F  play the given number of steps, then fork the game that many
+//           times with Game::saveState / restoreState and play a short
+//           rollout from each fork; report what saving and restoring
+//           cost and check every rollout ends like the game itself
+//       -W  write the state stream of the run to a file, see
+//           legoStream.h; report its rate at the game window's tick rate
+//           and check that decoding it rebuilds the game tick by tick
+//       -S  serve the state stream on a Unix socket, one tick per tick of
+//           the game window, for -V to watch
+//       -V  watch a state stream from a Unix socket or a file, and report
+//           the scene it ends in; with -p render that scene
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoGame.h"
+#include "legoBatch.h"
+#include "legoCollide.h"
+#include "legoLevel.h"
+#include "legoProfile.h"
+#include "legoReplay.h"
+#include "legoSimThread.h"
+#include "legoSoftRender.h"
+#include "legoStream.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// zones of a -P run. the rings are emptied every step, so a long run loses
+// no zone; only the first ones go into the trace, to keep it loadable.
+struct ProfileTotal
+{
+	double	milliseconds;
+	long	calls;
+};
+static const size_t maxTraceZones = 1 << 20;
+static std::vector<lego::ProfileZone> s_traceZones;
+static std::map<std::string, ProfileTotal> s_profileTotals;
+
+static void collectProfile(void)
+{
+	static std::vector<lego::ProfileZone> zones;
+	zones.clear();
+	lego::Profiler::collect(zones);
+	for (size_t i = 0; i < zones.size(); i++) {
+		ProfileTotal& total = s_profileTotals[zones[i].name];
+		total.milliseconds += (zones[i].end - zones[i].begin) / 1e6;
+		total.calls++;
+	}
+	size_t room = maxTraceZones - s_traceZones.size();
+	s_traceZones.insert(s_traceZones.end(), zones.begin(), zones.begin() + std::min(zones.size(), room));
+}
+
+static bool finishProfile(const char* path)
+{
+	collectProfile();
+	for (std::map<std::string, ProfileTotal>::const_iterator i = s_profileTotals.begin(); i != s_profileTotals.end(); ++i)
+		printf("zone       : %-12s %10.3f ms %9ld calls\n", i->first.c_str(), i->second.milliseconds, i->second.calls);
+	if (lego::Profiler::getDropped() > 0)
+		printf("dropped    : %ld zones\n", lego::Profiler::getDropped());
+	printf("trace      : %u zones\n", (unsigned int)s_traceZones.size());
+	return lego::writeChromeTrace(path, s_traceZones);
+}
+
+// draws the state of game into a PPM file
+static bool renderFrame(const lego::Game& game, const char* path)
+{
+	lego::ThreadPool pool;
+	lego::SoftRenderer renderer(pool);
+	lego::CommandBuffer commands;
+	lego::recordScene(game, renderer.getHeight(), commands);
+	commands.sort();
+	lego::NullBackend counter;
+	lego::submitCommands(commands, counter);
+	printf("draw calls : %d for %d objects (%d mesh, %d material changes)\n", counter.getDrawCalls(),
+		counter.getInstances(), counter.getMeshChanges(), counter.getMaterialChanges());
+
+	const lego::MeshCache& meshes = renderer.getMeshCache();
+	printf("meshes     : %d (%.1f KB)\n", meshes.getMeshCount(), meshes.getMemoryUsage() / 1024.0);
+	for (int i = 0; i < lego::meshLodCount; i++) {
+		const lego::MeshData& ball = renderer.getMesh(lego::MESH_BALL, i);
+		printf("ball lod %d : %d triangles, %.2f vertices per triangle\n", i, ball.getTriangleCount(),
+			lego::getCacheMissRatio(ball, 16));
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	renderer.render(commands);
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("frame(ms)  : %.2f (%d triangles, %d threads)\n", elapsed * 1000.0, renderer.getTriangleCount(), pool.getThreadCount());
+	return renderer.savePpm(path);
+}
+
+// ticks per second of the game window, as virtualLego.cpp
+static const int windowTickRate = 240;
+
+// how far the balls of the scene a stream decoder rebuilt are from those of
+// the game it was encoded from, or -1 if anything that is sent exactly
+// (life, score, round, bricks, ball count) differs
+static float getStreamError(const lego::Game& scene, const lego::Game& game)
+{
+	if (scene.getLife() != game.getLife() || scene.getScore() != game.getScore()
+		|| scene.isRoundStarted() != game.isRoundStarted() || scene.isGameEnded() != game.isGameEnded()
+		|| scene.getExtraBallCount() != game.getExtraBallCount()
+		|| scene.getBricks().getAliveCount() != game.getBricks().getAliveCount())
+		return -1.0f;
+	for (int i = 0; i < game.getBrickCount(); i++) {
+		if (scene.getBricks().isAlive(i) != game.getBricks().isAlive(i))
+			return -1.0f;
+	}
+
+	float error = 0.0f;
+	const lego::Sphere* balls[][2] = {
+		{ &scene.getRedBall(), &game.getRedBall() },
+		{ &scene.getGreyBall(), &game.getGreyBall() }
+	};
+	for (int i = 0; i < 2; i++) {
+		lego::Vector3 a = balls[i][0]->getCenter();
+		lego::Vector3 b = balls[i][1]->getCenter();
+		error = std::max(error, std::max(std::fabs(a.x - b.x), std::fabs(a.z - b.z)));
+	}
+	for (int i = 0; i < game.getExtraBallCount(); i++) {
+		lego::Vector3 a = scene.getExtraBall(i).getCenter();
+		lego::Vector3 b = game.getExtraBall(i).getCenter();
+		error = std::max(error, std::max(std::fabs(a.x - b.x), std::fabs(a.z - b.z)));
+	}
+	return error;
+}
+
+static void printScene(const lego::StreamDecoder& decoder)
+{
+	const lego::Game& scene = decoder.getGame();
+	printf("tick %9u: life %d, score %d, %d of %d bricks, %d extra balls\n", decoder.getTick(), scene.getLife(),
+		scene.getScore(), scene.getBricks().getAliveCount(), scene.getBrickCount(), scene.getExtraBallCount());
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s [-n steps] [-t timeDelta] [-b bricks] [-l level] [-m balls] [-e] [-d] [-x] [-T] [-w worlds] [-j threads] [-o log] [-r log] [-p frame.ppm] [-P trace.json] [-F rollouts] [-W stream] [-S socket] [-V stream]\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+	long steps = 1000000;
+	float timeDelta = 0.001f;
+	int bricks = 0;
+	int multiBall = 0;
+	bool eventDriven = false;
+	bool discrete = false;
+	bool fixedPoint = false;
+	bool threaded = false;
+	int worlds = 0;
+	int threads = 0;
+	int rollouts = 0;
+	const char* levelPath = 0;
+	const char* recordPath = 0;
+	const char* replayPath = 0;
+	const char* framePath = 0;
+	const char* tracePath = 0;
+	const char* streamPath = 0;
+	const char* publishPath = 0;
+	const char* watchPath = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			steps = atol(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			timeDelta = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+			bricks = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+			levelPath = argv[++i];
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+			multiBall = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-e") == 0)
+			eventDriven = true;
+		else if (strcmp(argv[i], "-d") == 0)
+			discrete = true;
+		else if (strcmp(argv[i], "-x") == 0)
+			fixedPoint = true;
+		else if (strcmp(argv[i], "-T") == 0)
+			threaded = true;
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			worlds = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			replayPath = argv[++i];
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+			framePath = argv[++i];
+		else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+			tracePath = argv[++i];
+		else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc)
+			rollouts = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc)
+			streamPath = argv[++i];
+		else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc)
+			publishPath = argv[++i];
+		else if (strcmp(argv[i], "-V") == 0 && i + 1 < argc)
+			watchPath = argv[++i];
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (steps <= 0 || timeDelta <= 0.0f || bricks < 0 || worlds < 0 || threads < 0 || multiBall < 0 || multiBall > 255
+		|| (recordPath && (eventDriven || worlds > 0)) || (framePath && worlds > 0) || (levelPath && bricks > 0)
+		|| (threaded && (eventDriven || worlds > 0)) || (fixedPoint && eventDriven)
+		|| rollouts < 0 || (rollouts > 0 && (recordPath || threaded || worlds > 0 || eventDriven))
+		|| ((streamPath || publishPath) && (recordPath || replayPath || threaded || worlds > 0 || rollouts > 0))
+		|| (watchPath && (streamPath || publishPath || replayPath))) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (tracePath && !lego::Profiler::isCompiledIn()) {
+		fprintf(stderr, "%s: -P: the profiler is compiled out of this build\n", argv[0]);
+		return 1;
+	}
+	lego::Profiler::setEnabled(tracePath != 0);
+
+	if (watchPath) {
+		lego::StreamDecoder decoder;
+		lego::StreamSubscriber subscriber;
+		bool complete = true;
+		if (subscriber.connect(watchPath)) {
+			// a line a second of the game window's ticks
+			unsigned int shown = 0;
+			while (subscriber.receive(decoder)) {
+				if (decoder.isSynced() && decoder.getTick() >= shown + windowTickRate) {
+					printScene(decoder);
+					shown = decoder.getTick();
+				}
+			}
+		}
+		else {
+			FILE* file = fopen(watchPath, "rb");
+			if (!file) {
+				fprintf(stderr, "%s: can't open stream %s\n", argv[0], watchPath);
+				return 1;
+			}
+			std::vector<unsigned char> data;
+			unsigned char chunk[65536];
+			size_t n;
+			while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0)
+				data.insert(data.end(), chunk, chunk + n);
+			fclose(file);
+
+			size_t used = 0;
+			while (used < data.size()) {
+				int taken = decoder.decode(&data[used], data.size() - used);
+				if (taken < 0) {
+					fprintf(stderr, "%s: %s isn't a state stream\n", argv[0], watchPath);
+					return 1;
+				}
+				if (taken == 0)
+					break;
+				used += (size_t)taken;
+			}
+			complete = used == data.size();
+		}
+		if (!decoder.isSynced()) {
+			fprintf(stderr, "%s: %s: no keyframe in the stream\n", argv[0], watchPath);
+			return 1;
+		}
+		if (!complete)
+			fprintf(stderr, "%s: %s: the last frame is cut short\n", argv[0], watchPath);
+		printScene(decoder);
+		printf("tick delta : %g\n", decoder.getTickDelta());
+		if (framePath && !renderFrame(decoder.getGame(), framePath)) {
+			fprintf(stderr, "%s: can't write frame %s\n", argv[0], framePath);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (replayPath) {
+		lego::InputLog log;
+		if (!log.load(replayPath)) {
+			fprintf(stderr, "%s: can't read replay log %s\n", argv[0], replayPath);
+			return 1;
+		}
+
+		lego::Game game;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool match = lego::replayInput(log, game);
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("kernel     : %s\n", lego::getCollisionKernel());
+		printf("bricks     : %d\n", game.getBrickCount());
+		printf("ticks      : %u\n", log.ticks);
+		printf("inputs     : %u\n", (unsigned int)log.inputs.size());
+		printf("life       : %d\n", game.getLife());
+		printf("score      : %d\n", game.getScore());
+		printf("state      : %08x (%s)\n", lego::hashGame(game), match ? "match" : "MISMATCH");
+		printf("elapsed(s) : %.3f\n", elapsed);
+		printf("ticks/sec  : %.0f\n", elapsed > 0.0 ? log.ticks / elapsed : 0.0);
+		if (framePath && !renderFrame(game, framePath)) {
+			fprintf(stderr, "%s: can't write frame %s\n", argv[0], framePath);
+			return 1;
+		}
+		if (tracePath && !finishProfile(tracePath)) {
+			fprintf(stderr, "%s: can't write trace %s\n", argv[0], tracePath);
+			return 1;
+		}
+		return match ? 0 : 2;
+	}
+
+	// the level file stays mapped while the game runs, positions point into it
+	lego::LevelFile level;
+	std::vector<float> layout;
+	const float* positions = 0;
+	int count = 0;
+	if (levelPath) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!level.open(levelPath)) {
+			fprintf(stderr, "%s: can't load level %s: %s\n", argv[0], levelPath, level.getError());
+			return 1;
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (!level.hasBuiltInTable())
+			fprintf(stderr, "%s: %s: only the built-in table and walls are simulated\n", argv[0], levelPath);
+		printf("load(ms)   : %.3f\n", elapsed * 1000.0);
+		positions = level.getBrickPositions();
+		count = level.getBrickCount();
+	}
+	else {
+		if (bricks > 0)
+			lego::makeBrickLayout(bricks, layout);
+		else
+			layout.assign(&lego::spherePos[0][0], &lego::spherePos[0][0] + lego::totalBalls * 2);
+		positions = &layout[0];
+		count = (int)layout.size() / 2;
+	}
+
+	if (worlds > 0) {
+		lego::ThreadPool pool(threads);
+		lego::BatchSimulator batch(pool);
+		batch.setup(worlds, positions, count);
+		batch.setContinuousCollision(!discrete);
+		batch.setMultiBall(multiBall);
+		batch.setFixedPoint(fixedPoint);
+		batch.setEventDriven(eventDriven);
+		lego::BatchStats stats = batch.run(steps, timeDelta);
+
+		printf("kernel     : %s\n", lego::getCollisionKernel());
+		printf("bricks     : %d\n", count);
+		printf("threads    : %d\n", pool.getThreadCount());
+		printf("worlds     : %d\n", stats.worlds);
+		printf("steps      : %ld\n", stats.steps);
+		if (eventDriven)
+			printf("events     : %ld\n", stats.events);
+		printf("games      : %ld\n", stats.games);
+		printf("avg score  : %.1f\n", (double)stats.score / stats.worlds);
+		printf("state      : %08x\n", stats.hash);
+		printf("elapsed(s) : %.3f\n", stats.seconds);
+		printf("steps/sec  : %.0f\n", stats.seconds > 0.0 ? stats.steps / stats.seconds : 0.0);
+		if (tracePath && !finishProfile(tracePath)) {
+			fprintf(stderr, "%s: can't write trace %s\n", argv[0], tracePath);
+			return 1;
+		}
+		return 0;
+	}
+
+	// the extra balls of the multi-ball mode are stepped in parallel
+	std::unique_ptr<lego::ThreadPool> pool;
+	if (multiBall > 0)
+		pool.reset(new lego::ThreadPool(threads));
+
+	lego::Game game;
+	game.setup(positions, count);
+	game.setContinuousCollision(!discrete);
+	game.setMultiBall(multiBall);
+	game.setFixedPoint(fixedPoint);
+	game.setThreadPool(pool.get());
+
+	if (threaded) {
+		lego::InputRecorder recorder;
+		recorder.start(game, timeDelta);
+		lego::SimulationThread sim(game, recorder);
+		unsigned int posted = 0, next = 0;
+		long snapshots = 0;
+
+		// one tick at a time: the input decided on a snapshot lands in the
+		// tick after it, as the recording loop below applies it
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		sim.setTickLimit(next);
+		sim.start(0.0f);
+		for (;;) {
+			const lego::SimSnapshot& snapshot = sim.getSnapshot();
+			if (snapshot.ticks != next) {
+				std::this_thread::yield();
+				continue;
+			}
+			snapshots++;
+			if (tracePath)
+				collectProfile();
+			if (snapshot.ticks >= (unsigned long)steps)
+				break;
+			lego::InputType input;
+			if (snapshot.state.isGameEnded)
+				posted += sim.postInput(lego::INPUT_RESTART);
+			if (lego::autopilotInput(snapshot.state, input))
+				posted += sim.postInput(input);
+			sim.setTickLimit(++next);
+		}
+		sim.stop();
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		const lego::InputLog& log = recorder.finish(game);
+		if (recordPath && !log.save(recordPath)) {
+			fprintf(stderr, "%s: can't write replay log %s\n", argv[0], recordPath);
+			return 1;
+		}
+		printf("ticks      : %u\n", log.ticks);
+		printf("snapshots  : %ld read\n", snapshots);
+		printf("inputs     : %u posted, %u logged\n", posted, (unsigned int)log.inputs.size());
+		printf("life       : %d\n", game.getLife());
+		printf("score      : %d\n", game.getScore());
+		printf("state      : %08x\n", log.finalHash);
+		printf("elapsed(s) : %.3f\n", elapsed);
+		printf("ticks/sec  : %.0f\n", elapsed > 0.0 ? log.ticks / elapsed : 0.0);
+		if (framePath && !renderFrame(game, framePath)) {
+			fprintf(stderr, "%s: can't write frame %s\n", argv[0], framePath);
+			return 1;
+		}
+		if (tracePath && !finishProfile(tracePath)) {
+			fprintf(stderr, "%s: can't write trace %s\n", argv[0], tracePath);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (recordPath) {
+		lego::InputRecorder recorder;
+		recorder.start(game, timeDelta);
+		for (long i = 0; i < steps; i++) {
+			lego::InputType input;
+			if (game.isGameEnded())
+				recorder.input(game, lego::INPUT_RESTART);
+			if (lego::autopilotInput(game, input))
+				recorder.input(game, input);
+			recorder.update(game);
+			if (tracePath)
+				collectProfile();
+		}
+		const lego::InputLog& log = recorder.finish(game);
+		if (!log.save(recordPath)) {
+			fprintf(stderr, "%s: can't write replay log %s\n", argv[0], recordPath);
+			return 1;
+		}
+		printf("ticks      : %u\n", log.ticks);
+		printf("inputs     : %u\n", (unsigned int)log.inputs.size());
+		printf("life       : %d\n", game.getLife());
+		printf("score      : %d\n", game.getScore());
+		printf("state      : %08x\n", log.finalHash);
+		if (tracePath && !finishProfile(tracePath)) {
+			fprintf(stderr, "%s: can't write trace %s\n", argv[0], tracePath);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (rollouts > 0) {
+		const long rolloutSteps = 1000;
+		for (long i = 0; i < steps; i++) {
+			if (game.isGameEnded())
+				game.restart();
+			lego::autopilot(game);
+			game.update(timeDelta);
+		}
+
+		// the rollout of the game itself, for every fork to match
+		lego::GameState state;
+		lego::Game reference;
+		game.saveState(state);
+		reference.restoreState(state);
+		for (long i = 0; i < rolloutSteps; i++) {
+			lego::autopilot(reference);
+			reference.update(timeDelta);
+		}
+		unsigned int expected = lego::hashGame(reference);
+
+		lego::Game fork;
+		fork.setThreadPool(pool.get());
+		double saveSeconds = 0.0, restoreSeconds = 0.0;
+		int matches = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int r = 0; r < rollouts; r++) {
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			game.saveState(state);
+			std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+			fork.restoreState(state);
+			std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+			saveSeconds += std::chrono::duration<double>(t1 - t0).count();
+			restoreSeconds += std::chrono::duration<double>(t2 - t1).count();
+
+			for (long i = 0; i < rolloutSteps; i++) {
+				lego::autopilot(fork);
+				fork.update(timeDelta);
+			}
+			matches += lego::hashGame(fork) == expected;
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("kernel     : %s\n", lego::getCollisionKernel());
+		printf("bricks     : %d (%d alive)\n", game.getBrickCount(), game.getBricks().getAliveCount());
+		printf("rollouts   : %d of %ld steps\n", rollouts, rolloutSteps);
+		printf("state      : %u bytes\n", (unsigned int)state.getMemoryUsage());
+		printf("save(us)   : %.2f\n", saveSeconds * 1e6 / rollouts);
+		printf("restore(us): %.2f\n", restoreSeconds * 1e6 / rollouts);
+		printf("matches    : %d of %d (%08x)\n", matches, rollouts, expected);
+		printf("elapsed(s) : %.3f\n", elapsed);
+		return matches == rollouts ? 0 : 2;
+	}
+
+	// -W writes every frame and decodes it again to check it, -S serves
+	// the frames at the game window's pace
+	lego::StreamEncoder encoder;
+	lego::StreamDecoder check;
+	lego::StreamPublisher publisher;
+	std::vector<unsigned char> header, frame;
+	FILE* streamFile = 0;
+	size_t streamBytes = 0;
+	long keyframes = 0, mismatches = 0;
+	float streamError = 0.0f;
+	if (streamPath || publishPath) {
+		encoder.begin(game, timeDelta, header);
+		if (streamPath) {
+			streamFile = fopen(streamPath, "wb");
+			if (!streamFile || fwrite(&header[0], 1, header.size(), streamFile) != header.size()) {
+				fprintf(stderr, "%s: can't write stream %s\n", argv[0], streamPath);
+				return 1;
+			}
+			check.decode(&header[0], header.size());
+		}
+		if (publishPath && !publisher.open(publishPath, header)) {
+			fprintf(stderr, "%s: can't serve stream on %s\n", argv[0], publishPath);
+			return 1;
+		}
+	}
+	std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now();
+
+	long games = 1;
+	long events = 0;
+	int peakBalls = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (long i = 0; i < steps; i++) {
+		if (game.isGameEnded()) {
+			game.restart();
+			games++;
+		}
+		lego::autopilot(game);
+		if (eventDriven)
+			events += game.fastForward(timeDelta);
+		else
+			game.update(timeDelta);
+		if (game.getExtraBallCount() > peakBalls)
+			peakBalls = game.getExtraBallCount();
+		if (tracePath)
+			collectProfile();
+
+		if (streamPath || publishPath) {
+			if (publishPath && publisher.accept())
+				encoder.requestKeyframe();
+			frame.clear();
+			bool keyframe = encoder.encode(game, frame);
+			streamBytes += frame.size();
+			keyframes += keyframe;
+			if (streamFile) {
+				fwrite(&frame[0], 1, frame.size(), streamFile);
+				check.decode(&frame[0], frame.size());
+				float error = getStreamError(check.getGame(), game);
+				if (error < 0.0f)
+					mismatches++;
+				else
+					streamError = std::max(streamError, error);
+			}
+			if (publishPath) {
+				publisher.send(&frame[0], frame.size(), keyframe);
+				nextTick += std::chrono::microseconds(1000000 / windowTickRate);
+				std::this_thread::sleep_until(nextTick);
+			}
+		}
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (streamFile) {
+		bool written = !ferror(streamFile);
+		if (fclose(streamFile) != 0 || !written) {
+			fprintf(stderr, "%s: can't write stream %s\n", argv[0], streamPath);
+			return 1;
+		}
+	}
+	publisher.close();
+
+	printf("kernel     : %s\n", lego::getCollisionKernel());
+	printf("bricks     : %d\n", game.getBrickCount());
+	printf("steps      : %ld\n", steps);
+	if (eventDriven)
+		printf("events     : %ld\n", events);
+	else
+		printf("asleep     : %ld steps\n", game.getSleepingSteps());
+	if (multiBall > 0)
+		printf("extra balls: %d at most (%d threads)\n", peakBalls, pool->getThreadCount());
+	printf("games      : %ld\n", games);
+	printf("life       : %d\n", game.getLife());
+	printf("score      : %d\n", game.getScore());
+	printf("state      : %08x\n", lego::hashGame(game));
+	printf("elapsed(s) : %.3f\n", elapsed);
+	printf("steps/sec  : %.0f\n", elapsed > 0.0 ? steps / elapsed : 0.0);
+	if (streamPath || publishPath) {
+		printf("stream     : %u bytes header, %lu bytes in %ld frames (%ld keyframes)\n", (unsigned int)header.size(),
+			(unsigned long)streamBytes, steps, keyframes);
+		printf("stream rate: %.2f bytes/tick, %.0f bytes/sec at %d ticks/sec\n", (double)streamBytes / steps,
+			(double)streamBytes / steps * windowTickRate, windowTickRate);
+	}
+	if (streamFile) {
+		if (mismatches > 0)
+			printf("decoded    : MISMATCH in %ld ticks\n", mismatches);
+		else
+			printf("decoded    : match, balls within %.4f\n", streamError);
+	}
+	if (framePath && !renderFrame(game, framePath)) {
+		fprintf(stderr, "%s: can't write frame %s\n", argv[0], framePath);
+		return 1;
+	}
+	if (tracePath && !finishProfile(tracePath)) {
+		fprintf(stderr, "%s: can't write trace %s\n", argv[0], tracePath);
+		return 1;
+	}
+	return mismatches > 0 ? 2 : 0;
+}
@@ -0,0 +1,225 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoHud.cpp
+//
+// Desc: Glyph atlas and HUD text layout.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoHud.h"
+#include <cstdio>
+#include <cstring>
+
+struct TextDesc
+{
+	lego::HudFont	font;
+	int				left, top;		// top left of the text on a 1024 x 768 screen
+	unsigned int	color;
+	const char*		characters;		// the text, or every character it can show
+};
+
+static const unsigned int hudGreen = 0xffa6ea5d;
+
+static const TextDesc texts[lego::HUD_TEXT_COUNT] = {
+	{ lego::HUD_FONT_60, 20, 20, hudGreen, "Lives Left" },
+	{ lego::HUD_FONT_50, 55, 70, hudGreen, "0123456789" },
+	{ lego::HUD_FONT_30, 380, 400, 0xff000000, "Press SPACE to start" },
+	{ lego::HUD_FONT_40, 410, 500, 0xffff0000, "Game over" },
+	{ lego::HUD_FONT_50, 440, 500, hudGreen, "CLEAR" },
+	{ lego::HUD_FONT_16, 780, 20, 0xff000000,
+		"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .,:;-_/()%+#" },
+};
+
+static const int glyphPadding = 1;		// texels between glyphs, against bleeding
+
+int lego::getHudFontHeight(HudFont font)
+{
+	static const int heights[HUD_FONT_COUNT] = { 16, 30, 40, 50, 60 };
+	return heights[font];
+}
+
+// -----------------------------------------------------------------------------
+// GlyphAtlas
+// -----------------------------------------------------------------------------
+
+lego::GlyphAtlas::GlyphAtlas(void)
+{
+	m_width = m_height = 0;
+	memset(m_ascent, 0, sizeof(m_ascent));
+	memset(m_glyphs, 0, sizeof(m_glyphs));
+}
+
+bool lego::GlyphAtlas::build(GlyphSource& source)
+{
+	std::vector<GlyphBitmap> bitmaps;
+	std::vector<Glyph*> placed;
+	int x = glyphPadding, y = glyphPadding, rowHeight = 0;
+	int font, i;
+
+	memset(m_glyphs, 0, sizeof(m_glyphs));
+	for (font = 0; font < HUD_FONT_COUNT; font++)
+		m_ascent[font] = source.getAscent((HudFont)font);
+
+	// shelf packing in the order the characters come: the glyphs of one font
+	// are about as high, so rows waste little
+	for (i = 0; i < HUD_TEXT_COUNT; i++) {
+		const TextDesc& text = texts[i];
+		for (const char* c = text.characters; *c != '\0'; c++) {
+			Glyph& glyph = m_glyphs[text.font][*c & 0x7f];
+			if (glyph.baked)
+				continue;
+
+			GlyphBitmap bitmap;
+			if (!source.rasterize(text.font, *c, bitmap))
+				return false;
+			if (bitmap.width + 2 * glyphPadding > atlasWidth)
+				return false;
+			if (x + bitmap.width + glyphPadding > atlasWidth) {
+				x = glyphPadding;
+				y += rowHeight + glyphPadding;
+				rowHeight = 0;
+			}
+
+			glyph.baked = true;
+			glyph.x = x;
+			glyph.y = y;
+			glyph.width = bitmap.width;
+			glyph.height = bitmap.height;
+			glyph.originX = bitmap.originX;
+			glyph.originY = bitmap.originY;
+			glyph.advance = bitmap.advance;
+
+			x += bitmap.width + glyphPadding;
+			if (bitmap.height > rowHeight)
+				rowHeight = bitmap.height;
+			bitmaps.push_back(bitmap);
+			placed.push_back(&glyph);
+		}
+	}
+
+	m_width = atlasWidth;
+	m_height = 1;
+	while (m_height < y + rowHeight + glyphPadding)
+		m_height *= 2;
+	m_pixels.assign(m_width * m_height, 0);
+
+	for (i = 0; i < (int)bitmaps.size(); i++) {
+		const GlyphBitmap& bitmap = bitmaps[i];
+		const Glyph& glyph = *placed[i];
+		for (int row = 0; row < bitmap.height; row++)
+			memcpy(&m_pixels[(glyph.y + row) * m_width + glyph.x], &bitmap.alpha[row * bitmap.width], bitmap.width);
+	}
+	return true;
+}
+
+const lego::Glyph* lego::GlyphAtlas::getGlyph(HudFont font, char c) const
+{
+	const Glyph& glyph = m_glyphs[font][c & 0x7f];
+	return glyph.baked ? &glyph : 0;
+}
+
+// -----------------------------------------------------------------------------
+// Hud
+// -----------------------------------------------------------------------------
+
+lego::Hud::Hud(const GlyphAtlas& atlas)
+	: m_atlas(atlas)
+{
+	m_layouts = 0;
+	m_life = m_score = m_roundStarted = m_cleared = -1;
+
+	// the fixed texts are laid out once and for all
+	for (int i = 0; i < HUD_TEXT_COUNT; i++) {
+		m_visible[i] = false;
+		if (i != HUD_LIVES_COUNT && i != HUD_PROFILE)
+			layout((HudText)i, texts[i].characters);
+	}
+}
+
+void lego::Hud::layout(HudText text, const char* string)
+{
+	const TextDesc& desc = texts[text];
+	const float invWidth = 1.0f / m_atlas.getWidth();
+	const float invHeight = 1.0f / m_atlas.getHeight();
+	int pen = desc.left;
+	int baseline = desc.top + m_atlas.getAscent(desc.font);
+
+	m_runs[text].clear();
+	for (const char* c = string; *c != '\0'; c++) {
+		if (*c == '\n') {
+			pen = desc.left;
+			baseline += getHudFontHeight(desc.font);
+			continue;
+		}
+		const Glyph* glyph = m_atlas.getGlyph(desc.font, *c);
+		if (glyph == 0)
+			continue;
+		if (glyph->width > 0 && glyph->height > 0) {
+			HudQuad quad;
+			quad.left = (float)(pen + glyph->originX);
+			quad.top = (float)(baseline - glyph->originY);
+			quad.right = quad.left + glyph->width;
+			quad.bottom = quad.top + glyph->height;
+			quad.u0 = glyph->x * invWidth;
+			quad.v0 = glyph->y * invHeight;
+			quad.u1 = (glyph->x + glyph->width) * invWidth;
+			quad.v1 = (glyph->y + glyph->height) * invHeight;
+			quad.color = desc.color;
+			m_runs[text].push_back(quad);
+		}
+		pen += glyph->advance;
+	}
+	m_layouts++;
+}
+
+bool lego::Hud::update(const RenderState& state)
+{
+	int life = state.life;
+	int score = state.score;
+	int roundStarted = state.isRoundStarted ? 1 : 0;
+	int cleared = state.isLevelCleared() ? 1 : 0;
+
+	if (life == m_life && score == m_score && roundStarted == m_roundStarted && cleared == m_cleared)
+		return false;
+
+	if (life != m_life) {
+		char count[16];
+		snprintf(count, sizeof(count), "%d", life);
+		layout(HUD_LIVES_COUNT, count);
+	}
+	m_life = life;
+	m_score = score;
+	m_roundStarted = roundStarted;
+	m_cleared = cleared;
+
+	m_visible[HUD_LIVES_LABEL] = true;
+	m_visible[HUD_LIVES_COUNT] = true;
+	// between rounds, with lives left and bricks to hit
+	m_visible[HUD_START] = !roundStarted && life > 0 && !cleared;
+	m_visible[HUD_GAME_OVER] = life <= 0;
+	m_visible[HUD_CLEAR] = cleared != 0;
+
+	gatherQuads();
+	return true;
+}
+
+bool lego::Hud::setOverlay(const char* text)
+{
+	if (m_overlay == text)
+		return false;
+
+	m_overlay = text;
+	layout(HUD_PROFILE, text);
+	m_visible[HUD_PROFILE] = !m_overlay.empty();
+	gatherQuads();
+	return true;
+}
+
+void lego::Hud::gatherQuads(void)
+{
+	m_quads.clear();
+	for (int i = 0; i < HUD_TEXT_COUNT; i++) {
+		if (m_visible[i])
+			m_quads.insert(m_quads.end(), m_runs[i].begin(), m_runs[i].end());
+	}
+}
@@ -0,0 +1,150 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoHud.h
+//
+// Desc: Lives, start, game over and clear messages drawn over the scene,
+//       and the profiler breakdown when it's on.
+//       Every glyph the HUD can show is baked once into one alpha atlas,
+//       the texts are laid out into textured quads, and a text is only
+//       laid out again when what it shows changes. A frame draws the
+//       cached quads with a single texture and no font objects.
+//
+//       Rasterizing the glyphs is left to a GlyphSource, since fonts are a
+//       matter of the platform (GDI on Windows).
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoHudH__
+#define __legoHudH__
+
+#include "legoGame.h"
+#include <string>
+#include <vector>
+
+namespace lego
+{
+	// bold Arial at the sizes the texts use
+	enum HudFont
+	{
+		HUD_FONT_16,
+		HUD_FONT_30,
+		HUD_FONT_40,
+		HUD_FONT_50,
+		HUD_FONT_60,
+		HUD_FONT_COUNT
+	};
+	int getHudFontHeight(HudFont font);
+
+	enum HudText
+	{
+		HUD_LIVES_LABEL,	// "Lives Left"
+		HUD_LIVES_COUNT,	// 0 to 5 under it
+		HUD_START,			// "Press SPACE to start"
+		HUD_GAME_OVER,
+		HUD_CLEAR,
+		HUD_PROFILE,		// profiler breakdown, see setOverlay()
+		HUD_TEXT_COUNT
+	};
+
+	// alpha coverage of one glyph, rows from the top. origin is where the
+	// top left of the bitmap sits from the pen on the baseline, y upwards.
+	struct GlyphBitmap
+	{
+		int		width, height;
+		int		originX, originY;
+		int		advance;
+		std::vector<unsigned char>	alpha;	// width * height, 0 to 255
+	};
+
+	class GlyphSource {
+	public:
+		virtual ~GlyphSource(void) {}
+
+		// baseline to the top of the cell
+		virtual int getAscent(HudFont font) = 0;
+		virtual bool rasterize(HudFont font, char c, GlyphBitmap& glyph) = 0;
+	};
+
+	// where a glyph is in the atlas
+	struct Glyph
+	{
+		bool	baked;
+		int		x, y;			// top left texel
+		int		width, height;
+		int		originX, originY;
+		int		advance;
+	};
+
+	class GlyphAtlas {
+	public:
+		GlyphAtlas(void);
+
+		// rasterizes the characters of every HUD text and packs them in rows
+		// of a texture atlasWidth texels wide, as high as they need rounded
+		// up to a power of two
+		bool build(GlyphSource& source);
+
+		int getWidth(void) const { return m_width; }
+		int getHeight(void) const { return m_height; }
+		// alpha, row by row from the top
+		const unsigned char* getPixels(void) const { return m_pixels.empty() ? 0 : &m_pixels[0]; }
+
+		int getAscent(HudFont font) const { return m_ascent[font]; }
+		// 0 for a character that isn't baked
+		const Glyph* getGlyph(HudFont font, char c) const;
+
+	private:
+		int		m_width, m_height;
+		int		m_ascent[HUD_FONT_COUNT];
+		Glyph	m_glyphs[HUD_FONT_COUNT][128];
+		std::vector<unsigned char>	m_pixels;
+	};
+
+	const int atlasWidth = 512;
+
+	// screen pixels and atlas texture coordinates
+	struct HudQuad
+	{
+		float			left, top, right, bottom;
+		float			u0, v0, u1, v1;
+		unsigned int	color;		// 0xAARRGGBB
+	};
+
+	class Hud {
+	public:
+		// atlas must be built already
+		explicit Hud(const GlyphAtlas& atlas);
+
+		// lays out what changed since the last call, from a snapshot of the
+		// game (see Game::saveRenderState). true when the quads changed.
+		bool update(const RenderState& state);
+		// shows text, several lines, in the top right corner, or nothing
+		// for "". true when the quads changed.
+		bool setOverlay(const char* text);
+
+		const std::vector<HudQuad>& getQuads(void) const { return m_quads; }
+		// texts laid out so far, to see the caching work
+		int getLayoutCount(void) const { return m_layouts; }
+
+	private:
+		const GlyphAtlas&	m_atlas;
+		std::vector<HudQuad>	m_runs[HUD_TEXT_COUNT];
+		bool				m_visible[HUD_TEXT_COUNT];
+		std::vector<HudQuad>	m_quads;
+		int					m_layouts;
+
+		// what the quads were built for, -1 before the first update
+		int		m_life, m_score;
+		int		m_roundStarted;
+		int		m_cleared;
+		std::string	m_overlay;
+
+		void layout(HudText text, const char* string);
+		void gatherQuads(void);
+
+		Hud(const Hud&);
+		Hud& operator=(const Hud&);
+	};
+}
+
+#endif // __legoHudH__
@@ -0,0 +1,339 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoLevel.cpp
+//
+// Desc: Binary level files, mapped into memory.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoLevel.h"
+#include "legoPhysics.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char levelMagic[4] = { 'L', 'G', 'L', 'V' };
+static const unsigned int levelAlignment = 16;
+static const unsigned int defaultBrickColor = 0x00ffff00;	// yellow, as MATERIAL_BRICK
+
+// the arrays are used in place, so the file has to be in the byte order of the cpu
+static bool isLittleEndian(void)
+{
+	const unsigned int probe = 1;
+	return *(const unsigned char*)&probe == 1;
+}
+
+static size_t alignUp(size_t offset)
+{
+	return (offset + levelAlignment - 1) & ~(size_t)(levelAlignment - 1);
+}
+
+// the walls Game::setup() puts up
+static void getBuiltInWalls(lego::LevelWall walls[3])
+{
+	const lego::LevelWall builtIn[3] = {
+		{ 0.0f, lego::verticalBarDepth / 2, lego::horizontalBarWidth, lego::wallThickness },
+		{ lego::horizontalBarWidth / 2, 0.0f, lego::wallThickness, lego::verticalBarDepth },
+		{ -lego::horizontalBarWidth / 2, 0.0f, lego::wallThickness, lego::verticalBarDepth },
+	};
+	memcpy(walls, builtIn, sizeof(builtIn));
+}
+
+// -----------------------------------------------------------------------------
+// LevelDesc
+// -----------------------------------------------------------------------------
+
+lego::LevelDesc::LevelDesc(void)
+{
+	tableWidth = horizontalBarWidth;
+	tableDepth = verticalBarDepth;
+	wallThickness = lego::wallThickness;
+
+	LevelWall builtIn[3];
+	getBuiltInWalls(builtIn);
+	walls.assign(builtIn, builtIn + 3);
+}
+
+void lego::LevelDesc::addBrick(float x, float z, unsigned int color, int hitPoints)
+{
+	positions.push_back(x);
+	positions.push_back(z);
+	colors.push_back(color);
+	this->hitPoints.push_back((unsigned char)hitPoints);
+}
+
+bool lego::saveLevel(const char* path, const LevelDesc& level)
+{
+	if (!isLittleEndian())
+		return false;
+
+	const size_t bricks = level.colors.size();
+	LevelHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, levelMagic, sizeof(levelMagic));
+	header.version = levelVersion;
+	header.headerSize = sizeof(LevelHeader);
+	header.wallCount = (unsigned int)level.walls.size();
+	header.brickCount = (unsigned int)bricks;
+	header.tableWidth = level.tableWidth;
+	header.tableDepth = level.tableDepth;
+	header.wallThickness = level.wallThickness;
+
+	size_t offset = alignUp(sizeof(LevelHeader));
+	header.wallOffset = (unsigned int)offset;
+	offset = alignUp(offset + level.walls.size() * sizeof(LevelWall));
+	header.positionOffset = (unsigned int)offset;
+	offset = alignUp(offset + bricks * 2 * sizeof(float));
+	header.colorOffset = (unsigned int)offset;
+	offset = alignUp(offset + bricks * sizeof(unsigned int));
+	header.hitPointOffset = (unsigned int)offset;
+	offset = offset + bricks;
+	if (offset > 0xffffffffu)
+		return false;
+	header.fileSize = (unsigned int)offset;
+
+	std::vector<unsigned char> file(offset, 0);
+	memcpy(&file[0], &header, sizeof(header));
+	if (!level.walls.empty())
+		memcpy(&file[header.wallOffset], &level.walls[0], level.walls.size() * sizeof(LevelWall));
+	if (bricks > 0) {
+		memcpy(&file[header.positionOffset], &level.positions[0], bricks * 2 * sizeof(float));
+		memcpy(&file[header.colorOffset], &level.colors[0], bricks * sizeof(unsigned int));
+		memcpy(&file[header.hitPointOffset], &level.hitPoints[0], bricks);
+	}
+
+	FILE* out = fopen(path, "wb");
+	if (out == NULL)
+		return false;
+	bool ok = fwrite(&file[0], 1, file.size(), out) == file.size();
+	ok = fclose(out) == 0 && ok;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// text form
+// -----------------------------------------------------------------------------
+
+static bool parseFailed(std::string& error, int line, const char* what)
+{
+	char message[256];
+	snprintf(message, sizeof(message), "line %d: %s", line, what);
+	error = message;
+	return false;
+}
+
+bool lego::parseLevel(const char* text, LevelDesc& level, std::string& error)
+{
+	bool builtInWalls = true;
+	int line = 0;
+
+	level = LevelDesc();
+	while (*text != '\0') {
+		const char* end = strchr(text, '\n');
+		size_t length = end ? (size_t)(end - text) : strlen(text);
+		std::string statement(text, length);
+		text += length + (end ? 1 : 0);
+		line++;
+
+		size_t comment = statement.find('#');
+		if (comment != std::string::npos)
+			statement.erase(comment);
+
+		char keyword[16];
+		int used = 0;
+		if (sscanf(statement.c_str(), " %15s%n", keyword, &used) != 1)
+			continue;	// blank
+		const char* args = statement.c_str() + used;
+		float f[4];
+		char extra[2];
+
+		if (strcmp(keyword, "table") == 0) {
+			if (sscanf(args, "%f %f %f %1s", &f[0], &f[1], &f[2], extra) != 3)
+				return parseFailed(error, line, "expected table <width> <depth> <wall thickness>");
+			if (!(f[0] > 0.0f && f[1] > 0.0f && f[2] > 0.0f))
+				return parseFailed(error, line, "table sizes must be positive");
+			level.tableWidth = f[0];
+			level.tableDepth = f[1];
+			level.wallThickness = f[2];
+		}
+		else if (strcmp(keyword, "wall") == 0) {
+			if (sscanf(args, "%f %f %f %f %1s", &f[0], &f[1], &f[2], &f[3], extra) != 4)
+				return parseFailed(error, line, "expected wall <x> <z> <width> <depth>");
+			if (builtInWalls) {
+				level.walls.clear();
+				builtInWalls = false;
+			}
+			LevelWall wall = { f[0], f[1], f[2], f[3] };
+			level.walls.push_back(wall);
+		}
+		else if (strcmp(keyword, "brick") == 0) {
+			unsigned int color = defaultBrickColor;
+			int hitPoints = 1;
+			int fields = sscanf(args, "%f %f %x %d %1s", &f[0], &f[1], &color, &hitPoints, extra);
+			if (fields < 2 || fields > 4)
+				return parseFailed(error, line, "expected brick <x> <z> [<color> [<hit points>]]");
+			if (color > 0xffffff)
+				return parseFailed(error, line, "color must be RRGGBB");
+			if (hitPoints < 1 || hitPoints > 255)
+				return parseFailed(error, line, "hit points must be 1 to 255");
+			if (fabsf(f[0]) > level.tableWidth / 2 || fabsf(f[1]) > level.tableDepth / 2)
+				return parseFailed(error, line, "brick outside the table");
+			level.addBrick(f[0], f[1], color, hitPoints);
+		}
+		else {
+			return parseFailed(error, line, "unknown statement");
+		}
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// LevelFile
+// -----------------------------------------------------------------------------
+
+lego::LevelFile::LevelFile(void)
+{
+	m_header = 0;
+	m_size = 0;
+	m_error = "";
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#endif
+}
+
+lego::LevelFile::~LevelFile(void)
+{
+	close();
+}
+
+// true when count items of size starting at offset lie within the file
+static bool inFile(size_t fileSize, unsigned int offset, unsigned int count, size_t size)
+{
+	return offset % levelAlignment == 0 && offset <= fileSize && count <= (fileSize - offset) / size;
+}
+
+bool lego::LevelFile::open(const char* path)
+{
+	close();
+	if (!isLittleEndian()) {
+		m_error = "level files are little endian";
+		return false;
+	}
+
+	const void* data = 0;
+#ifdef _WIN32
+	m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		m_error = "cannot open the file";
+		return false;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(m_file, &size);
+	m_size = (size_t)size.QuadPart;
+	if (m_size >= sizeof(LevelHeader)) {
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_mapping != NULL)
+			data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		m_error = "cannot open the file";
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) == 0)
+		m_size = (size_t)info.st_size;
+	if (m_size >= sizeof(LevelHeader)) {
+		data = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+			data = 0;
+	}
+	// the mapping keeps the file alive
+	::close(fd);
+#endif
+
+	if (data == 0) {
+		m_error = m_size < sizeof(LevelHeader) ? "not a level file" : "cannot map the file";
+		close();
+		return false;
+	}
+	m_header = (const LevelHeader*)data;
+
+	const LevelHeader& h = *m_header;
+	if (memcmp(h.magic, levelMagic, sizeof(levelMagic)) != 0)
+		m_error = "not a level file";
+	else if (h.version != levelVersion || h.headerSize != sizeof(LevelHeader))
+		m_error = "unsupported level version";
+	else if (h.fileSize != m_size)
+		m_error = "truncated level file";
+	else if (!inFile(m_size, h.wallOffset, h.wallCount, sizeof(LevelWall)) ||
+		!inFile(m_size, h.positionOffset, h.brickCount, 2 * sizeof(float)) ||
+		!inFile(m_size, h.colorOffset, h.brickCount, sizeof(unsigned int)) ||
+		!inFile(m_size, h.hitPointOffset, h.brickCount, 1))
+		m_error = "corrupt level file";
+	else
+		return true;
+
+	close();
+	return false;
+}
+
+void lego::LevelFile::close(void)
+{
+#ifdef _WIN32
+	if (m_header != 0)
+		UnmapViewOfFile(m_header);
+	if (m_mapping != NULL)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = NULL;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_header != 0)
+		munmap((void*)m_header, m_size);
+#endif
+	m_header = 0;
+	m_size = 0;
+}
+
+bool lego::LevelFile::hasBuiltInTable(void) const
+{
+	LevelWall builtIn[3];
+	getBuiltInWalls(builtIn);
+	return getTableWidth() == horizontalBarWidth && getTableDepth() == verticalBarDepth &&
+		getWallThickness() == wallThickness &&
+		getWallCount() == 3 && memcmp(getWalls(), builtIn, sizeof(builtIn)) == 0;
+}
+
+const lego::LevelWall* lego::LevelFile::getWalls(void) const
+{
+	return (const LevelWall*)at(m_header->wallOffset);
+}
+
+const float* lego::LevelFile::getBrickPositions(void) const
+{
+	return (const float*)at(m_header->positionOffset);
+}
+
+const unsigned int* lego::LevelFile::getBrickColors(void) const
+{
+	return (const unsigned int*)at(m_header->colorOffset);
+}
+
+const unsigned char* lego::LevelFile::getBrickHitPoints(void) const
+{
+	return at(m_header->hitPointOffset);
+}
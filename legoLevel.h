@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoLevel.h
+//
+// Desc: Binary level files. A level is mapped into memory and used where it
+//       lies: the header is checked, and the arrays are handed out as
+//       pointers into the mapping, so loading costs the same for 20 bricks
+//       as for a million, with no parsing and no allocation per brick.
+//
+//       file layout, little endian, every array 16 byte aligned:
+//         LevelHeader
+//         wallCount * LevelWall
+//         brickCount * (f32 x, f32 z)
+//         brickCount * u32 color, 0x00RRGGBB
+//         brickCount * u8 hit points
+//
+//       Levels are written by saveLevel(), usually from the text
+//       description read by parseLevel(), with legoMakeLevel.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoLevelH__
+#define __legoLevelH__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lego
+{
+	const unsigned int levelVersion = 1;
+
+	struct LevelHeader
+	{
+		char			magic[4];		// "LGLV"
+		unsigned int	version;
+		unsigned int	headerSize;		// sizeof(LevelHeader), grows with the version
+		unsigned int	wallCount;
+		unsigned int	brickCount;
+		float			tableWidth, tableDepth;
+		float			wallThickness;
+		// from the start of the file
+		unsigned int	wallOffset;
+		unsigned int	positionOffset;
+		unsigned int	colorOffset;
+		unsigned int	hitPointOffset;
+		unsigned int	fileSize;
+		unsigned int	reserved[3];
+	};
+
+	// a wall centered on (x, z)
+	struct LevelWall
+	{
+		float	x, z;
+		float	width, depth;
+	};
+
+	// what a level is made of, in ordinary vectors, for writing one
+	struct LevelDesc
+	{
+		float	tableWidth, tableDepth;
+		float	wallThickness;
+		std::vector<LevelWall>		walls;
+		std::vector<float>			positions;	// (x, z) per brick
+		std::vector<unsigned int>	colors;
+		std::vector<unsigned char>	hitPoints;
+
+		// the built-in table and walls, without bricks
+		LevelDesc(void);
+		int getBrickCount(void) const { return (int)colors.size(); }
+		void addBrick(float x, float z, unsigned int color, int hitPoints);
+	};
+
+	bool saveLevel(const char* path, const LevelDesc& level);
+
+	// reads the text form of a level, one statement per line, '#' comments:
+	//   table <width> <depth> <wall thickness>
+	//   wall <x> <z> <width> <depth>        (the first one drops the built-in walls)
+	//   brick <x> <z> [<color, hex RRGGBB> [<hit points>]]
+	// on failure error tells the line and what's wrong with it
+	bool parseLevel(const char* text, LevelDesc& level, std::string& error);
+
+	// a level file mapped read-only
+	class LevelFile {
+	public:
+		LevelFile(void);
+		~LevelFile(void);
+
+		bool open(const char* path);
+		void close(void);
+		bool isOpen(void) const { return m_header != 0; }
+		// why open() failed
+		const char* getError(void) const { return m_error; }
+
+		float getTableWidth(void) const { return m_header->tableWidth; }
+		float getTableDepth(void) const { return m_header->tableDepth; }
+		float getWallThickness(void) const { return m_header->wallThickness; }
+		// the walls and the table size are those of the built-in table,
+		// the only ones the physics handles for now
+		bool hasBuiltInTable(void) const;
+
+		int getWallCount(void) const { return (int)m_header->wallCount; }
+		const LevelWall* getWalls(void) const;
+
+		int getBrickCount(void) const { return (int)m_header->brickCount; }
+		// brickCount (x, z) pairs, ready for Game::setup()
+		const float* getBrickPositions(void) const;
+		const unsigned int* getBrickColors(void) const;
+		const unsigned char* getBrickHitPoints(void) const;
+
+	private:
+		const LevelHeader*	m_header;
+		size_t				m_size;
+		const char*			m_error;
+#ifdef _WIN32
+		void*				m_file;
+		void*				m_mapping;
+#endif
+
+		const unsigned char* at(unsigned int offset) const { return (const unsigned char*)m_header + offset; }
+
+		LevelFile(const LevelFile&);
+		LevelFile& operator=(const LevelFile&);
+	};
+}
+
+#endif // __legoLevelH__
@@ -0,0 +1,113 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoLockFree.h
+//
+// Desc: Lock-free hand-offs between exactly two threads.
+//
+//       SpscQueue    bounded FIFO, one thread pushes, one thread pops
+//       TripleBuffer one thread publishes whole values, one thread reads
+//                    the latest; neither ever waits for the other
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoLockFreeH__
+#define __legoLockFreeH__
+
+#include <atomic>
+
+namespace lego
+{
+	// keeps the fields either thread writes on cache lines of their own
+	const int cacheLineSize = 64;
+
+	// Size must be a power of two; the queue holds up to Size items
+	template <class T, unsigned int Size>
+	class SpscQueue {
+	public:
+		SpscQueue(void)
+		{
+			m_head.store(0, std::memory_order_relaxed);
+			m_tail.store(0, std::memory_order_relaxed);
+		}
+
+		// producer. false when the queue is full.
+		bool push(const T& item)
+		{
+			unsigned int head = m_head.load(std::memory_order_relaxed);
+			if (head - m_tail.load(std::memory_order_acquire) >= Size)
+				return false;
+			m_items[head & (Size - 1)] = item;
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// consumer. false when the queue is empty.
+		bool pop(T& item)
+		{
+			unsigned int tail = m_tail.load(std::memory_order_relaxed);
+			if (tail == m_head.load(std::memory_order_acquire))
+				return false;
+			item = m_items[tail & (Size - 1)];
+			m_tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		static_assert((Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+		T							m_items[Size];
+		std::atomic<unsigned int>	m_head;		// written by the producer
+		char						m_pad[cacheLineSize];
+		std::atomic<unsigned int>	m_tail;		// written by the consumer
+
+		SpscQueue(const SpscQueue&);
+		SpscQueue& operator=(const SpscQueue&);
+	};
+
+	// three slots: the writer fills its back slot and swaps it with the
+	// middle one, the reader swaps the middle one with its front slot when
+	// it holds something newer. a slot is never used by both at once.
+	template <class T>
+	class TripleBuffer {
+	public:
+		TripleBuffer(void)
+		{
+			m_back = 0;
+			m_middle.store(1, std::memory_order_relaxed);
+			m_front = 2;
+		}
+
+		// writer: the slot to fill, holding a value two publishes old
+		T& getBack(void) { return m_slots[m_back]; }
+		void publish(void)
+		{
+			m_back = m_middle.exchange(m_back | freshBit, std::memory_order_acq_rel) & indexMask;
+		}
+
+		// reader: takes the latest published value, if any. true if it did.
+		bool update(void)
+		{
+			if ((m_middle.load(std::memory_order_relaxed) & freshBit) == 0)
+				return false;
+			m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & indexMask;
+			return true;
+		}
+		const T& getFront(void) const { return m_slots[m_front]; }
+
+	private:
+		static const unsigned int indexMask = 3;
+		static const unsigned int freshBit = 4;		// the middle slot wasn't read yet
+
+		T							m_slots[3];
+		unsigned int				m_back;		// writer only
+		char						m_pad0[cacheLineSize];
+		std::atomic<unsigned int>	m_middle;	// slot index | freshBit
+		char						m_pad1[cacheLineSize];
+		unsigned int				m_front;	// reader only
+
+		TripleBuffer(const TripleBuffer&);
+		TripleBuffer& operator=(const TripleBuffer&);
+	};
+}
+
+#endif // __legoLockFreeH__
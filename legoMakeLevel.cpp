@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoMakeLevel.cpp
+//
+// Desc: Converts the text description of a level into the binary level
+//       file the game maps, see legoLevel.h for both formats.
+//
+//       usage: legoMakeLevel input.txt output.lvl
+//              legoMakeLevel -g bricks output.lvl
+//
+//       -g  write a generated level of that many bricks, the layout of
+//           legoHeadless -b, for stress tests
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoGame.h"
+#include "legoLevel.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static bool readText(const char* path, std::string& text)
+{
+	FILE* in = fopen(path, "rb");
+	if (in == NULL)
+		return false;
+	char buffer[65536];
+	size_t read;
+	text.clear();
+	while ((read = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		text.append(buffer, read);
+	bool ok = !ferror(in);
+	fclose(in);
+	return ok;
+}
+
+static void usage(const char* name)
+{
+	fprintf(stderr, "usage: %s input.txt output.lvl\n", name);
+	fprintf(stderr, "       %s -g bricks output.lvl\n", name);
+}
+
+int main(int argc, char* argv[])
+{
+	lego::LevelDesc level;
+	const char* outputPath;
+
+	if (argc == 4 && strcmp(argv[1], "-g") == 0) {
+		int bricks = atoi(argv[2]);
+		if (bricks <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+		std::vector<float> layout;
+		lego::makeBrickLayout(bricks, layout);
+		for (int i = 0; i < bricks; i++)
+			level.addBrick(layout[i * 2], layout[i * 2 + 1], 0x00ffff00, 1);
+		outputPath = argv[3];
+	}
+	else if (argc == 3) {
+		std::string text, error;
+		if (!readText(argv[1], text)) {
+			fprintf(stderr, "%s: can't read %s\n", argv[0], argv[1]);
+			return 1;
+		}
+		if (!lego::parseLevel(text.c_str(), level, error)) {
+			fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], error.c_str());
+			return 1;
+		}
+		outputPath = argv[2];
+	}
+	else {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!lego::saveLevel(outputPath, level)) {
+		fprintf(stderr, "%s: can't write %s\n", argv[0], outputPath);
+		return 1;
+	}
+
+	// read it back the way the game does
+	lego::LevelFile file;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!file.open(outputPath)) {
+		fprintf(stderr, "%s: %s: %s\n", argv[0], outputPath, file.getError());
+		return 1;
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("table      : %g x %g, %d walls%s\n", file.getTableWidth(), file.getTableDepth(),
+		file.getWallCount(), file.hasBuiltInTable() ? " (built-in)" : "");
+	printf("bricks     : %d\n", file.getBrickCount());
+	printf("load(ms)   : %.3f\n", elapsed * 1000.0);
+	return 0;
+}
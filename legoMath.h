@@ -0,0 +1,156 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoMath.h
+//
+// Desc: Vectors and 4x4 matrices for the simulation, the renderers and the
+//       D3D client, without D3DX. Matrices follow the D3DX conventions: row
+//       vectors, p' = p * M, translation in the last row, left-handed view
+//       and projection, and the same memory layout as D3DMATRIX, so one can
+//       be handed to SetTransform as it is.
+//
+//       Construction is constexpr, so constants built from vectors and
+//       matrices fold at compile time. Products and the batch operations
+//       use SSE2 where the target has it.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoMathH__
+#define __legoMathH__
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LEGO_MATH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace lego
+{
+	struct Vector3
+	{
+		constexpr Vector3(void) : x(0.0f), y(0.0f), z(0.0f) {}
+		constexpr Vector3(float ix, float iy, float iz) : x(ix), y(iy), z(iz) {}
+
+		float x, y, z;
+	};
+
+	constexpr Vector3 operator+(const Vector3& a, const Vector3& b) { return Vector3(a.x + b.x, a.y + b.y, a.z + b.z); }
+	constexpr Vector3 operator-(const Vector3& a, const Vector3& b) { return Vector3(a.x - b.x, a.y - b.y, a.z - b.z); }
+	constexpr Vector3 operator*(const Vector3& a, float s) { return Vector3(a.x * s, a.y * s, a.z * s); }
+	constexpr float dot(const Vector3& a, const Vector3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	constexpr Vector3 cross(const Vector3& a, const Vector3& b)
+	{
+		return Vector3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+	constexpr float lengthSquared(const Vector3& a) { return dot(a, a); }
+	// a zero vector stays zero
+	inline Vector3 normalize(const Vector3& a)
+	{
+		float length = sqrtf(lengthSquared(a));
+		return length > 0.0f ? Vector3(a.x / length, a.y / length, a.z / length) : a;
+	}
+
+	// 16 byte aligned, each row one SSE register. unaligned copies, e.g. in
+	// a vector on a 32 bit heap, still work.
+	struct alignas(16) Matrix4
+	{
+		constexpr Matrix4(void)
+			: m{ { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f },
+				{ 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } } {}
+		constexpr Matrix4(float m11, float m12, float m13, float m14,
+			float m21, float m22, float m23, float m24,
+			float m31, float m32, float m33, float m34,
+			float m41, float m42, float m43, float m44)
+			: m{ { m11, m12, m13, m14 }, { m21, m22, m23, m24 },
+				{ m31, m32, m33, m34 }, { m41, m42, m43, m44 } } {}
+
+		static constexpr Matrix4 identity(void)
+		{
+			return Matrix4(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		static constexpr Matrix4 translation(float x, float y, float z)
+		{
+			return Matrix4(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, 1.0f, 0.0f, x, y, z, 1.0f);
+		}
+
+		// as D3DXMatrixLookAtLH
+		static Matrix4 lookAtLH(const Vector3& eye, const Vector3& target, const Vector3& up)
+		{
+			Vector3 zAxis = normalize(target - eye);
+			Vector3 xAxis = normalize(cross(up, zAxis));
+			Vector3 yAxis = cross(zAxis, xAxis);
+			return Matrix4(xAxis.x, yAxis.x, zAxis.x, 0.0f,
+				xAxis.y, yAxis.y, zAxis.y, 0.0f,
+				xAxis.z, yAxis.z, zAxis.z, 0.0f,
+				-dot(xAxis, eye), -dot(yAxis, eye), -dot(zAxis, eye), 1.0f);
+		}
+
+		// as D3DXMatrixPerspectiveFovLH
+		static Matrix4 perspectiveFovLH(float fieldOfView, float aspect, float nearPlane, float farPlane)
+		{
+			float yScale = 1.0f / tanf(fieldOfView / 2);
+			float xScale = yScale / aspect;
+			float q = farPlane / (farPlane - nearPlane);
+			return Matrix4(xScale, 0.0f, 0.0f, 0.0f,
+				0.0f, yScale, 0.0f, 0.0f,
+				0.0f, 0.0f, q, 1.0f,
+				0.0f, 0.0f, -nearPlane * q, 0.0f);
+		}
+
+		float m[4][4];
+	};
+
+	inline Matrix4 operator*(const Matrix4& a, const Matrix4& b)
+	{
+		Matrix4 r;
+#ifdef LEGO_MATH_SSE2
+		const __m128 b0 = _mm_loadu_ps(b.m[0]), b1 = _mm_loadu_ps(b.m[1]);
+		const __m128 b2 = _mm_loadu_ps(b.m[2]), b3 = _mm_loadu_ps(b.m[3]);
+		for (int i = 0; i < 4; i++) {
+			__m128 row = _mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0);
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a.m[i][3]), b3));
+			_mm_storeu_ps(r.m[i], row);
+		}
+#else
+		for (int i = 0; i < 4; i++) {
+			for (int j = 0; j < 4; j++)
+				r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+		}
+#endif
+		return r;
+	}
+
+	// count points (x, y, z), w = 1, to (x, y, z, w) in out
+	inline void transformPoints(const Matrix4& matrix, const float* points, int count, float* out)
+	{
+#ifdef LEGO_MATH_SSE2
+		const __m128 r0 = _mm_loadu_ps(matrix.m[0]), r1 = _mm_loadu_ps(matrix.m[1]);
+		const __m128 r2 = _mm_loadu_ps(matrix.m[2]), r3 = _mm_loadu_ps(matrix.m[3]);
+		for (int i = 0; i < count; i++, points += 3, out += 4) {
+			__m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(points[0]), r0), r3);
+			p = _mm_add_ps(p, _mm_mul_ps(_mm_set1_ps(points[1]), r1));
+			p = _mm_add_ps(p, _mm_mul_ps(_mm_set1_ps(points[2]), r2));
+			_mm_storeu_ps(out, p);
+		}
+#else
+		const float (*m)[4] = matrix.m;
+		for (int i = 0; i < count; i++, points += 3, out += 4) {
+			for (int j = 0; j < 4; j++)
+				out[j] = points[0] * m[0][j] + m[3][j] + points[1] * m[1][j] + points[2] * m[2][j];
+		}
+#endif
+	}
+
+	// a translation matrix for each of count positions (x, y, z)
+	inline void makeTranslations(const float* positions, int count, Matrix4* out)
+	{
+		for (int i = 0; i < count; i++, positions += 3)
+			out[i] = Matrix4::translation(positions[0], positions[1], positions[2]);
+	}
+}
+
+#endif // __legoMathH__
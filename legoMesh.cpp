@@ -0,0 +1,315 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoMesh.cpp
+//
+// Desc: Sphere and box meshes for the renderers.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoMesh.h"
+#include "legoPhysics.h"
+#include <algorithm>
+#include <cmath>
+
+static void addVertex(lego::MeshData& mesh, float x, float y, float z, float nx, float ny, float nz)
+{
+	mesh.position.push_back(x);	mesh.position.push_back(y);	mesh.position.push_back(z);
+	mesh.normal.push_back(nx);	mesh.normal.push_back(ny);	mesh.normal.push_back(nz);
+}
+
+// the meshes are convex and centered on the origin, so the face normal
+// must point away from the centroid. the winding follows it.
+static void addTriangle(lego::MeshData& mesh, int i0, int i1, int i2)
+{
+	const float* p = &mesh.position[0];
+	lego::Vector3 p0(p[i0 * 3], p[i0 * 3 + 1], p[i0 * 3 + 2]);
+	lego::Vector3 p1(p[i1 * 3], p[i1 * 3 + 1], p[i1 * 3 + 2]);
+	lego::Vector3 p2(p[i2 * 3], p[i2 * 3 + 1], p[i2 * 3 + 2]);
+	lego::Vector3 n = lego::normalize(lego::cross(p1 - p0, p2 - p0));
+	if (lego::dot(n, p0 + p1 + p2) < 0.0f) {
+		std::swap(i1, i2);
+		n = n * -1.0f;
+	}
+
+	mesh.index.push_back((unsigned short)i0);
+	mesh.index.push_back((unsigned short)i1);
+	mesh.index.push_back((unsigned short)i2);
+	mesh.faceNormal.push_back(n.x);	mesh.faceNormal.push_back(n.y);	mesh.faceNormal.push_back(n.z);
+}
+
+void lego::makeSphereMesh(MeshData& mesh, float radius, int slices, int stacks)
+{
+	mesh = MeshData();
+	for (int stack = 0; stack <= stacks; stack++) {
+		float phi = (float)PI * stack / stacks;
+		for (int slice = 0; slice <= slices; slice++) {
+			float theta = 2.0f * (float)PI * slice / slices;
+			float nx = sinf(phi) * cosf(theta);
+			float ny = cosf(phi);
+			float nz = sinf(phi) * sinf(theta);
+			addVertex(mesh, nx * radius, ny * radius, nz * radius, nx, ny, nz);
+		}
+	}
+	for (int stack = 0; stack < stacks; stack++) {
+		for (int slice = 0; slice < slices; slice++) {
+			int a = stack * (slices + 1) + slice;
+			int b = a + slices + 1;
+			// the quads touching a pole are triangles
+			if (stack != 0)
+				addTriangle(mesh, a, a + 1, b);
+			if (stack != stacks - 1)
+				addTriangle(mesh, a + 1, b + 1, b);
+		}
+	}
+}
+
+void lego::makeBoxMesh(MeshData& mesh, float width, float height, float depth)
+{
+	static const float faces[6][3] = {
+		{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+	};
+	const float half[3] = { width / 2, height / 2, depth / 2 };
+
+	mesh = MeshData();
+	for (int f = 0; f < 6; f++) {
+		const float* n = faces[f];
+		// two axes spanning the face
+		float u[3] = { n[1] != 0 || n[2] != 0 ? 1.0f : 0.0f, n[0] != 0 ? 1.0f : 0.0f, 0.0f };
+		Vector3 axis = cross(Vector3(n[0], n[1], n[2]), Vector3(u[0], u[1], u[2]));
+		float v[3] = { fabsf(axis.x), fabsf(axis.y), fabsf(axis.z) };
+
+		int first = mesh.getVertexCount();
+		for (int corner = 0; corner < 4; corner++) {
+			float su = (corner == 1 || corner == 2) ? 1.0f : -1.0f;
+			float sv = (corner >= 2) ? 1.0f : -1.0f;
+			float p[3];
+			for (int k = 0; k < 3; k++)
+				p[k] = (n[k] + su * u[k] + sv * v[k]) * half[k];
+			addVertex(mesh, p[0], p[1], p[2], n[0], n[1], n[2]);
+		}
+		addTriangle(mesh, first, first + 1, first + 2);
+		addTriangle(mesh, first, first + 2, first + 3);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// vertex cache optimization
+// -----------------------------------------------------------------------------
+
+static const int scoreCacheSize = 32;
+
+// recently used vertices score high, the three of the last triangle a bit
+// less so strips don't run away; vertices with few triangles left score
+// high so they get finished and leave the cache
+static float vertexScore(int cachePosition, int remaining)
+{
+	if (remaining == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3)
+			score = 0.75f;
+		else
+			score = powf(1.0f - (float)(cachePosition - 3) / (scoreCacheSize - 3), 1.5f);
+	}
+	return score + 2.0f / sqrtf((float)remaining);
+}
+
+void lego::optimizeVertexCache(MeshData& mesh)
+{
+	const int vertices = mesh.getVertexCount();
+	const int triangles = mesh.getTriangleCount();
+	if (triangles == 0)
+		return;
+	int i, k;
+
+	// triangles of every vertex
+	std::vector<int> start(vertices + 1, 0);
+	for (i = 0; i < triangles * 3; i++)
+		start[mesh.index[i] + 1]++;
+	for (i = 0; i < vertices; i++)
+		start[i + 1] += start[i];
+	std::vector<int> adjacent(triangles * 3);
+	std::vector<int> fill(start.begin(), start.end() - 1);
+	for (i = 0; i < triangles * 3; i++)
+		adjacent[fill[mesh.index[i]]++] = i / 3;
+
+	std::vector<int> remaining(vertices);
+	std::vector<float> score(vertices);
+	for (i = 0; i < vertices; i++) {
+		remaining[i] = start[i + 1] - start[i];
+		score[i] = vertexScore(-1, remaining[i]);
+	}
+
+	std::vector<bool> added(triangles, false);
+	std::vector<int> cache, nextCache;
+	std::vector<int> picked;
+	std::vector<unsigned short> order;
+	picked.reserve(triangles);
+	order.reserve(triangles * 3);
+	int best = 0;
+	int scan = 0;
+
+	for (int n = 0; n < triangles; n++) {
+		if (best < 0) {
+			// nothing in the cache is left, take the next unused triangle
+			while (added[scan])
+				scan++;
+			best = scan;
+		}
+
+		added[best] = true;
+		picked.push_back(best);
+		nextCache.clear();
+		for (k = 0; k < 3; k++) {
+			int v = mesh.index[best * 3 + k];
+			order.push_back((unsigned short)v);
+			nextCache.push_back(v);
+
+			// drop the triangle from the vertex's list of pending ones
+			int* first = &adjacent[start[v]];
+			int* last = first + remaining[v];
+			*std::find(first, last, best) = *(last - 1);
+			remaining[v]--;
+		}
+
+		// move the triangle's vertices to the front of the cache
+		for (i = 0; i < (int)cache.size(); i++) {
+			int v = cache[i];
+			if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+				nextCache.push_back(v);
+		}
+		for (i = scoreCacheSize; i < (int)nextCache.size(); i++)
+			score[nextCache[i]] = vertexScore(-1, remaining[nextCache[i]]);
+		if ((int)nextCache.size() > scoreCacheSize)
+			nextCache.resize(scoreCacheSize);
+		cache.swap(nextCache);
+
+		for (i = 0; i < (int)cache.size(); i++)
+			score[cache[i]] = vertexScore(i, remaining[cache[i]]);
+
+		// best pending triangle around the cached vertices
+		best = -1;
+		float bestScore = -1.0f;
+		for (i = 0; i < (int)cache.size(); i++) {
+			int v = cache[i];
+			for (k = 0; k < remaining[v]; k++) {
+				int t = adjacent[start[v] + k];
+				float s = score[mesh.index[t * 3]] + score[mesh.index[t * 3 + 1]] + score[mesh.index[t * 3 + 2]];
+				if (s > bestScore) {
+					bestScore = s;
+					best = t;
+				}
+			}
+		}
+	}
+
+	// face normals follow their triangles
+	std::vector<float> faceNormal(triangles * 3);
+	for (i = 0; i < triangles; i++) {
+		for (k = 0; k < 3; k++)
+			faceNormal[i * 3 + k] = mesh.faceNormal[picked[i] * 3 + k];
+	}
+
+	// vertices in order of first use, so fetching them streams through memory
+	std::vector<int> remap(vertices, -1);
+	int used = 0;
+	for (i = 0; i < triangles * 3; i++) {
+		if (remap[order[i]] < 0)
+			remap[order[i]] = used++;
+		order[i] = (unsigned short)remap[order[i]];
+	}
+	std::vector<float> position(used * 3), normal(used * 3);
+	for (i = 0; i < vertices; i++) {
+		if (remap[i] < 0)
+			continue;
+		for (k = 0; k < 3; k++) {
+			position[remap[i] * 3 + k] = mesh.position[i * 3 + k];
+			normal[remap[i] * 3 + k] = mesh.normal[i * 3 + k];
+		}
+	}
+
+	mesh.position.swap(position);
+	mesh.normal.swap(normal);
+	mesh.index.swap(order);
+	mesh.faceNormal.swap(faceNormal);
+}
+
+float lego::getCacheMissRatio(const MeshData& mesh, int cacheSize)
+{
+	std::vector<int> fifo;
+	int misses = 0;
+	for (size_t i = 0; i < mesh.index.size(); i++) {
+		int v = mesh.index[i];
+		if (std::find(fifo.begin(), fifo.end(), v) != fifo.end())
+			continue;
+		misses++;
+		fifo.push_back(v);
+		if ((int)fifo.size() > cacheSize)
+			fifo.erase(fifo.begin());
+	}
+	return mesh.getTriangleCount() > 0 ? (float)misses / mesh.getTriangleCount() : 0.0f;
+}
+
+// -----------------------------------------------------------------------------
+// MeshCache
+// -----------------------------------------------------------------------------
+
+bool lego::MeshCache::Key::operator<(const Key& other) const
+{
+	for (int i = 0; i < 3; i++) {
+		if (size[i] != other.size[i])
+			return size[i] < other.size[i];
+	}
+	if (slices != other.slices)
+		return slices < other.slices;
+	return stacks < other.stacks;
+}
+
+lego::MeshCache::~MeshCache(void)
+{
+	for (std::map<Key, MeshData*>::iterator it = m_meshes.begin(); it != m_meshes.end(); ++it)
+		delete it->second;
+}
+
+const lego::MeshData& lego::MeshCache::get(const MeshShape& shape)
+{
+	Key key;
+	if (shape.sphere) {
+		key.size[0] = shape.radius;
+		key.size[1] = key.size[2] = -1.0f;
+		key.slices = shape.slices;
+		key.stacks = shape.stacks;
+	}
+	else {
+		key.size[0] = shape.width;
+		key.size[1] = shape.height;
+		key.size[2] = shape.depth;
+		key.slices = key.stacks = 0;
+	}
+
+	std::map<Key, MeshData*>::iterator it = m_meshes.find(key);
+	if (it != m_meshes.end())
+		return *it->second;
+
+	MeshData* mesh = new MeshData;
+	if (shape.sphere)
+		makeSphereMesh(*mesh, shape.radius, shape.slices, shape.stacks);
+	else
+		makeBoxMesh(*mesh, shape.width, shape.height, shape.depth);
+	optimizeVertexCache(*mesh);
+	m_meshes[key] = mesh;
+	return *mesh;
+}
+
+size_t lego::MeshCache::getMemoryUsage(void) const
+{
+	size_t bytes = 0;
+	for (std::map<Key, MeshData*>::const_iterator it = m_meshes.begin(); it != m_meshes.end(); ++it) {
+		const MeshData& mesh = *it->second;
+		bytes += (mesh.position.size() + mesh.normal.size() + mesh.faceNormal.size()) * sizeof(float);
+		bytes += mesh.index.size() * sizeof(unsigned short);
+	}
+	return bytes;
+}
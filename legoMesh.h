@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoMesh.h
+//
+// Desc: Sphere and box meshes for the renderers, generated once per shape
+//       and shared through MeshCache. Triangles are ordered for the
+//       post-transform vertex cache (Forsyth's linear-speed algorithm) and
+//       vertices by first use, so a mesh costs about one vertex shade per
+//       triangle instead of three.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoMeshH__
+#define __legoMeshH__
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace lego
+{
+	// a sphere of radius, or a box of width x height x depth, centered on
+	// the origin
+	struct MeshShape
+	{
+		bool	sphere;
+		float	radius;
+		int		slices, stacks;
+		float	width, height, depth;
+	};
+
+	// triangles wind clockwise seen from outside, as Direct3D expects
+	struct MeshData
+	{
+		std::vector<float>			position;	// x, y, z per vertex
+		std::vector<float>			normal;
+		std::vector<unsigned short>	index;		// 3 per triangle
+		std::vector<float>			faceNormal;	// 3 per triangle
+
+		int getVertexCount(void) const { return (int)position.size() / 3; }
+		int getTriangleCount(void) const { return (int)index.size() / 3; }
+	};
+
+	void makeSphereMesh(MeshData& mesh, float radius, int slices, int stacks);
+	void makeBoxMesh(MeshData& mesh, float width, float height, float depth);
+
+	// reorders the triangles for a vertex cache, then the vertices by first use
+	void optimizeVertexCache(MeshData& mesh);
+
+	// vertices transformed per triangle with a FIFO cache of cacheSize
+	// entries: 3 without any reuse, about 0.6 at best for a regular grid
+	float getCacheMissRatio(const MeshData& mesh, int cacheSize);
+
+	// every mesh is built and optimized the first time it's asked for, then
+	// handed out to every user of the same shape
+	class MeshCache {
+	public:
+		MeshCache(void) {}
+		~MeshCache(void);
+
+		const MeshData& get(const MeshShape& shape);
+
+		int getMeshCount(void) const { return (int)m_meshes.size(); }
+		// bytes of vertex and index data held
+		size_t getMemoryUsage(void) const;
+
+	private:
+		struct Key
+		{
+			float	size[3];	// radius, or width, height, depth
+			int		slices, stacks;
+
+			bool operator<(const Key& other) const;
+		};
+
+		std::map<Key, MeshData*>	m_meshes;
+
+		MeshCache(const MeshCache&);
+		MeshCache& operator=(const MeshCache&);
+	};
+}
+
+#endif // __legoMeshH__
@@ -0,0 +1,245 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoPhysics.cpp
+//
+// Desc: Ball / wall collision rules, moved out of virtualLego.cpp so that
+//       they can be built without the DirectX SDK.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoPhysics.h"
+#include <cmath>
+
+bool lego::spheresIntersect(float dx, float dy, float dz)
+{
+	return dx * dx + dy * dy + dz * dz <= touchDistance * touchDistance;
+}
+
+void lego::bounceOffBrick(Sphere& ball, float brickVX, float brickVZ)
+{
+	float vXAfterCollision = (ball.getVelocity_X() + brickVX) * ball.getVelocity_X() / ball.getVelocity_Z();
+	float vZAfterCollision = ball.getVelocity_Z() + brickVZ;
+	ball.setPower(-vXAfterCollision, -vZAfterCollision);
+}
+
+bool lego::bounceBalls(Sphere& a, Sphere& b)
+{
+	if (!a.hasIntersected(b))
+		return false;
+	Vector3 ca = a.getCenter(), cb = b.getCenter();
+	float dx = cb.x - ca.x, dz = cb.z - ca.z;
+	float dvx = b.getVelocity_X() - a.getVelocity_X();
+	float dvz = b.getVelocity_Z() - a.getVelocity_Z();
+	float approach = dx * dvx + dz * dvz;
+	float distance = dx * dx + dz * dz;
+	if (approach >= 0.0f || distance == 0.0f)
+		return false;
+
+	float k = approach / distance;
+	a.setPower(a.getVelocity_X() + k * dx, a.getVelocity_Z() + k * dz);
+	b.setPower(b.getVelocity_X() - k * dx, b.getVelocity_Z() - k * dz);
+	return true;
+}
+
+float lego::sweepSphere(float x, float z, float dx, float dz, float cx, float cz, float reach)
+{
+	const float noImpact = 2.0f;
+	float r = reach - contactSlop;
+	float rx = x - cx;
+	float rz = z - cz;
+
+	// |(rx, rz) + t (dx, dz)| = r
+	float a = dx * dx + dz * dz;
+	float b = 2 * (rx * dx + rz * dz);
+	float c = rx * rx + rz * rz - r * r;
+	if (a == 0.0f || c <= 0.0f || b >= 0.0f)
+		return noImpact;
+	float disc = b * b - 4 * a * c;
+	if (disc < 0.0f)
+		return noImpact;
+	float t = (-b - sqrtf(disc)) / (2 * a);
+	return t >= 0.0f ? t : noImpact;
+}
+
+// -----------------------------------------------------------------------------
+// Sphere
+// -----------------------------------------------------------------------------
+
+lego::Sphere::Sphere(void)
+{
+	center_x = center_y = center_z = 0.0f;
+	m_radius = ballRadius;
+	m_velocity_x = 0;
+	m_velocity_z = 0;
+	m_awake = false;
+	m_type = SPHERE_BRICK;
+}
+
+bool lego::Sphere::hasIntersected(const Sphere& ball) const
+{
+	return spheresIntersect(center_x - ball.center_x, center_y - ball.center_y, center_z - ball.center_z);
+}
+
+bool lego::Sphere::hitBy(Sphere& ball)
+{
+	if (!hasIntersected(ball))
+		return false;
+	wake();
+	ball.wake();
+
+	// if one of the balls intersected is yellow, then destroy that and save the other ball.
+	if (m_type == SPHERE_BRICK) {
+		bounceOffBrick(ball, m_velocity_x, m_velocity_z);
+		this->setCenter(center_x, -500.0f, center_z);
+		return true;
+	}
+	else if (ball.m_type == SPHERE_BRICK) {
+		bounceOffBrick(*this, ball.m_velocity_x, ball.m_velocity_z);
+		ball.setCenter(center_x, -500.0f, center_z);
+		return true;
+	}
+	// else, it is collision of grey and red balls.
+	else if (ball.m_type == SPHERE_RED) {
+		ball.setPower(ball.m_velocity_x, -1 * ball.m_velocity_z);
+	}
+	return false;
+}
+
+void lego::Sphere::ballUpdate(float timeDiff)
+{
+	if (!m_awake)
+		return;
+
+	const float TIME_SCALE = ballTimeScale;
+	Vector3 cord = this->getCenter();
+	float vx = fabsf(this->getVelocity_X());
+	float vz = fabsf(this->getVelocity_Z());
+
+	if (vx > sleepSpeed || vz > sleepSpeed)
+	{
+		float tX = cord.x + TIME_SCALE*timeDiff*m_velocity_x;
+		float tZ = cord.z + TIME_SCALE*timeDiff*m_velocity_z;
+
+		// correction of position of ball, necessary when a ball collides with a wall
+		if (tX >= ballLimitX)
+			tX = ballLimitX;
+		else if (tX <= -ballLimitX)
+			tX = -ballLimitX;
+		else if (tZ <= -ballLimitZ)
+			tZ = -ballLimitZ;
+		else if (tZ >= ballLimitZ)
+			tZ = ballLimitZ;
+
+		this->setCenter(tX, cord.y, tZ);
+	}
+	else { this->setPower(0, 0); }	// falls asleep
+}
+
+void lego::Sphere::setPower(float vx, float vz)
+{
+	m_velocity_x = vx;
+	m_velocity_z = vz;
+	m_awake = m_velocity_x != 0.0f || m_velocity_z != 0.0f;
+}
+
+void lego::Sphere::setCenter(float x, float y, float z)
+{
+	center_x = x;	center_y = y;	center_z = z;
+}
+
+// -----------------------------------------------------------------------------
+// Wall
+// -----------------------------------------------------------------------------
+
+lego::Wall::Wall(void)
+{
+	m_x = 0;
+	m_z = 0;
+	m_width = 0;
+	m_depth = 0;
+}
+
+void lego::Wall::create(float iwidth, float idepth)
+{
+	m_width = iwidth;
+	m_depth = idepth;
+}
+
+bool lego::Wall::hasIntersected(float x, float z) const
+{
+	if (isWide()) {
+		float distance = fabsf(z - m_z);
+		return distance <= (float)(M_RADIUS + m_depth / 2);
+	}
+	else if (isTall()) {
+		float distance = fabsf(x - m_x);
+		return distance <= (float)(M_RADIUS + m_width / 2);
+	}
+	return false;
+}
+
+bool lego::Wall::hasIntersected(const Sphere& ball) const
+{
+	Vector3 ballCenter = ball.getCenter();
+	return hasIntersected(ballCenter.x, ballCenter.z);
+}
+
+void lego::Wall::hitBy(Sphere& ball)
+{
+	Vector3 ballCenter = ball.getCenter();
+	float vx = (float)ball.getVelocity_X();
+	float vz = (float)ball.getVelocity_Z();
+	if (hitBy(ballCenter.x, ballCenter.z, vx, vz)) {
+		ball.setPower(vx, vz);
+		ball.setCenter(ballCenter.x, ballCenter.y, ballCenter.z);
+	}
+}
+
+bool lego::Wall::hitBy(float& x, float& z, float& vx, float& vz) const
+{
+	if (!hasIntersected(x, z))
+		return false;
+
+	// reflect the ball.
+	if (isWide()) {
+		float zBound = (float)(m_z - wallThickness);
+		vz = -1 * vz;
+		z = (float)(zBound - M_RADIUS - 0.05);
+	}
+	else if (isTall()) {
+		x = (float)(m_x > 0 ? m_x - wallThickness / 2 - M_RADIUS - 0.05 : m_x + wallThickness / 2 + M_RADIUS + 0.05);
+		vx = -1 * vx;
+	}
+	return true;
+}
+
+float lego::Wall::sweep(float x, float z, float dx, float dz) const
+{
+	const float noImpact = 2.0f;
+	if (hasIntersected(x, z))
+		return noImpact;
+
+	// distance to the wall along its normal, the move along it, and the
+	// distance at which the ball touches
+	float gap, move, touch;
+	if (isWide()) {
+		gap = z - m_z;
+		move = dz;
+		touch = (float)(M_RADIUS + m_depth / 2) - contactSlop;
+	}
+	else if (isTall()) {
+		gap = x - m_x;
+		move = dx;
+		touch = (float)(M_RADIUS + m_width / 2) - contactSlop;
+	}
+	else {
+		return noImpact;
+	}
+
+	// only a move towards the wall can hit it
+	if (move == 0.0f || (gap > 0.0f) == (move > 0.0f))
+		return noImpact;
+	if (gap < 0.0f)
+		touch = -touch;
+	return (touch - gap) / move;
+}
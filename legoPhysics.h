@@ -0,0 +1,158 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoPhysics.h
+//
+// Desc: Platform independent ball / wall rules of Virtual Lego.
+//       Nothing in here depends on Direct3D, so the same rules can be
+//       stepped by the D3D client and by the headless Linux build.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoPhysicsH__
+#define __legoPhysicsH__
+
+#include "legoMath.h"
+
+#define M_RADIUS 0.21   // ball radius
+#define PI 3.14159265
+#define M_HEIGHT 0.01
+#define DECREASE_RATE 0.9982
+
+#define KEYSTEP 0.1
+#define REDBALLSPEED 30.0
+
+namespace lego
+{
+	// global constants
+	constexpr float ballRadius = (float)M_RADIUS;
+	constexpr float initialGreyBallPosZ = -4.0f + ballRadius + 0.05f;
+	constexpr float initialRedBallPosZ = initialGreyBallPosZ + ballRadius * 2 + 0.05f;
+	constexpr float horizontalBarWidth = 6.0f;
+	constexpr float verticalBarDepth = 9.0f;
+	constexpr float wallThickness = 0.12f;
+
+	// how far a ball center gets from the middle of the table, the inner
+	// faces of the walls less a radius
+	constexpr float ballLimitX = horizontalBarWidth / 2 - wallThickness / 2 - ballRadius;
+	constexpr float ballLimitZ = verticalBarDepth / 2 - wallThickness / 2 - ballRadius;
+
+	// centers of two balls closer than this touch
+	constexpr float touchDistance = 2 * ballRadius;
+
+	// a ball moves ballTimeScale * timeDelta * velocity per update
+	constexpr float ballTimeScale = 3.3f;
+
+	// a ball slower than this on both axes stops and falls asleep
+	constexpr float sleepSpeed = 0.01f;
+
+	// contacts are reported this much before the exact touching distance,
+	// so the overlap tests that follow a swept test always see the contact
+	constexpr float contactSlop = 0.0001f;
+
+	// what a sphere is decides how it reacts to a collision
+	enum SphereType
+	{
+		SPHERE_BRICK,	// yellow lego block, destroyed when hit
+		SPHERE_RED,		// the moving ball
+		SPHERE_GREY		// the paddle ball controlled by the player
+	};
+
+	class Sphere;
+
+	// true when two balls whose centers are (dx, dy, dz) apart touch
+	bool spheresIntersect(float dx, float dy, float dz);
+
+	// a brick moving with (brickVX, brickVZ) was hit by ball: send the ball back
+	void bounceOffBrick(Sphere& ball, float brickVX, float brickVZ);
+
+	// two red balls that touch bounce off each other like equal masses: the
+	// parts of their velocities along the line through the centers are
+	// swapped, unless they already move apart. true if they bounced.
+	bool bounceBalls(Sphere& a, Sphere& b);
+
+	// fraction of the move (dx, dz) after which a ball at (x, z) comes within
+	// reach of (cx, cz). 1 or more if it doesn't, or if it already is.
+	float sweepSphere(float x, float z, float dx, float dz, float cx, float cz, float reach);
+
+	// -------------------------------------------------------------------------
+	// Sphere class definition
+	// -------------------------------------------------------------------------
+
+	class Sphere {
+	public:
+		Sphere(void);
+
+		bool hasIntersected(const Sphere& ball) const;
+
+		// returns true when a brick was destroyed by this collision
+		bool hitBy(Sphere& ball);
+		// does nothing to a sleeping ball
+		void ballUpdate(float timeDiff);
+
+		// a sleeping ball is at rest and is skipped by integration and
+		// collision tests. setting a velocity (an impulse) or a contact
+		// wakes it; ballUpdate puts it back to sleep below sleepSpeed.
+		bool isAwake(void) const { return m_awake; }
+		void wake(void) { m_awake = true; }
+
+		float getVelocity_X(void) const { return m_velocity_x; }
+		void setVelocity_X(float velocity_x) { setPower(velocity_x, m_velocity_z); }
+		float getVelocity_Z(void) const { return m_velocity_z; }
+		void setVelocity_Z(float velocity_z) { setPower(m_velocity_x, velocity_z); }
+		void setPower(float vx, float vz);
+
+		void setCenter(float x, float y, float z);
+		Vector3 getCenter(void) const { return Vector3(center_x, center_y, center_z); }
+		float getRadius(void) const { return m_radius; }
+
+		SphereType getType(void) const { return m_type; }
+		void setType(SphereType type) { m_type = type; }
+
+	private:
+		float		center_x, center_y, center_z;
+		float		m_radius;
+		float		m_velocity_x;
+		float		m_velocity_z;
+		bool		m_awake;
+		SphereType	m_type;
+	};
+
+	// -------------------------------------------------------------------------
+	// Wall class definition
+	// -------------------------------------------------------------------------
+
+	class Wall {
+	public:
+		Wall(void);
+
+		void create(float iwidth, float idepth);
+		bool hasIntersected(float x, float z) const;
+		bool hasIntersected(const Sphere& ball) const;
+		void hitBy(Sphere& ball);
+
+		// pushes a ball at (x, z) out of the wall and reflects its velocity.
+		// returns true if the ball touched the wall.
+		bool hitBy(float& x, float& z, float& vx, float& vz) const;
+
+		// fraction of the move (dx, dz) after which a ball at (x, z) touches
+		// the wall. 1 or more if it doesn't, or if it already does.
+		float sweep(float x, float z, float dx, float dz) const;
+
+		void setPosition(float x, float z) { m_x = x; m_z = z; }
+		float getPositionX(void) const { return m_x; }
+		float getPositionZ(void) const { return m_z; }
+		float getWidth(void) const { return m_width; }
+		float getDepth(void) const { return m_depth; }
+
+	private:
+		float	m_x;
+		float	m_z;
+		float	m_width;
+		float	m_depth;
+
+		bool isWide(void) const { return m_width > m_depth; }
+		bool isTall(void) const { return m_depth > m_width; }
+	};
+}
+
+#endif // __legoPhysicsH__
@@ -0,0 +1,252 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoProfile.cpp
+//
+// Desc: Scoped frame profiler, per-thread rings and Chrome trace export.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoProfile.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+// zones of one thread. only that thread writes m_head and the zones behind
+// it, only the collecting thread writes m_tail, so neither needs a lock.
+struct ProfileRing
+{
+	lego::ProfileZone		zones[lego::profileRingSize];
+	std::atomic<unsigned>	head;
+	std::atomic<unsigned>	tail;
+	int						thread;
+	int						depth;		// owner thread only
+};
+
+// every ring ever made. a ring lives as long as the program, so collect()
+// still gets the last zones of a thread that has quit.
+struct ProfileRegistry
+{
+	std::mutex									lock;
+	std::vector<std::unique_ptr<ProfileRing> >	rings;
+};
+
+static std::atomic<bool> s_enabled(false);
+static std::atomic<long> s_dropped(0);
+static thread_local ProfileRing* t_ring = 0;
+
+static ProfileRegistry& getRegistry(void)
+{
+	static ProfileRegistry registry;
+	return registry;
+}
+
+static std::chrono::steady_clock::time_point getEpoch(void)
+{
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return epoch;
+}
+
+// the ring of the calling thread, registered on first use
+static ProfileRing* getRing(void)
+{
+	if (t_ring == 0) {
+		std::unique_ptr<ProfileRing> ring(new ProfileRing);
+		ring->head.store(0, std::memory_order_relaxed);
+		ring->tail.store(0, std::memory_order_relaxed);
+		ring->depth = 0;
+
+		ProfileRegistry& registry = getRegistry();
+		std::lock_guard<std::mutex> hold(registry.lock);
+		ring->thread = (int)registry.rings.size();
+		t_ring = ring.get();
+		registry.rings.push_back(std::move(ring));
+	}
+	return t_ring;
+}
+
+// -----------------------------------------------------------------------------
+// Profiler
+// -----------------------------------------------------------------------------
+
+void lego::Profiler::setEnabled(bool enable)
+{
+	getEpoch();
+	s_enabled.store(enable, std::memory_order_relaxed);
+}
+
+bool lego::Profiler::isEnabled(void)
+{
+	return s_enabled.load(std::memory_order_relaxed);
+}
+
+long long lego::Profiler::now(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - getEpoch()).count();
+}
+
+int lego::Profiler::enter(void)
+{
+	if (!s_enabled.load(std::memory_order_relaxed))
+		return -1;
+	return getRing()->depth++;
+}
+
+void lego::Profiler::leave(const char* name, long long begin, int depth)
+{
+	long long end = now();
+	ProfileRing* ring = getRing();
+	ring->depth = depth;
+
+	unsigned head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= (unsigned)profileRingSize) {
+		s_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ProfileZone& zone = ring->zones[head % profileRingSize];
+	zone.name = name;
+	zone.begin = begin;
+	zone.end = end;
+	zone.thread = ring->thread;
+	zone.depth = depth;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void lego::Profiler::collect(std::vector<ProfileZone>& zones)
+{
+	ProfileRegistry& registry = getRegistry();
+	std::lock_guard<std::mutex> hold(registry.lock);
+	for (size_t i = 0; i < registry.rings.size(); i++) {
+		ProfileRing& ring = *registry.rings[i];
+		unsigned tail = ring.tail.load(std::memory_order_relaxed);
+		unsigned head = ring.head.load(std::memory_order_acquire);
+		for (; tail != head; tail++)
+			zones.push_back(ring.zones[tail % profileRingSize]);
+		ring.tail.store(tail, std::memory_order_release);
+	}
+}
+
+long lego::Profiler::getDropped(void)
+{
+	return s_dropped.load(std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+// ProfileSummary
+// -----------------------------------------------------------------------------
+
+// weight of the newest frame in the rolling averages, about the last 20 frames
+static const double summarySmoothing = 0.05;
+
+lego::ProfileSummary::ProfileSummary(void)
+{
+	m_frameMs = 0.0;
+	m_lastFrameEnd = -1;
+}
+
+void lego::ProfileSummary::addFrame(const std::vector<ProfileZone>& zones)
+{
+	const size_t known = m_entries.size();
+	std::vector<double> frame(known, 0.0);
+	for (size_t i = 0; i < known; i++)
+		m_entries[i].calls = 0;
+
+	for (size_t i = 0; i < zones.size(); i++) {
+		size_t e = 0;
+		while (e < m_entries.size() && m_entries[e].name != zones[i].name && strcmp(m_entries[e].name, zones[i].name) != 0)
+			e++;
+		if (e == m_entries.size()) {
+			Entry entry = { zones[i].name, 0.0, 0 };
+			m_entries.push_back(entry);
+			frame.push_back(0.0);
+		}
+		frame[e] += (zones[i].end - zones[i].begin) / 1e6;
+		m_entries[e].calls++;
+	}
+
+	// zones seen for the first time start at their value instead of ramping up
+	for (size_t i = 0; i < m_entries.size(); i++) {
+		if (i < known)
+			m_entries[i].milliseconds += (frame[i] - m_entries[i].milliseconds) * summarySmoothing;
+		else
+			m_entries[i].milliseconds = frame[i];
+	}
+
+	long long end = Profiler::now();
+	if (m_lastFrameEnd >= 0) {
+		double ms = (end - m_lastFrameEnd) / 1e6;
+		m_frameMs = m_frameMs > 0.0 ? m_frameMs + (ms - m_frameMs) * summarySmoothing : ms;
+	}
+	m_lastFrameEnd = end;
+}
+
+static bool slowerEntry(const lego::ProfileSummary::Entry& a, const lego::ProfileSummary::Entry& b)
+{
+	return a.milliseconds > b.milliseconds;
+}
+
+std::string lego::ProfileSummary::format(void) const
+{
+	std::vector<Entry> entries(m_entries);
+	std::stable_sort(entries.begin(), entries.end(), slowerEntry);
+
+	std::string text;
+	char line[128];
+	snprintf(line, sizeof(line), "frame  %.2f ms\n", m_frameMs);
+	text += line;
+	for (size_t i = 0; i < entries.size(); i++) {
+		snprintf(line, sizeof(line), "%s  %.2f ms\n", entries[i].name, entries[i].milliseconds);
+		text += line;
+	}
+	return text;
+}
+
+// -----------------------------------------------------------------------------
+// Chrome trace
+// -----------------------------------------------------------------------------
+
+static void writeJsonString(FILE* out, const char* text)
+{
+	fputc('"', out);
+	for (; *text != '\0'; text++) {
+		unsigned char c = (unsigned char)*text;
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+bool lego::writeChromeTrace(const char* path, const std::vector<ProfileZone>& zones)
+{
+	FILE* out = fopen(path, "w");
+	if (out == NULL)
+		return false;
+
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	int threads = 0;
+	for (size_t i = 0; i < zones.size(); i++)
+		threads = std::max(threads, zones[i].thread + 1);
+	for (int t = 0; t < threads; t++)
+		fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n", t, t);
+
+	for (size_t i = 0; i < zones.size(); i++) {
+		const ProfileZone& zone = zones[i];
+		fprintf(out, "{\"name\":");
+		writeJsonString(out, zone.name);
+		fprintf(out, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d},\n",
+			zone.begin / 1e3, (zone.end - zone.begin) / 1e3, zone.thread);
+	}
+	// the format doesn't allow a trailing comma
+	fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"Virtual Lego\"}}\n]}\n");
+
+	bool ok = !ferror(out);
+	ok = fclose(out) == 0 && ok;
+	return ok;
+}
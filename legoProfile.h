@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoProfile.h
+//
+// Desc: Scoped frame profiler. LEGO_PROFILE_SCOPE("name") times the rest of
+//       the enclosing block. Every thread writes its zones into a ring
+//       buffer of its own, without locks; the main thread collects them
+//       once a frame, keeps a rolling per-zone breakdown to show on screen
+//       and, while tracing, a copy to export as Chrome trace JSON (open it
+//       in chrome://tracing or ui.perfetto.dev).
+//
+//       Zones are compiled in for debug builds and for any build defining
+//       LEGO_PROFILE (the CMake option of the same name, on by default),
+//       and compile to nothing otherwise. Compiled in, they cost a relaxed
+//       atomic load until the profiler is enabled at run time.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoProfileH__
+#define __legoProfileH__
+
+#include <string>
+#include <vector>
+
+#if !defined(NDEBUG) || defined(LEGO_PROFILE)
+#define LEGO_PROFILE_ENABLED 1
+#else
+#define LEGO_PROFILE_ENABLED 0
+#endif
+
+namespace lego
+{
+	// one timed zone. name must be a string literal, or live as long.
+	struct ProfileZone
+	{
+		const char*	name;
+		long long	begin, end;		// ns since the profiler started
+		int			thread;			// in order of first use, the main thread is usually 0
+		int			depth;			// zones open around it on the same thread
+	};
+
+	// events kept per thread between two collect() calls; more are dropped
+	const int profileRingSize = 8192;
+
+	class Profiler {
+	public:
+		// false when the zones are compiled out
+		static bool isCompiledIn(void) { return LEGO_PROFILE_ENABLED != 0; }
+
+		static void setEnabled(bool enable);
+		static bool isEnabled(void);
+
+		static long long now(void);
+		// called by ProfileScope
+		static int enter(void);
+		static void leave(const char* name, long long begin, int depth);
+
+		// moves the zones every thread finished since the last call into
+		// zones, oldest first per thread. call from one thread only.
+		static void collect(std::vector<ProfileZone>& zones);
+		// zones lost to full rings so far
+		static long getDropped(void);
+	};
+
+	// time of every zone name per frame, smoothed over the last frames
+	class ProfileSummary {
+	public:
+		ProfileSummary(void);
+
+		// adds the zones of one frame
+		void addFrame(const std::vector<ProfileZone>& zones);
+
+		struct Entry
+		{
+			const char*	name;
+			double		milliseconds;	// per frame, rolling average
+			int			calls;			// in the last frame
+		};
+		const std::vector<Entry>& getEntries(void) const { return m_entries; }
+		double getFrameMilliseconds(void) const { return m_frameMs; }
+
+		// one "name  0.00 ms" line per zone, slowest first
+		std::string format(void) const;
+
+	private:
+		std::vector<Entry>	m_entries;
+		double				m_frameMs;
+		long long			m_lastFrameEnd;
+	};
+
+	// Chrome trace event format, complete ("X") events in microseconds
+	bool writeChromeTrace(const char* path, const std::vector<ProfileZone>& zones);
+
+	class ProfileScope {
+	public:
+		explicit ProfileScope(const char* name)
+			: m_name(name)
+		{
+			m_depth = Profiler::enter();
+			m_begin = m_depth >= 0 ? Profiler::now() : 0;
+		}
+		~ProfileScope(void)
+		{
+			if (m_depth >= 0)
+				Profiler::leave(m_name, m_begin, m_depth);
+		}
+
+	private:
+		const char*	m_name;
+		long long	m_begin;
+		int			m_depth;	// -1 while the profiler is off
+
+		ProfileScope(const ProfileScope&);
+		ProfileScope& operator=(const ProfileScope&);
+	};
+}
+
+#define LEGO_PROFILE_CONCAT2(a, b) a##b
+#define LEGO_PROFILE_CONCAT(a, b) LEGO_PROFILE_CONCAT2(a, b)
+
+#if LEGO_PROFILE_ENABLED
+#define LEGO_PROFILE_SCOPE(name) lego::ProfileScope LEGO_PROFILE_CONCAT(legoProfileScope, __LINE__)(name)
+#else
+#define LEGO_PROFILE_SCOPE(name) ((void)0)
+#endif
+
+#endif // __legoProfileH__
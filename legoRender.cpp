@@ -0,0 +1,209 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoRender.cpp
+//
+// Desc: Renderer independent description of a frame.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoRender.h"
+#include <cmath>
+
+int lego::selectSphereLod(float radius, float x, float y, float z, int viewportHeight)
+{
+	constexpr Vector3 forward = sceneCameraTarget - sceneCameraPosition;
+	float depth = dot(Vector3(x, y, z) - sceneCameraPosition, forward) / std::sqrt(lengthSquared(forward));
+	int i;
+
+	if (depth < sceneNearPlane)
+		return 0;
+
+	// projected radius, 1 / tan(fov / 2) being the vertical scale of the projection
+	float pixels = radius / std::tan(sceneFieldOfView / 2) * (viewportHeight / 2) / depth;
+	for (i = 0; i < meshLodCount - 1; i++) {
+		if (pixels >= sphereLodRadius[i])
+			break;
+	}
+	return i;
+}
+
+lego::MeshShape lego::getMeshShape(RenderMesh mesh, int lod)
+{
+	MeshShape shape;
+	shape.sphere = false;
+	shape.radius = 0.0f;
+	shape.slices = shape.stacks = 0;
+	shape.width = shape.height = shape.depth = 0.0f;
+
+	switch (mesh) {
+	case MESH_BALL:
+		shape.sphere = true;
+		shape.radius = (float)M_RADIUS;
+		shape.slices = shape.stacks = sphereLodDetail[lod];
+		break;
+	case MESH_PLANE:
+		shape.width = horizontalBarWidth;	shape.height = 0.03f;	shape.depth = verticalBarDepth;
+		break;
+	case MESH_LINE:
+		shape.width = horizontalBarWidth;	shape.height = 0.1f;	shape.depth = 0.1f;
+		break;
+	case MESH_WALL_ACROSS:
+		shape.width = horizontalBarWidth;	shape.height = 0.3f;	shape.depth = wallThickness;
+		break;
+	case MESH_WALL_ALONG:
+		shape.width = wallThickness;	shape.height = 0.3f;	shape.depth = verticalBarDepth;
+		break;
+	default:
+		break;
+	}
+	return shape;
+}
+
+lego::MaterialDesc lego::getMaterial(RenderMaterial material)
+{
+	static const MaterialDesc materials[MATERIAL_COUNT] = {
+		{ 0x0000ff00, 5.0f },	// MATERIAL_PLANE, green
+		{ 0x00d70000, 5.0f },	// MATERIAL_WALL, dark red
+		{ 0x00ffff00, 5.0f },	// MATERIAL_BRICK, yellow
+		{ 0x00ff0000, 5.0f },	// MATERIAL_RED
+		{ 0x00d1d1d1, 5.0f },	// MATERIAL_GREY
+		{ 0x000000ff, 5.0f },	// MATERIAL_LINE, blue
+	};
+	return materials[material];
+}
+
+void lego::CommandBuffer::clear(void)
+{
+	m_commands.clear();
+	m_instances.clear();
+	m_batches.clear();
+}
+
+void lego::CommandBuffer::draw(RenderMesh mesh, RenderMaterial material, float x, float y, float z, int lod)
+{
+	Command c;
+	c.key = (mesh * meshLodCount + lod) * MATERIAL_COUNT + material;
+	c.x = x;	c.y = y;	c.z = z;
+	m_commands.push_back(c);
+}
+
+void lego::CommandBuffer::sort(void)
+{
+	// few distinct keys: a counting sort is linear and stable
+	const int keys = MESH_COUNT * meshLodCount * MATERIAL_COUNT;
+	int start[MESH_COUNT * meshLodCount * MATERIAL_COUNT + 1] = { 0 };
+	int i;
+
+	for (i = 0; i < (int)m_commands.size(); i++)
+		start[m_commands[i].key + 1]++;
+	for (int k = 0; k < keys; k++)
+		start[k + 1] += start[k];
+
+	m_batches.clear();
+	for (int k = 0; k < keys; k++) {
+		if (start[k + 1] == start[k])
+			continue;
+		DrawBatch batch;
+		batch.mesh = (RenderMesh)(k / MATERIAL_COUNT / meshLodCount);
+		batch.lod = k / MATERIAL_COUNT % meshLodCount;
+		batch.material = (RenderMaterial)(k % MATERIAL_COUNT);
+		batch.firstInstance = start[k];
+		batch.instanceCount = start[k + 1] - start[k];
+		m_batches.push_back(batch);
+	}
+
+	m_instances.resize(m_commands.size() * 3);
+	for (i = 0; i < (int)m_commands.size(); i++) {
+		const Command& c = m_commands[i];
+		float* p = &m_instances[start[c.key]++ * 3];
+		p[0] = c.x;	p[1] = c.y;	p[2] = c.z;
+	}
+}
+
+void lego::submitCommands(const CommandBuffer& commands, RenderBackend& backend)
+{
+	int mesh = -1, lod = -1, material = -1;
+	for (int i = 0; i < commands.getBatchCount(); i++) {
+		const DrawBatch& batch = commands.getBatch(i);
+		if (batch.mesh != mesh || batch.lod != lod) {
+			mesh = batch.mesh;
+			lod = batch.lod;
+			backend.setMesh(batch.mesh, batch.lod);
+		}
+		if (batch.material != material) {
+			material = batch.material;
+			backend.setMaterial(batch.material);
+		}
+		backend.drawInstances(commands.getInstancePositions(batch.firstInstance), batch.instanceCount);
+	}
+}
+
+static const float planeY = -0.0006f / 5;
+
+// the plane and the walls, which start every scene
+static void recordTable(const lego::Wall* walls, lego::CommandBuffer& commands)
+{
+	using namespace lego;
+	commands.clear();
+	commands.draw(MESH_PLANE, MATERIAL_PLANE, 0.0f, planeY, 0.0f);
+	for (int i = 0; i < totalWalls; i++) {
+		RenderMesh mesh = walls[i].getWidth() > walls[i].getDepth() ? MESH_WALL_ACROSS : MESH_WALL_ALONG;
+		commands.draw(mesh, MATERIAL_WALL, walls[i].getPositionX(), wallThickness, walls[i].getPositionZ());
+	}
+}
+
+static void recordSphere(lego::RenderMaterial material, const lego::Vector3& c, int viewportHeight, lego::CommandBuffer& commands)
+{
+	commands.draw(lego::MESH_BALL, material, c.x, c.y, c.z,
+		lego::selectSphereLod((float)M_RADIUS, c.x, c.y, c.z, viewportHeight));
+}
+
+void lego::recordScene(const Game& game, const Vector3& red, const Vector3& grey, int viewportHeight, CommandBuffer& commands)
+{
+	int i;
+	Wall walls[totalWalls];
+	for (i = 0; i < totalWalls; i++)
+		walls[i] = game.getWall(i);
+	recordTable(walls, commands);
+
+	const BallArray& bricks = game.getBricks();
+	const int* active = bricks.getActiveBalls();
+	for (i = 0; i < bricks.getActiveCount(); i++)
+		recordSphere(MATERIAL_BRICK, bricks.getCenter(active[i]), viewportHeight, commands);
+
+	recordSphere(MATERIAL_RED, red, viewportHeight, commands);
+	recordSphere(MATERIAL_GREY, grey, viewportHeight, commands);
+	for (i = 0; i < game.getExtraBallCount(); i++)
+		recordSphere(MATERIAL_RED, game.getExtraBall(i).getCenter(), viewportHeight, commands);
+	commands.draw(MESH_LINE, MATERIAL_LINE, 0.0f, planeY, initialGreyBallPosZ);
+}
+
+void lego::recordScene(const Game& game, int viewportHeight, CommandBuffer& commands)
+{
+	recordScene(game, game.getRedBall().getCenter(), game.getGreyBall().getCenter(), viewportHeight, commands);
+}
+
+void lego::recordScene(const RenderState& state, const Vector3& red, const Vector3& grey, int viewportHeight, CommandBuffer& commands)
+{
+	size_t i;
+	Wall walls[totalWalls];
+	makeWalls(walls);
+	recordTable(walls, commands);
+
+	if (state.level) {
+		const BallArray& bricks = state.level->bricks;
+		std::vector<unsigned char> gone(bricks.size(), 0);
+		for (i = 0; i < state.destroyed.size(); i++)
+			gone[state.destroyed[i]] = 1;
+		for (int b = 0; b < bricks.size(); b++) {
+			if (!gone[b])
+				recordSphere(MATERIAL_BRICK, bricks.getCenter(b), viewportHeight, commands);
+		}
+	}
+
+	recordSphere(MATERIAL_RED, red, viewportHeight, commands);
+	recordSphere(MATERIAL_GREY, grey, viewportHeight, commands);
+	for (i = 0; i < state.extraCenters.size(); i++)
+		recordSphere(MATERIAL_RED, state.extraCenters[i], viewportHeight, commands);
+	commands.draw(MESH_LINE, MATERIAL_LINE, 0.0f, planeY, initialGreyBallPosZ);
+}
@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoRender.h
+//
+// Desc: Renderer independent description of a frame. The scene is recorded
+//       as draw commands (mesh, material, position), sorted so each mesh
+//       and material is set once, and objects sharing both, like all the
+//       bricks, are collapsed into one instanced draw. A backend only has
+//       to implement the three calls of RenderBackend; NullBackend just
+//       counts them, so draw calls and state changes can be checked
+//       without a display.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoRenderH__
+#define __legoRenderH__
+
+#include "legoGame.h"
+#include "legoMesh.h"
+#include <vector>
+
+namespace lego
+{
+	// camera and light of the scene, see Matrix4::lookAtLH and
+	// Matrix4::perspectiveFovLH
+	constexpr Vector3 sceneCameraPosition(0.0f, 10.0f, -9.0f);
+	constexpr Vector3 sceneCameraTarget(0.0f, 0.0f, 0.0f);
+	constexpr Vector3 sceneCameraUp(0.0f, 2.0f, 0.0f);
+	constexpr float sceneFieldOfView = (float)PI / 4;
+	constexpr float sceneNearPlane = 1.0f;
+	constexpr float sceneFarPlane = 100.0f;
+	constexpr float sceneLightHeight = 3.0f;	// the point light hangs over the center
+
+	// view * projection of the scene camera for a viewport of that shape
+	inline Matrix4 getSceneViewProjection(float aspect)
+	{
+		return Matrix4::lookAtLH(sceneCameraPosition, sceneCameraTarget, sceneCameraUp) *
+			Matrix4::perspectiveFovLH(sceneFieldOfView, aspect, sceneNearPlane, sceneFarPlane);
+	}
+
+	// spheres come in meshLodCount levels of detail, from sphereLodDetail[0]
+	// slices for a sphere covering sphereLodRadius[0] pixels or more down to
+	// the last level for the smallest ones. other meshes have one level.
+	const int meshLodCount = 4;
+	const int sphereLodDetail[meshLodCount] = { 50, 24, 12, 6 };
+	const float sphereLodRadius[meshLodCount] = { 32.0f, 12.0f, 5.0f, 0.0f };
+
+	// level of detail of a sphere of radius at (x, y, z), from its radius on
+	// a screen viewportHeight pixels high
+	int selectSphereLod(float radius, float x, float y, float z, int viewportHeight);
+
+	enum RenderMesh
+	{
+		MESH_BALL,			// bricks, red and grey ball
+		MESH_PLANE,
+		MESH_LINE,			// blue line the grey ball moves on
+		MESH_WALL_ACROSS,	// wall at the far end
+		MESH_WALL_ALONG,	// walls on the sides
+		MESH_COUNT
+	};
+
+	enum RenderMaterial
+	{
+		MATERIAL_PLANE,
+		MATERIAL_WALL,
+		MATERIAL_BRICK,
+		MATERIAL_RED,
+		MATERIAL_GREY,
+		MATERIAL_LINE,
+		MATERIAL_COUNT
+	};
+
+	MeshShape getMeshShape(RenderMesh mesh, int lod);
+
+	// ambient, diffuse and specular all take color (0x00RRGGBB)
+	struct MaterialDesc
+	{
+		unsigned int	color;
+		float			power;
+	};
+	MaterialDesc getMaterial(RenderMaterial material);
+
+	// instanceCount copies of one mesh in one material
+	struct DrawBatch
+	{
+		RenderMesh		mesh;
+		int				lod;
+		RenderMaterial	material;
+		int				firstInstance;
+		int				instanceCount;
+	};
+
+	class CommandBuffer {
+	public:
+		void clear(void);
+		void draw(RenderMesh mesh, RenderMaterial material, float x, float y, float z, int lod = 0);
+
+		// groups the commands by mesh and lod, then material, keeping the recorded
+		// order within a group, and builds the batches
+		void sort(void);
+
+		int getCommandCount(void) const { return (int)m_commands.size(); }
+		int getBatchCount(void) const { return (int)m_batches.size(); }
+		const DrawBatch& getBatch(int i) const { return m_batches[i]; }
+		// x, y, z of every instance, batch after batch
+		const float* getInstancePositions(int first) const { return &m_instances[first * 3]; }
+
+	private:
+		struct Command
+		{
+			int		key;	// (mesh * meshLodCount + lod) * MATERIAL_COUNT + material
+			float	x, y, z;
+		};
+
+		std::vector<Command>	m_commands;
+		std::vector<float>		m_instances;
+		std::vector<DrawBatch>	m_batches;
+	};
+
+	class RenderBackend {
+	public:
+		virtual ~RenderBackend(void) {}
+
+		virtual void setMesh(RenderMesh mesh, int lod) = 0;
+		virtual void setMaterial(RenderMaterial material) = 0;
+		// count copies of the current mesh, at x, y, z triples
+		virtual void drawInstances(const float* positions, int count) = 0;
+	};
+
+	// plays the batches of a sorted buffer, setting only what changes
+	void submitCommands(const CommandBuffer& commands, RenderBackend& backend);
+
+	class NullBackend : public RenderBackend {
+	public:
+		NullBackend(void) { reset(); }
+
+		void reset(void) { m_drawCalls = m_instances = m_meshChanges = m_materialChanges = 0; }
+
+		virtual void setMesh(RenderMesh, int) { m_meshChanges++; }
+		virtual void setMaterial(RenderMaterial) { m_materialChanges++; }
+		virtual void drawInstances(const float*, int count) { m_drawCalls++; m_instances += count; }
+
+		int getDrawCalls(void) const { return m_drawCalls; }
+		int getInstances(void) const { return m_instances; }
+		int getMeshChanges(void) const { return m_meshChanges; }
+		int getMaterialChanges(void) const { return m_materialChanges; }
+
+	private:
+		int		m_drawCalls;
+		int		m_instances;
+		int		m_meshChanges;
+		int		m_materialChanges;
+	};
+
+	// what Display() draws: plane, walls, alive bricks, both balls at the
+	// given (e.g. interpolated) centers, the extra balls of the multi-ball
+	// mode and the line; the light's sphere had no size and isn't drawn.
+	// spheres get their level of detail for a viewport viewportHeight
+	// pixels high.
+	void recordScene(const Game& game, const Vector3& red, const Vector3& grey, int viewportHeight, CommandBuffer& commands);
+	void recordScene(const Game& game, int viewportHeight, CommandBuffer& commands);
+	// the same from a snapshot of a game, e.g. one published by the
+	// simulation thread
+	void recordScene(const RenderState& state, const Vector3& red, const Vector3& grey, int viewportHeight, CommandBuffer& commands);
+}
+
+#endif // __legoRenderH__
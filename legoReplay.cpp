@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoReplay.cpp
+//
+// Desc: Deterministic input recording and replay.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoReplay.h"
+#include "legoBytes.h"
+#include <cstdio>
+#include <cstring>
+
+static const unsigned char replayMagic[4] = { 'L', 'G', 'I', 'N' };
+static const unsigned char replayVersion = 3;
+
+void lego::applyInput(Game& game, InputType type)
+{
+	switch (type) {
+	case INPUT_LAUNCH:
+		game.launchRedBall();
+		break;
+	case INPUT_LEFT:
+		game.moveGreyBallLeft();
+		break;
+	case INPUT_RIGHT:
+		game.moveGreyBallRight();
+		break;
+	case INPUT_RESTART:
+		game.restart();
+		break;
+	}
+}
+
+static unsigned int hashBytes(unsigned int hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static unsigned int hashSphere(unsigned int hash, const lego::Sphere& ball)
+{
+	lego::Vector3 c = ball.getCenter();
+	float state[5] = { c.x, c.y, c.z, (float)ball.getVelocity_X(), (float)ball.getVelocity_Z() };
+	return hashBytes(hash, state, sizeof(state));
+}
+
+unsigned int lego::hashGame(const Game& game)
+{
+	unsigned int hash = 2166136261u;
+	int counters[2] = { game.getLife(), game.getScore() };
+	unsigned char flags[2] = { game.isRoundStarted(), game.isGameEnded() };
+	hash = hashBytes(hash, counters, sizeof(counters));
+	hash = hashBytes(hash, flags, sizeof(flags));
+
+	const BallArray& bricks = game.getBricks();
+	hash = hashBytes(hash, bricks.getAliveFlags(), bricks.size());
+
+	hash = hashSphere(hash, game.getRedBall());
+	hash = hashSphere(hash, game.getGreyBall());
+	// only when there are any, so single ball hashes stay what they were
+	for (int i = 0; i < game.getExtraBallCount(); i++)
+		hash = hashSphere(hash, game.getExtraBall(i));
+	return hash;
+}
+
+lego::InputLog::InputLog(void)
+{
+	clear();
+}
+
+void lego::InputLog::clear(void)
+{
+	layout.clear();
+	continuousCollision = true;
+	fixedPoint = false;
+	multiBall = 0;
+	tickDelta = 0.0f;
+	ticks = 0;
+	finalHash = 0;
+	inputs.clear();
+}
+
+bool lego::InputLog::save(const char* path) const
+{
+	std::vector<unsigned char> out;
+	out.insert(out.end(), replayMagic, replayMagic + 4);
+	out.push_back(replayVersion);
+	out.push_back((continuousCollision ? 1 : 0) | (fixedPoint ? 2 : 0));
+	out.push_back((unsigned char)multiBall);
+	writeF32(out, tickDelta);
+	writeU32(out, ticks);
+	writeU32(out, finalHash);
+
+	writeU32(out, (unsigned int)(layout.size() / 2));
+	for (size_t i = 0; i < layout.size(); i++)
+		writeF32(out, layout[i]);
+
+	writeU32(out, (unsigned int)inputs.size());
+	unsigned int last = 0;
+	for (size_t i = 0; i < inputs.size(); i++) {
+		writeVarint(out, ((inputs[i].tick - last) << 2) | (unsigned int)inputs[i].type);
+		last = inputs[i].tick;
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+	bool ok = fwrite(&out[0], 1, out.size(), file) == out.size();
+	ok = fclose(file) == 0 && ok;
+	return ok;
+}
+
+bool lego::InputLog::load(const char* path)
+{
+	clear();
+
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+	std::vector<unsigned char> data;
+	unsigned char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + n);
+	fclose(file);
+
+	// version 1 logs have no multi-ball byte
+	if (data.size() < 6 || memcmp(&data[0], replayMagic, 4) != 0 || data[4] < 1 || data[4] > replayVersion)
+		return false;
+
+	ByteReader reader(&data[6], data.size() - 6);
+	continuousCollision = (data[5] & 1) != 0;
+	fixedPoint = data[4] >= 3 && (data[5] & 2) != 0;
+	if (data[4] >= 2)
+		multiBall = reader.readU8();
+	tickDelta = reader.readF32();
+	ticks = reader.readU32();
+	finalHash = reader.readU32();
+
+	unsigned int bricks = reader.readU32();
+	if (!reader.good() || bricks > (data.size() - 6) / 8)
+		return false;
+	layout.resize(bricks * 2);
+	for (size_t i = 0; i < layout.size(); i++)
+		layout[i] = reader.readF32();
+
+	unsigned int count = reader.readU32();
+	if (!reader.good() || count > data.size())
+		return false;
+	inputs.resize(count);
+	unsigned int tick = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int v = reader.readVarint();
+		tick += v >> 2;
+		inputs[i].tick = tick;
+		inputs[i].type = (InputType)(v & 3);
+	}
+
+	if (!reader.good() || !reader.atEnd() || tick > ticks) {
+		clear();
+		return false;
+	}
+	return true;
+}
+
+void lego::InputRecorder::start(const Game& game, float tickDelta)
+{
+	m_log.clear();
+	m_log.layout.assign(game.getBrickLayout(), game.getBrickLayout() + game.getBrickCount() * 2);
+	m_log.continuousCollision = game.getContinuousCollision();
+	m_log.fixedPoint = game.getFixedPoint();
+	m_log.multiBall = game.getMultiBall();
+	m_log.tickDelta = tickDelta;
+}
+
+void lego::InputRecorder::input(Game& game, InputType type)
+{
+	InputEvent e;
+	e.tick = m_log.ticks;
+	e.type = type;
+	m_log.inputs.push_back(e);
+	applyInput(game, type);
+}
+
+void lego::InputRecorder::update(Game& game)
+{
+	game.update(m_log.tickDelta);
+	m_log.ticks++;
+}
+
+const lego::InputLog& lego::InputRecorder::finish(const Game& game)
+{
+	m_log.finalHash = hashGame(game);
+	return m_log;
+}
+
+bool lego::replayInput(const InputLog& log, Game& game)
+{
+	const int bricks = (int)log.layout.size() / 2;
+	game.setup(bricks > 0 ? &log.layout[0] : 0, bricks);
+	game.setContinuousCollision(log.continuousCollision);
+	game.setFixedPoint(log.fixedPoint);
+	game.setMultiBall(log.multiBall);
+
+	size_t next = 0;
+	for (unsigned int tick = 0; tick < log.ticks; tick++) {
+		while (next < log.inputs.size() && log.inputs[next].tick == tick)
+			applyInput(game, log.inputs[next++].type);
+		game.update(log.tickDelta);
+	}
+	// input after the last tick
+	while (next < log.inputs.size())
+		applyInput(game, log.inputs[next++].type);
+
+	return hashGame(game) == log.finalHash;
+}
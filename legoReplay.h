@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoReplay.h
+//
+// Desc: Deterministic input recording and replay. The simulation only
+//       changes through player input and fixed-length ticks, so a session
+//       is fully described by its level, its tick length and the tick at
+//       which every key was pressed. Replaying that log on a fresh Game
+//       reproduces the session bit for bit, without a window and as fast
+//       as the cpu allows.
+//
+//       file layout, little endian:
+//         "LGIN", u8 version, u8 flags (1 = continuous collision,
+//         2 = fixed point from version 3)
+//         u8 multi-ball count (from version 2)
+//         f32 tickDelta, u32 ticks, u32 final state hash
+//         u32 bricks, bricks * (f32 x, f32 z)
+//         u32 inputs, inputs * varint((ticks since last input << 2) | type)
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoReplayH__
+#define __legoReplayH__
+
+#include "legoGame.h"
+#include <vector>
+
+namespace lego
+{
+	enum InputType
+	{
+		INPUT_LAUNCH,	// VK_SPACE
+		INPUT_LEFT,		// VK_LEFT
+		INPUT_RIGHT,	// VK_RIGHT
+		INPUT_RESTART	// new game on the same level
+	};
+
+	struct InputEvent
+	{
+		unsigned int	tick;	// ticks simulated before the input
+		InputType		type;
+	};
+
+	// feeds one input to the game
+	void applyInput(Game& game, InputType type);
+
+	// FNV-1a over the bits of everything that evolves during a session:
+	// life, score, round state, alive bricks and all moving balls
+	unsigned int hashGame(const Game& game);
+
+	class InputLog {
+	public:
+		InputLog(void);
+
+		void clear(void);
+		bool save(const char* path) const;
+		bool load(const char* path);
+
+		std::vector<float>			layout;		// (x, z) of every brick
+		bool						continuousCollision;
+		bool						fixedPoint;	// Game::setFixedPoint
+		int							multiBall;	// Game::setMultiBall, 0 to 255
+		float						tickDelta;
+		unsigned int				ticks;
+		unsigned int				finalHash;
+		std::vector<InputEvent>		inputs;
+	};
+
+	class InputRecorder {
+	public:
+		// takes the level and settings of game, which must be freshly set up
+		void start(const Game& game, float tickDelta);
+
+		// use instead of the matching Game calls so the input gets logged
+		void input(Game& game, InputType type);
+		void update(Game& game);
+
+		// stamps the final state into the log
+		const InputLog& finish(const Game& game);
+
+		const InputLog& getLog(void) const { return m_log; }
+
+	private:
+		InputLog	m_log;
+	};
+
+	// plays log on game from a fresh setup. true if the final state matches
+	// the recorded one.
+	bool replayInput(const InputLog& log, Game& game);
+}
+
+#endif // __legoReplayH__
@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoSimThread.cpp
+//
+// Desc: Simulation thread, input queue and snapshots.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoSimThread.h"
+#include "legoProfile.h"
+#include "legoTimestep.h"
+#include <chrono>
+#include <climits>
+
+lego::SimulationThread::SimulationThread(Game& game, InputRecorder& recorder)
+	: m_game(game), m_recorder(recorder)
+{
+	m_tickDelta = 0.0f;
+	m_ticks = 0;
+	m_applied = 0;
+	m_quit.store(false);
+	m_tickLimit.store(UINT_MAX);
+}
+
+lego::SimulationThread::~SimulationThread(void)
+{
+	stop();
+}
+
+long long lego::SimulationThread::now(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void lego::SimulationThread::start(float tickRate, int maxTicksPerFrame)
+{
+	stop();
+	m_tickDelta = tickRate > 0.0f ? 1.0f / tickRate : 0.0f;
+
+	// the state before the first tick, so there is always something to draw
+	SimSnapshot& first = m_snapshots.getBack();
+	m_game.saveRenderState(first.state);
+	first.prevRedCenter = m_game.getRedBall().getCenter();
+	first.prevGreyCenter = m_game.getGreyBall().getCenter();
+	first.ticks = m_ticks;
+	first.inputs = m_applied;
+	first.time = now();
+	m_snapshots.publish();
+
+	m_quit.store(false);
+	m_thread = std::thread(&SimulationThread::run, this, maxTicksPerFrame);
+}
+
+void lego::SimulationThread::stop(void)
+{
+	if (!m_thread.joinable())
+		return;
+	m_quit.store(true);
+	m_thread.join();
+}
+
+const lego::SimSnapshot& lego::SimulationThread::getSnapshot(void)
+{
+	m_snapshots.update();
+	return m_snapshots.getFront();
+}
+
+float lego::SimulationThread::getAlpha(const SimSnapshot& snapshot) const
+{
+	if (m_tickDelta <= 0.0f)
+		return 1.0f;
+	float alpha = (float)((now() - snapshot.time) / 1e9) / m_tickDelta;
+	return alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+}
+
+void lego::SimulationThread::run(int maxTicksPerFrame)
+{
+	if (m_tickDelta <= 0.0f) {
+		while (!m_quit.load(std::memory_order_relaxed)) {
+			if (m_ticks < m_tickLimit.load(std::memory_order_acquire))
+				tick();
+			else
+				std::this_thread::yield();
+		}
+		return;
+	}
+
+	FixedTimestep timestep(1.0f / m_tickDelta, maxTicksPerFrame);
+	long long last = now();
+	while (!m_quit.load(std::memory_order_relaxed)) {
+		long long current = now();
+		int ticks = timestep.advance((current - last) / 1e9);
+		last = current;
+		for (int i = 0; i < ticks && m_ticks < m_tickLimit.load(std::memory_order_acquire); i++)
+			tick();
+
+		// sleep until the next tick is due
+		float wait = (1.0f - timestep.getAlpha()) * m_tickDelta;
+		std::this_thread::sleep_for(std::chrono::microseconds((long long)(wait * 1e6f)));
+	}
+}
+
+void lego::SimulationThread::tick(void)
+{
+	LEGO_PROFILE_SCOPE("tick");
+
+	InputType input;
+	while (m_inputs.pop(input)) {
+		m_recorder.input(m_game, input);
+		m_applied++;
+	}
+
+	SimSnapshot& snapshot = m_snapshots.getBack();
+	snapshot.prevRedCenter = m_game.getRedBall().getCenter();
+	snapshot.prevGreyCenter = m_game.getGreyBall().getCenter();
+	m_recorder.update(m_game);
+	m_ticks++;
+
+	// a slot used before only takes the bricks destroyed since
+	m_game.saveRenderState(snapshot.state);
+	snapshot.ticks = m_ticks;
+	snapshot.inputs = m_applied;
+	snapshot.time = now();
+	m_snapshots.publish();
+}
@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoSimThread.h
+//
+// Desc: Runs the simulation on a thread of its own. Input events come in
+//       through a lock-free queue and every tick publishes a snapshot of
+//       the world through a triple buffer, so the thread drawing frames
+//       never waits for the physics and a slow frame never delays a tick.
+//
+//       While the thread runs the game and the recorder belong to it; the
+//       other side only reads snapshots and posts input.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoSimThreadH__
+#define __legoSimThreadH__
+
+#include "legoGame.h"
+#include "legoLockFree.h"
+#include "legoReplay.h"
+#include <atomic>
+#include <thread>
+
+namespace lego
+{
+	// the world as a tick left it
+	struct SimSnapshot
+	{
+		RenderState		state;
+		// centers at the tick before, to interpolate the moving balls
+		Vector3			prevRedCenter;
+		Vector3			prevGreyCenter;
+		unsigned int	ticks;		// simulated so far
+		unsigned int	inputs;		// posted events applied so far
+		long long		time;		// when the tick ended, see SimulationThread::now()
+	};
+
+	// input events waiting for the next tick
+	const unsigned int simInputQueueSize = 256;
+
+	class SimulationThread {
+	public:
+		// the recorder must be started on game already
+		SimulationThread(Game& game, InputRecorder& recorder);
+		~SimulationThread(void);
+
+		// ticks tickRate times per second of real time, catching up at most
+		// maxTicksPerFrame at once, or as fast as it can for a tickRate of 0
+		void start(float tickRate, int maxTicksPerFrame = 8);
+		// never ticks past ticks in all, until the limit is raised: with a
+		// tickRate of 0, raising it one tick at a time steps the game in
+		// lock-step with the other side. no limit by default.
+		void setTickLimit(unsigned int ticks) { m_tickLimit.store(ticks, std::memory_order_release); }
+		// waits for the thread; game and recorder are the caller's again
+		void stop(void);
+
+		// from one thread only. false when the queue is full.
+		bool postInput(InputType type) { return m_inputs.push(type); }
+
+		// the latest snapshot, valid until the next call. from one thread only.
+		const SimSnapshot& getSnapshot(void);
+		// how far now lies between the snapshot's tick and the next one, 0 to 1
+		float getAlpha(const SimSnapshot& snapshot) const;
+
+		// ns on a steady clock
+		static long long now(void);
+
+	private:
+		Game&			m_game;
+		InputRecorder&	m_recorder;
+		float			m_tickDelta;	// real seconds per tick
+		unsigned int	m_ticks;
+		unsigned int	m_applied;
+
+		SpscQueue<InputType, simInputQueueSize>	m_inputs;
+		TripleBuffer<SimSnapshot>	m_snapshots;
+		std::atomic<bool>	m_quit;
+		std::atomic<unsigned int>	m_tickLimit;
+		std::thread			m_thread;
+
+		void run(int maxTicksPerFrame);
+		void tick(void);
+
+		SimulationThread(const SimulationThread&);
+		SimulationThread& operator=(const SimulationThread&);
+	};
+}
+
+#endif // __legoSimThreadH__
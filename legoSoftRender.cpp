@@ -0,0 +1,392 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoSoftRender.cpp
+//
+// Desc: CPU renderer of the Virtual Lego scene.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoSoftRender.h"
+#include "legoProfile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LEGO_X86
+#include <emmintrin.h>
+#endif
+
+// same light as Setup() in virtualLego.cpp
+static constexpr lego::Vector3 lightPos(0.0f, lego::sceneLightHeight, 0.0f);
+static const float lightDiffuse = 1.0f;
+static const float lightSpecular = 0.9f;
+static const float lightAmbient = 0.9f;
+static const float lightRange = 100.0f;
+static const float lightAttenuation[3] = { 0.0f, 0.9f, 0.0f };
+
+static const unsigned int clearColor = 0x00afafaf;
+
+// -----------------------------------------------------------------------------
+// SoftRenderer
+// -----------------------------------------------------------------------------
+
+lego::SoftRenderer::SoftRenderer(ThreadPool& pool)
+	: m_pool(pool)
+{
+	m_width = m_height = 0;
+	m_tilesX = m_tilesY = 0;
+	m_visibleTriangles = 0;
+	m_binChunks = std::max(1, pool.getThreadCount() * 2);
+
+	// a level coarser than the Direct3D client: the cpu pays for every
+	// vertex, and the spheres still look round at the size they're drawn
+	for (int i = 0; i < MESH_COUNT; i++) {
+		for (int lod = 0; lod < meshLodCount; lod++)
+			m_meshes[i][lod] = &m_meshCache.get(getMeshShape((RenderMesh)i, std::min(lod + 1, meshLodCount - 1)));
+	}
+
+	resize(1024, 768);
+}
+
+void lego::SoftRenderer::resize(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_tilesX = (width + softTileSize - 1) / softTileSize;
+	m_tilesY = (height + softTileSize - 1) / softTileSize;
+	m_pixels.assign(width * height, clearColor);
+	m_depth.assign(width * height, 1.0f);
+	m_bins.assign(m_binChunks * m_tilesX * m_tilesY, std::vector<int>());
+
+	m_viewProj = getSceneViewProjection((float)width / height);
+}
+
+void lego::SoftRenderer::addObject(const MeshData& mesh, const float* position, RenderMaterial material)
+{
+	MaterialDesc desc = getMaterial(material);
+	Object object;
+	object.mesh = &mesh;
+	object.x = position[0];	object.y = position[1];	object.z = position[2];
+	object.r = ((desc.color >> 16) & 0xff) / 255.0f;
+	object.g = ((desc.color >> 8) & 0xff) / 255.0f;
+	object.b = (desc.color & 0xff) / 255.0f;
+	object.power = desc.power;
+	object.firstVertex = m_objects.empty() ? 0 : m_objects.back().firstVertex + m_objects.back().mesh->getVertexCount();
+	object.firstTriangle = m_objects.empty() ? 0 : m_objects.back().firstTriangle + m_objects.back().mesh->getTriangleCount();
+	m_objects.push_back(object);
+}
+
+void lego::SoftRenderer::buildObjects(const CommandBuffer& commands)
+{
+	m_objects.clear();
+	for (int i = 0; i < commands.getBatchCount(); i++) {
+		const DrawBatch& batch = commands.getBatch(i);
+		const float* positions = commands.getInstancePositions(batch.firstInstance);
+		for (int k = 0; k < batch.instanceCount; k++)
+			addObject(*m_meshes[batch.mesh][batch.lod], &positions[k * 3], batch.material);
+	}
+}
+
+// fixed-function point light: ambient + diffuse + specular with the local
+// viewer, attenuated by 1 / (a0 + a1 d + a2 d^2)
+static void shade(const lego::Vector3& p, const lego::Vector3& n, float r, float g, float b, float power, float* out)
+{
+	lego::Vector3 toLight = lightPos - p;
+	float distance = sqrtf(lego::lengthSquared(toLight));
+	if (distance > lightRange || distance <= 0.0f) {
+		out[0] = out[1] = out[2] = 0.0f;
+		return;
+	}
+	float atten = 1.0f / (lightAttenuation[0] + lightAttenuation[1] * distance + lightAttenuation[2] * distance * distance);
+	toLight = lego::Vector3(toLight.x / distance, toLight.y / distance, toLight.z / distance);
+
+	float diffuse = std::max(0.0f, lego::dot(n, toLight));
+	float specular = 0.0f;
+	if (diffuse > 0.0f) {
+		lego::Vector3 toEye = lego::normalize(lego::sceneCameraPosition - p);
+		lego::Vector3 half = lego::normalize(toEye + toLight);
+		specular = powf(std::max(0.0f, lego::dot(n, half)), power) * lightSpecular * atten;
+	}
+
+	float lit = (lightAmbient + lightDiffuse * diffuse) * atten;
+	out[0] = std::min(1.0f, std::min(1.0f, r * lit) + r * specular);
+	out[1] = std::min(1.0f, std::min(1.0f, g * lit) + g * specular);
+	out[2] = std::min(1.0f, std::min(1.0f, b * lit) + b * specular);
+}
+
+void lego::SoftRenderer::transformObject(Object& object)
+{
+	const MeshData& mesh = *object.mesh;
+	const int vertices = mesh.getVertexCount();
+	const int triangles = mesh.getTriangleCount();
+	const Vector3 offset(object.x, object.y, object.z);
+
+	// all the vertices of the object through one matrix, in a batch
+	float* clip = &m_clip[object.firstVertex * 4];
+	transformPoints(Matrix4::translation(object.x, object.y, object.z) * m_viewProj,
+		&mesh.position[0], vertices, clip);
+
+	for (int i = 0; i < vertices; i++, clip += 4) {
+		const float* local = &mesh.position[i * 3];
+		const float* normal = &mesh.normal[i * 3];
+		float cx = clip[0], cy = clip[1], cz = clip[2], cw = clip[3];
+
+		Vertex& v = m_vertices[object.firstVertex + i];
+		float color[3];
+		shade(Vector3(local[0], local[1], local[2]) + offset, Vector3(normal[0], normal[1], normal[2]),
+			object.r, object.g, object.b, object.power, color);
+
+		// behind the near plane: flagged by invW, its triangles are dropped
+		v.invW = cw > sceneNearPlane * 0.5f ? 1.0f / cw : 0.0f;
+		v.x = (cx * v.invW + 1.0f) * 0.5f * m_width;
+		v.y = (1.0f - cy * v.invW) * 0.5f * m_height;
+		v.z = cz * v.invW;
+		v.r = color[0] * v.invW;
+		v.g = color[1] * v.invW;
+		v.b = color[2] * v.invW;
+	}
+
+	for (int i = 0; i < triangles; i++) {
+		Triangle& t = m_triangles[object.firstTriangle + i];
+		const unsigned short* index = &mesh.index[i * 3];
+		const float* p0 = &mesh.position[index[0] * 3];
+		const float* n = &mesh.faceNormal[i * 3];
+		Vector3 toFace = Vector3(p0[0], p0[1], p0[2]) + offset - sceneCameraPosition;
+
+		// back faces, whatever the winding
+		t.visible = dot(Vector3(n[0], n[1], n[2]), toFace) < 0.0f;
+		if (t.visible) {
+			setupTriangle(t, m_vertices[object.firstVertex + index[0]],
+				m_vertices[object.firstVertex + index[1]], m_vertices[object.firstVertex + index[2]]);
+		}
+	}
+}
+
+void lego::SoftRenderer::setupTriangle(Triangle& t, const Vertex& v0, const Vertex& v1, const Vertex& v2)
+{
+	t.visible = false;
+	if (v0.invW == 0.0f || v1.invW == 0.0f || v2.invW == 0.0f)
+		return;
+
+	float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+	if (fabsf(area) < 1e-8f)
+		return;
+
+	float minX = std::min(v0.x, std::min(v1.x, v2.x));
+	float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+	float minY = std::min(v0.y, std::min(v1.y, v2.y));
+	float maxY = std::max(v0.y, std::max(v1.y, v2.y));
+	t.minX = std::max(0, (int)floorf(minX));
+	t.minY = std::max(0, (int)floorf(minY));
+	t.maxX = std::min(m_width - 1, (int)ceilf(maxX));
+	t.maxY = std::min(m_height - 1, (int)ceilf(maxY));
+	if (t.minX > t.maxX || t.minY > t.maxY)
+		return;
+
+	// weight of vertex k is the edge function of the opposite edge over the area
+	const Vertex* v[3] = { &v0, &v1, &v2 };
+	for (int k = 0; k < 3; k++) {
+		const Vertex& a = *v[(k + 1) % 3];
+		const Vertex& b = *v[(k + 2) % 3];
+		float ea = (a.y - b.y) / area;
+		float eb = (b.x - a.x) / area;
+		t.edge[k][0] = ea;
+		t.edge[k][1] = eb;
+		t.edge[k][2] = -(ea * a.x + eb * a.y);
+	}
+
+	// attributes as planes over the screen, from the weights
+	for (int c = 0; c < 3; c++) {
+		t.z[c] = t.edge[0][c] * v0.z + t.edge[1][c] * v1.z + t.edge[2][c] * v2.z;
+		t.invW[c] = t.edge[0][c] * v0.invW + t.edge[1][c] * v1.invW + t.edge[2][c] * v2.invW;
+		t.r[c] = t.edge[0][c] * v0.r + t.edge[1][c] * v1.r + t.edge[2][c] * v2.r;
+		t.g[c] = t.edge[0][c] * v0.g + t.edge[1][c] * v1.g + t.edge[2][c] * v2.g;
+		t.b[c] = t.edge[0][c] * v0.b + t.edge[1][c] * v1.b + t.edge[2][c] * v2.b;
+	}
+	t.visible = true;
+}
+
+static unsigned int packColor(float r, float g, float b)
+{
+	int ir = (int)(std::max(0.0f, std::min(1.0f, r)) * 255.0f + 0.5f);
+	int ig = (int)(std::max(0.0f, std::min(1.0f, g)) * 255.0f + 0.5f);
+	int ib = (int)(std::max(0.0f, std::min(1.0f, b)) * 255.0f + 0.5f);
+	return (ir << 16) | (ig << 8) | ib;
+}
+
+void lego::SoftRenderer::rasterTriangle(const Triangle& t, int x0, int y0, int x1, int y1)
+{
+	x0 = std::max(x0, t.minX);	x1 = std::min(x1, t.maxX);
+	y0 = std::max(y0, t.minY);	y1 = std::min(y1, t.maxY);
+
+	for (int y = y0; y <= y1; y++) {
+		const float py = y + 0.5f;
+		unsigned int* pixels = &m_pixels[y * m_width];
+		float* depth = &m_depth[y * m_width];
+
+		// the row part of every plane
+		float e0 = t.edge[0][1] * py + t.edge[0][2];
+		float e1 = t.edge[1][1] * py + t.edge[1][2];
+		float e2 = t.edge[2][1] * py + t.edge[2][2];
+		float zr = t.z[1] * py + t.z[2];
+		float wr = t.invW[1] * py + t.invW[2];
+		float rr = t.r[1] * py + t.r[2];
+		float gr = t.g[1] * py + t.g[2];
+		float br = t.b[1] * py + t.b[2];
+
+		int x = x0;
+#ifdef LEGO_X86
+		// four pixels per step
+		const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		const __m128 zero = _mm_setzero_ps();
+		for (; x + 3 <= x1; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+			__m128 w0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edge[0][0]), px), _mm_set1_ps(e0));
+			__m128 w1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edge[1][0]), px), _mm_set1_ps(e1));
+			__m128 w2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edge[2][0]), px), _mm_set1_ps(e2));
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_and_ps(_mm_cmpge_ps(w1, zero), _mm_cmpge_ps(w2, zero)));
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.z[0]), px), _mm_set1_ps(zr));
+			__m128 oldZ = _mm_loadu_ps(&depth[x]);
+			__m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, oldZ));
+			if (_mm_movemask_ps(pass) == 0)
+				continue;
+
+			__m128 w = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.invW[0]), px), _mm_set1_ps(wr));
+			__m128 toColor = _mm_div_ps(_mm_set1_ps(255.0f), w);
+			__m128 r = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.r[0]), px), _mm_set1_ps(rr)), toColor);
+			__m128 g = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.g[0]), px), _mm_set1_ps(gr)), toColor);
+			__m128 b = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.b[0]), px), _mm_set1_ps(br)), toColor);
+			const __m128 half = _mm_set1_ps(0.5f), top = _mm_set1_ps(255.0f);
+			__m128i ir = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(r, zero), top), half));
+			__m128i ig = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(g, zero), top), half));
+			__m128i ib = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(b, zero), top), half));
+			__m128i color = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(ir, 16), _mm_slli_epi32(ig, 8)), ib);
+
+			__m128i mask = _mm_castps_si128(pass);
+			__m128i oldColor = _mm_loadu_si128((const __m128i*)&pixels[x]);
+			_mm_storeu_si128((__m128i*)&pixels[x], _mm_or_si128(_mm_and_si128(mask, color), _mm_andnot_si128(mask, oldColor)));
+			_mm_storeu_ps(&depth[x], _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldZ)));
+		}
+#endif
+		for (; x <= x1; x++) {
+			const float px = x + 0.5f;
+			if (t.edge[0][0] * px + e0 < 0.0f || t.edge[1][0] * px + e1 < 0.0f || t.edge[2][0] * px + e2 < 0.0f)
+				continue;
+			float z = t.z[0] * px + zr;
+			if (!(z < depth[x]))
+				continue;
+			float w = 1.0f / (t.invW[0] * px + wr);
+			depth[x] = z;
+			pixels[x] = packColor((t.r[0] * px + rr) * w, (t.g[0] * px + gr) * w, (t.b[0] * px + br) * w);
+		}
+	}
+}
+
+void lego::SoftRenderer::rasterTile(int tile)
+{
+	const int tiles = m_tilesX * m_tilesY;
+	const int x0 = (tile % m_tilesX) * softTileSize;
+	const int y0 = (tile / m_tilesX) * softTileSize;
+	const int x1 = std::min(m_width, x0 + softTileSize) - 1;
+	const int y1 = std::min(m_height, y0 + softTileSize) - 1;
+
+	for (int y = y0; y <= y1; y++) {
+		std::fill(&m_pixels[y * m_width + x0], &m_pixels[y * m_width + x1] + 1, clearColor);
+		std::fill(&m_depth[y * m_width + x0], &m_depth[y * m_width + x1] + 1, 1.0f);
+	}
+
+	for (int chunk = 0; chunk < m_binChunks; chunk++) {
+		const std::vector<int>& bin = m_bins[chunk * tiles + tile];
+		for (size_t i = 0; i < bin.size(); i++)
+			rasterTriangle(m_triangles[bin[i]], x0, y0, x1, y1);
+	}
+}
+
+void lego::SoftRenderer::render(const Game& game)
+{
+	recordScene(game, m_height, m_commands);
+	m_commands.sort();
+	render(m_commands);
+}
+
+void lego::SoftRenderer::render(const CommandBuffer& commands)
+{
+	LEGO_PROFILE_SCOPE("soft render");
+	buildObjects(commands);
+	if (m_objects.empty())
+		return;
+
+	const Object& last = m_objects.back();
+	m_vertices.resize(last.firstVertex + last.mesh->position.size() / 3);
+	m_clip.resize(m_vertices.size() * 4);
+	m_triangles.resize(last.firstTriangle + last.mesh->index.size() / 3);
+
+	// vertices and triangles of every object land at fixed offsets, so
+	// the objects can be processed in any order
+	m_pool.parallelFor((int)m_objects.size(), 16, [this](int begin, int end) {
+		LEGO_PROFILE_SCOPE("transform");
+		for (int i = begin; i < end; i++)
+			transformObject(m_objects[i]);
+	});
+
+	// bin contiguous chunks of triangles, each into its own lists
+	const int tiles = m_tilesX * m_tilesY;
+	const int triangles = (int)m_triangles.size();
+	const int perChunk = (triangles + m_binChunks - 1) / m_binChunks;
+	m_pool.parallelFor(m_binChunks, 1, [this, tiles, triangles, perChunk](int begin, int end) {
+		LEGO_PROFILE_SCOPE("bin");
+		for (int chunk = begin; chunk < end; chunk++) {
+			std::vector<int>* bins = &m_bins[chunk * tiles];
+			for (int tile = 0; tile < tiles; tile++)
+				bins[tile].clear();
+
+			int last = std::min(triangles, (chunk + 1) * perChunk);
+			for (int i = chunk * perChunk; i < last; i++) {
+				const Triangle& t = m_triangles[i];
+				if (!t.visible)
+					continue;
+				for (int ty = t.minY / softTileSize; ty <= t.maxY / softTileSize; ty++) {
+					for (int tx = t.minX / softTileSize; tx <= t.maxX / softTileSize; tx++)
+						bins[ty * m_tilesX + tx].push_back(i);
+				}
+			}
+		}
+	});
+
+	m_visibleTriangles = 0;
+	for (int i = 0; i < triangles; i++)
+		m_visibleTriangles += m_triangles[i].visible;
+
+	// tiles don't share pixels, one worker each
+	m_pool.parallelFor(tiles, 1, [this](int begin, int end) {
+		LEGO_PROFILE_SCOPE("raster");
+		for (int tile = begin; tile < end; tile++)
+			rasterTile(tile);
+	});
+}
+
+bool lego::SoftRenderer::savePpm(const char* path) const
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+
+	fprintf(file, "P6\n%d %d\n255\n", m_width, m_height);
+	std::vector<unsigned char> row(m_width * 3);
+	bool ok = true;
+	for (int y = 0; y < m_height && ok; y++) {
+		for (int x = 0; x < m_width; x++) {
+			unsigned int c = m_pixels[y * m_width + x];
+			row[x * 3] = (unsigned char)(c >> 16);
+			row[x * 3 + 1] = (unsigned char)(c >> 8);
+			row[x * 3 + 2] = (unsigned char)c;
+		}
+		ok = fwrite(&row[0], 1, row.size(), file) == row.size();
+	}
+	ok = fclose(file) == 0 && ok;
+	return ok;
+}
@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoSoftRender.h
+//
+// Desc: CPU renderer of the Virtual Lego scene, for machines without a GPU:
+//       thumbnails, replays and visual regression checks. Draws the
+//       commands recorded by recordScene() with the same camera, point
+//       light and per-vertex lighting as the Direct3D device.
+//
+//       The frame is cut into 64x64 tiles. Triangles are transformed and
+//       lit per object, then binned into the tiles they overlap, and every
+//       tile is rasterized on its own by one worker with edge functions
+//       evaluated four pixels at a time.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoSoftRenderH__
+#define __legoSoftRenderH__
+
+#include "legoGame.h"
+#include "legoRender.h"
+#include "legoThreadPool.h"
+#include <vector>
+
+namespace lego
+{
+	const int softTileSize = 64;
+
+	class SoftRenderer {
+	public:
+		explicit SoftRenderer(ThreadPool& pool);
+
+		void resize(int width, int height);
+		void render(const Game& game);
+		// commands must be sorted
+		void render(const CommandBuffer& commands);
+
+		int getWidth(void) const { return m_width; }
+		int getHeight(void) const { return m_height; }
+		// 0x00RRGGBB, row by row from the top
+		const unsigned int* getPixels(void) const { return m_pixels.empty() ? 0 : &m_pixels[0]; }
+		// triangles that reached the rasterizer last frame
+		int getTriangleCount(void) const { return m_visibleTriangles; }
+
+		const MeshCache& getMeshCache(void) const { return m_meshCache; }
+		const MeshData& getMesh(RenderMesh mesh, int lod) const { return *m_meshes[mesh][lod]; }
+
+		// binary PPM, readable by about any image tool
+		bool savePpm(const char* path) const;
+
+	private:
+		struct Object
+		{
+			const MeshData*	mesh;
+			float			x, y, z;		// the meshes are only ever translated
+			float			r, g, b;		// ambient = diffuse = specular
+			float			power;
+			int				firstVertex;
+			int				firstTriangle;
+		};
+
+		// screen space, color divided by w for perspective correct shading
+		struct Vertex
+		{
+			float	x, y, z, invW;
+			float	r, g, b;
+		};
+
+		// every attribute as a plane a * x + b * y + c over the pixel centers
+		struct Triangle
+		{
+			float	edge[3][3];		// barycentric weights, >= 0 inside
+			float	z[3], invW[3], r[3], g[3], b[3];
+			int		minX, minY, maxX, maxY;
+			bool	visible;
+		};
+
+		ThreadPool&		m_pool;
+		int				m_width, m_height;
+		int				m_tilesX, m_tilesY;
+
+		std::vector<unsigned int>	m_pixels;
+		std::vector<float>			m_depth;
+
+		MeshCache		m_meshCache;
+		const MeshData*	m_meshes[MESH_COUNT][meshLodCount];
+		CommandBuffer	m_commands;
+
+		Matrix4	m_viewProj;
+
+		std::vector<Object>		m_objects;
+		std::vector<float>		m_clip;		// clip space (x, y, z, w) of every vertex
+		std::vector<Vertex>		m_vertices;
+		std::vector<Triangle>	m_triangles;
+		int						m_visibleTriangles;
+
+		// m_bins[chunk * tiles + tile] lists the triangles of one chunk of
+		// the frame that touch the tile, in drawing order
+		int						m_binChunks;
+		std::vector<std::vector<int> >	m_bins;
+
+		void addObject(const MeshData& mesh, const float* position, RenderMaterial material);
+		void buildObjects(const CommandBuffer& commands);
+		void transformObject(Object& object);
+		void setupTriangle(Triangle& t, const Vertex& v0, const Vertex& v1, const Vertex& v2);
+		void rasterTile(int tile);
+		void rasterTriangle(const Triangle& t, int x0, int y0, int x1, int y1);
+	};
+}
+
+#endif // __legoSoftRenderH__
@@ -0,0 +1,711 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoStream.cpp
+//
+// Desc: State stream encoder, decoder and Unix socket transport.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoStream.h"
+#include "legoBytes.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+static const unsigned char streamMagic[4] = { 'L', 'G', 'S', 'T' };
+static const unsigned char streamVersion = 1;
+static const int streamHeaderSize = 4 + 1 + 4 + 4;
+
+// ball update flags
+static const unsigned char UPDATE_CORRECTION = 1;
+static const unsigned char UPDATE_DISPLACEMENT = 2;
+
+// round flags of FRAME_STATUS
+static const unsigned char STATUS_ROUND_STARTED = 1;
+static const unsigned char STATUS_GAME_ENDED = 2;
+
+static int quantize(float v)
+{
+	return (int)floorf(v * lego::streamScale + 0.5f);
+}
+
+static unsigned char getRoundFlags(const lego::Game& game)
+{
+	return (game.isRoundStarted() ? STATUS_ROUND_STARTED : 0) | (game.isGameEnded() ? STATUS_GAME_ENDED : 0);
+}
+
+// the encoder's side of a ball seen at center for the first time, or anew
+static void resetBall(lego::StreamBall& ball, const lego::Vector3& center, int dx, int dz)
+{
+	ball.x = ball.lastX = quantize(center.x);
+	ball.z = ball.lastZ = quantize(center.z);
+	ball.dx = ball.lastDx = dx;
+	ball.dz = ball.lastDz = dz;
+}
+
+// moves the ball as the decoder will predict it and appends the update
+// that brings it where center is, if it needs one. false if it doesn't.
+static bool trackBall(lego::StreamBall& ball, const lego::Vector3& center, std::vector<unsigned char>& out)
+{
+	int x = quantize(center.x);
+	int z = quantize(center.z);
+	int dx = x - ball.lastX;
+	int dz = z - ball.lastZ;
+	ball.x += ball.dx;
+	ball.z += ball.dz;
+
+	// a new displacement is only taken once it was seen twice running, so
+	// a single jump (a bounce, a key press) is a correction alone
+	unsigned char update = 0;
+	if (abs(dx - ball.lastDx) <= 1 && abs(dz - ball.lastDz) <= 1 && (abs(dx - ball.dx) > 1 || abs(dz - ball.dz) > 1))
+		update |= UPDATE_DISPLACEMENT | UPDATE_CORRECTION;
+	if (abs(x - ball.x) > lego::streamTolerance || abs(z - ball.z) > lego::streamTolerance)
+		update |= UPDATE_CORRECTION;
+	ball.lastX = x;
+	ball.lastZ = z;
+	ball.lastDx = dx;
+	ball.lastDz = dz;
+	if (update == 0)
+		return false;
+
+	out.push_back(update);
+	if (update & UPDATE_DISPLACEMENT) {
+		lego::writeSigned(out, dx);
+		lego::writeSigned(out, dz);
+		ball.dx = dx;
+		ball.dz = dz;
+	}
+	lego::writeSigned(out, x - ball.x);
+	lego::writeSigned(out, z - ball.z);
+	ball.x = x;
+	ball.z = z;
+	return true;
+}
+
+static void writeBall(std::vector<unsigned char>& out, const lego::StreamBall& ball)
+{
+	lego::writeSigned(out, ball.x);
+	lego::writeSigned(out, ball.z);
+	lego::writeSigned(out, ball.dx);
+	lego::writeSigned(out, ball.dz);
+}
+
+// -----------------------------------------------------------------------------
+// StreamEncoder
+// -----------------------------------------------------------------------------
+
+lego::StreamEncoder::StreamEncoder(void)
+{
+	m_interval = streamKeyframeInterval;
+	m_keyRequested = true;
+	m_tick = 0;
+	m_lastKey = 0;
+	m_life = m_score = 0;
+	m_flags = 0;
+	m_aliveCount = 0;
+	memset(&m_red, 0, sizeof(m_red));
+	memset(&m_grey, 0, sizeof(m_grey));
+}
+
+void lego::StreamEncoder::begin(const Game& game, float tickDelta, std::vector<unsigned char>& header)
+{
+	const int bricks = game.getBrickCount();
+	const float* layout = game.getBrickLayout();
+	header.clear();
+	header.insert(header.end(), streamMagic, streamMagic + 4);
+	header.push_back(streamVersion);
+	writeF32(header, tickDelta);
+	writeU32(header, (unsigned int)bricks);
+	for (int i = 0; i < bricks * 2; i++)
+		writeF32(header, layout[i]);
+
+	m_keyRequested = true;
+	m_tick = 0;
+	m_lastKey = 0;
+	resetBall(m_red, game.getRedBall().getCenter(), 0, 0);
+	resetBall(m_grey, game.getGreyBall().getCenter(), 0, 0);
+	m_extra.clear();
+}
+
+bool lego::StreamEncoder::encode(const Game& game, std::vector<unsigned char>& out)
+{
+	m_tick++;
+
+	// bricks only come back with a new game or level, which a keyframe
+	// says in fewer bytes than a list would
+	const BallArray& bricks = game.getBricks();
+	if (m_keyRequested || m_tick - m_lastKey >= (unsigned int)m_interval || bricks.getAliveCount() > m_aliveCount) {
+		writeKeyframe(game, out);
+		return true;
+	}
+
+	size_t maskAt = out.size();
+	unsigned char mask = 0;
+	out.push_back(0);
+
+	if (trackBall(m_red, game.getRedBall().getCenter(), out))
+		mask |= FRAME_RED;
+	if (trackBall(m_grey, game.getGreyBall().getCenter(), out))
+		mask |= FRAME_GREY;
+
+	unsigned char flags = getRoundFlags(game);
+	if (game.getLife() != m_life || game.getScore() != m_score || flags != m_flags) {
+		m_life = game.getLife();
+		m_score = game.getScore();
+		m_flags = flags;
+		writeVarint(out, (unsigned int)m_life);
+		writeVarint(out, (unsigned int)m_score);
+		out.push_back(m_flags);
+		mask |= FRAME_STATUS;
+	}
+
+	if (bricks.getAliveCount() < m_aliveCount) {
+		const unsigned char* alive = bricks.getAliveFlags();
+		writeVarint(out, (unsigned int)(m_aliveCount - bricks.getAliveCount()));
+		int last = 0;
+		for (int i = 0; i < bricks.size(); i++) {
+			if (m_alive[i] && !alive[i]) {
+				writeVarint(out, (unsigned int)(i - last));
+				last = i;
+				m_alive[i] = 0;
+			}
+		}
+		m_aliveCount = bricks.getAliveCount();
+		mask |= FRAME_BRICKS;
+	}
+
+	const int extra = game.getExtraBallCount();
+	if (extra != (int)m_extra.size()) {
+		writeExtraBalls(game, out);
+		mask |= FRAME_EXTRA;
+	}
+	else if (extra > 0) {
+		// one byte per ball as long as any needs an update
+		m_payload.clear();
+		writeVarint(m_payload, (unsigned int)extra << 1);
+		bool any = false;
+		for (int i = 0; i < extra; i++) {
+			if (!trackBall(m_extra[i], game.getExtraBall(i).getCenter(), m_payload))
+				m_payload.push_back(0);
+			else
+				any = true;
+		}
+		if (any) {
+			out.insert(out.end(), m_payload.begin(), m_payload.end());
+			mask |= FRAME_EXTRA;
+		}
+	}
+
+	out[maskAt] = mask;
+	return false;
+}
+
+void lego::StreamEncoder::writeKeyframe(const Game& game, std::vector<unsigned char>& out)
+{
+	m_keyRequested = false;
+	m_lastKey = m_tick;
+
+	out.push_back(FRAME_KEY);
+	writeVarint(out, m_tick);
+	m_life = game.getLife();
+	m_score = game.getScore();
+	m_flags = getRoundFlags(game);
+	writeVarint(out, (unsigned int)m_life);
+	writeVarint(out, (unsigned int)m_score);
+	out.push_back(m_flags);
+
+	// the displacement of this tick is the best guess for the next one
+	const Vector3 red = game.getRedBall().getCenter();
+	const Vector3 grey = game.getGreyBall().getCenter();
+	resetBall(m_red, red, quantize(red.x) - m_red.lastX, quantize(red.z) - m_red.lastZ);
+	resetBall(m_grey, grey, quantize(grey.x) - m_grey.lastX, quantize(grey.z) - m_grey.lastZ);
+	writeBall(out, m_red);
+	writeBall(out, m_grey);
+
+	const BallArray& bricks = game.getBricks();
+	const unsigned char* alive = bricks.getAliveFlags();
+	m_alive.assign(alive, alive + bricks.size());
+	m_aliveCount = bricks.getAliveCount();
+	std::vector<unsigned int>& runs = m_runs;
+	runs.clear();
+	unsigned char current = 1;
+	unsigned int length = 0;
+	for (int i = 0; i < bricks.size(); i++) {
+		if ((m_alive[i] != 0) != (current != 0)) {
+			runs.push_back(length);
+			current = !current;
+			length = 0;
+		}
+		length++;
+	}
+	runs.push_back(length);
+	writeVarint(out, (unsigned int)runs.size());
+	for (size_t i = 0; i < runs.size(); i++)
+		writeVarint(out, runs[i]);
+
+	writeExtraBalls(game, out);
+}
+
+void lego::StreamEncoder::writeExtraBalls(const Game& game, std::vector<unsigned char>& out)
+{
+	const int extra = game.getExtraBallCount();
+	writeVarint(out, ((unsigned int)extra << 1) | 1);
+	m_extra.resize(extra);
+	for (int i = 0; i < extra; i++) {
+		resetBall(m_extra[i], game.getExtraBall(i).getCenter(), 0, 0);
+		writeSigned(out, m_extra[i].x);
+		writeSigned(out, m_extra[i].z);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// StreamDecoder
+// -----------------------------------------------------------------------------
+
+// reads a ball update into ball, or only past it without one
+static void readBallUpdate(lego::ByteReader& reader, lego::StreamBall* ball)
+{
+	unsigned char update = reader.readU8();
+	if (update & UPDATE_DISPLACEMENT) {
+		int dx = reader.readSigned();
+		int dz = reader.readSigned();
+		if (ball) {
+			ball->dx = dx;
+			ball->dz = dz;
+		}
+	}
+	if (update & UPDATE_CORRECTION) {
+		int x = reader.readSigned();
+		int z = reader.readSigned();
+		if (ball) {
+			ball->x += x;
+			ball->z += z;
+		}
+	}
+}
+
+static void readBall(lego::ByteReader& reader, lego::StreamBall* ball)
+{
+	int x = reader.readSigned();
+	int z = reader.readSigned();
+	int dx = reader.readSigned();
+	int dz = reader.readSigned();
+	if (ball) {
+		ball->x = x;
+		ball->z = z;
+		ball->dx = dx;
+		ball->dz = dz;
+	}
+}
+
+lego::StreamDecoder::StreamDecoder(void)
+{
+	m_hasHeader = false;
+	m_synced = false;
+	m_tickDelta = 0.0f;
+	m_tick = 0;
+	memset(&m_red, 0, sizeof(m_red));
+	memset(&m_grey, 0, sizeof(m_grey));
+}
+
+int lego::StreamDecoder::decodeHeader(const unsigned char* data, size_t size)
+{
+	if (size < (size_t)streamHeaderSize)
+		return 0;
+	if (memcmp(data, streamMagic, 4) != 0 || data[4] != streamVersion)
+		return -1;
+
+	ByteReader reader(data + 5, size - 5);
+	float tickDelta = reader.readF32();
+	unsigned int bricks = reader.readU32();
+	if (bricks > (1u << 24))
+		return -1;
+	if (size < streamHeaderSize + (size_t)bricks * 8)
+		return 0;
+
+	std::vector<float> layout(bricks * 2);
+	for (size_t i = 0; i < layout.size(); i++)
+		layout[i] = reader.readF32();
+	m_game.setup(layout.empty() ? 0 : &layout[0], (int)bricks);
+	m_tickDelta = tickDelta;
+	m_hasHeader = true;
+	return streamHeaderSize + (int)bricks * 8;
+}
+
+int lego::StreamDecoder::decode(const unsigned char* data, size_t size)
+{
+	if (!m_hasHeader)
+		return decodeHeader(data, size);
+
+	// a frame is read through once to see it is all there, then applied,
+	// so a frame cut short by the transport leaves the scene as it was
+	for (int pass = 0; pass < 2; pass++) {
+		ByteReader reader(data, size);
+		unsigned char mask = reader.readU8();
+		if (!reader.good())
+			return 0;
+		if (mask & ~(FRAME_KEY | FRAME_RED | FRAME_GREY | FRAME_STATUS | FRAME_BRICKS | FRAME_EXTRA))
+			return -1;
+		bool apply = pass == 1 && (m_synced || (mask & FRAME_KEY));
+		Game& game = m_game;
+
+		if (mask & FRAME_KEY) {
+			unsigned int tick = reader.readVarint();
+			int life = (int)reader.readVarint();
+			int score = (int)reader.readVarint();
+			unsigned char flags = reader.readU8();
+			readBall(reader, apply ? &m_red : 0);
+			readBall(reader, apply ? &m_grey : 0);
+
+			unsigned int runs = reader.readVarint();
+			if (runs > (unsigned int)game.getBrickCount() + 1)
+				return -1;
+			if (apply)
+				game.resetBricks();
+			unsigned int brick = 0;
+			for (unsigned int r = 0; r < runs; r++) {
+				unsigned int length = reader.readVarint();
+				if (length > (unsigned int)game.getBrickCount() - brick)
+					return -1;
+				// odd runs are the destroyed bricks
+				if (apply && (r & 1)) {
+					for (unsigned int i = brick; i < brick + length; i++)
+						game.removeBrick(i);
+				}
+				brick += length;
+			}
+			if (reader.good() && brick != (unsigned int)game.getBrickCount())
+				return -1;
+
+			if (apply) {
+				m_tick = tick;
+				game.setStatus(life, score, (flags & STATUS_ROUND_STARTED) != 0, (flags & STATUS_GAME_ENDED) != 0);
+				m_synced = true;
+			}
+			mask = FRAME_EXTRA;
+		}
+		else if (apply) {
+			// every ball goes where the encoder predicted it
+			m_tick++;
+			StreamBall* balls[] = { &m_red, &m_grey };
+			for (int i = 0; i < 2; i++) {
+				balls[i]->x += balls[i]->dx;
+				balls[i]->z += balls[i]->dz;
+			}
+			for (size_t i = 0; i < m_extra.size(); i++) {
+				m_extra[i].x += m_extra[i].dx;
+				m_extra[i].z += m_extra[i].dz;
+			}
+		}
+
+		if (mask & FRAME_RED)
+			readBallUpdate(reader, apply ? &m_red : 0);
+		if (mask & FRAME_GREY)
+			readBallUpdate(reader, apply ? &m_grey : 0);
+		if (mask & FRAME_STATUS) {
+			int life = (int)reader.readVarint();
+			int score = (int)reader.readVarint();
+			unsigned char flags = reader.readU8();
+			if (apply)
+				game.setStatus(life, score, (flags & STATUS_ROUND_STARTED) != 0, (flags & STATUS_GAME_ENDED) != 0);
+		}
+		if (mask & FRAME_BRICKS) {
+			unsigned int count = reader.readVarint();
+			if (count > (unsigned int)game.getBrickCount())
+				return -1;
+			unsigned int brick = 0;
+			for (unsigned int i = 0; i < count; i++) {
+				brick += reader.readVarint();
+				if (brick >= (unsigned int)game.getBrickCount())
+					return -1;
+				if (apply)
+					game.removeBrick(brick);
+			}
+		}
+		if (mask & FRAME_EXTRA) {
+			unsigned int header = reader.readVarint();
+			unsigned int count = header >> 1;
+			if (count > (unsigned int)maxExtraBalls)
+				return -1;
+			if (header & 1) {
+				// where each ball is, displacements to be learnt
+				if (apply)
+					m_extra.resize(count);
+				for (unsigned int i = 0; i < count; i++) {
+					int x = reader.readSigned();
+					int z = reader.readSigned();
+					if (apply) {
+						m_extra[i].x = x;
+						m_extra[i].z = z;
+						m_extra[i].dx = m_extra[i].dz = 0;
+					}
+				}
+			}
+			else {
+				if (apply && count != m_extra.size())
+					return -1;
+				// a ball without an update has a 0 for its flags
+				for (unsigned int i = 0; i < count; i++)
+					readBallUpdate(reader, apply ? &m_extra[i] : 0);
+			}
+		}
+
+		if (!reader.good())
+			return 0;
+		if (pass == 1) {
+			if (apply)
+				place();
+			return (int)reader.getPosition();
+		}
+	}
+	return -1;
+}
+
+void lego::StreamDecoder::place(void)
+{
+	const float scale = 1.0f / streamScale;
+	m_centers.resize(m_extra.size());
+	for (size_t i = 0; i < m_extra.size(); i++)
+		m_centers[i] = Vector3(m_extra[i].x * scale, ballRadius, m_extra[i].z * scale);
+	m_game.placeBalls(Vector3(m_red.x * scale, ballRadius, m_red.z * scale),
+		Vector3(m_grey.x * scale, ballRadius, m_grey.z * scale),
+		m_centers.empty() ? 0 : &m_centers[0], (int)m_centers.size());
+}
+
+// -----------------------------------------------------------------------------
+// StreamPublisher
+// -----------------------------------------------------------------------------
+
+#ifndef _WIN32
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0		// SO_NOSIGPIPE is set on the socket instead
+#endif
+
+static bool makeAddress(const char* path, sockaddr_un& address)
+{
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path))
+		return false;
+	strcpy(address.sun_path, path);
+	return true;
+}
+#endif
+
+lego::StreamPublisher::StreamPublisher(void)
+{
+	m_listener = -1;
+}
+
+lego::StreamPublisher::~StreamPublisher(void)
+{
+	close();
+}
+
+bool lego::StreamPublisher::open(const char* path, const std::vector<unsigned char>& header)
+{
+	close();
+#ifdef _WIN32
+	(void)path;
+	(void)header;
+	return false;
+#else
+	sockaddr_un address;
+	if (!makeAddress(path, address))
+		return false;
+	m_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_listener < 0)
+		return false;
+	unlink(path);
+	if (bind(m_listener, (const sockaddr*)&address, sizeof(address)) != 0 || listen(m_listener, 16) != 0 ||
+		fcntl(m_listener, F_SETFL, fcntl(m_listener, F_GETFL) | O_NONBLOCK) != 0) {
+		::close(m_listener);
+		m_listener = -1;
+		return false;
+	}
+	m_path = path;
+	m_header = header;
+	return true;
+#endif
+}
+
+void lego::StreamPublisher::close(void)
+{
+#ifndef _WIN32
+	for (size_t i = 0; i < m_spectators.size(); i++)
+		::close(m_spectators[i].socket);
+	if (m_listener >= 0) {
+		::close(m_listener);
+		unlink(m_path.c_str());
+	}
+#endif
+	m_spectators.clear();
+	m_listener = -1;
+	m_path.clear();
+}
+
+bool lego::StreamPublisher::accept(void)
+{
+	bool any = false;
+#ifndef _WIN32
+	if (m_listener < 0)
+		return false;
+	for (;;) {
+		int s = ::accept(m_listener, 0, 0);
+		if (s < 0)
+			break;
+		fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+		int on = 1;
+		setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+		Spectator spectator;
+		spectator.socket = s;
+		spectator.synced = false;
+		spectator.pending = m_header;
+		if (flush(spectator)) {
+			m_spectators.push_back(spectator);
+			any = true;
+		}
+		else {
+			::close(s);
+		}
+	}
+#endif
+	return any;
+}
+
+void lego::StreamPublisher::send(const unsigned char* frame, size_t size, bool keyframe)
+{
+#ifdef _WIN32
+	(void)frame;
+	(void)size;
+	(void)keyframe;
+#else
+	size_t kept = 0;
+	for (size_t i = 0; i < m_spectators.size(); i++) {
+		Spectator& spectator = m_spectators[i];
+		spectator.synced = spectator.synced || keyframe;
+		if (spectator.synced)
+			spectator.pending.insert(spectator.pending.end(), frame, frame + size);
+		if (spectator.pending.size() > streamBacklog || !flush(spectator)) {
+			::close(spectator.socket);
+			continue;
+		}
+		if (kept != i)
+			std::swap(m_spectators[kept], spectator);
+		kept++;
+	}
+	m_spectators.resize(kept);
+#endif
+}
+
+bool lego::StreamPublisher::flush(Spectator& spectator)
+{
+#ifdef _WIN32
+	(void)spectator;
+	return false;
+#else
+	size_t sent = 0;
+	while (sent < spectator.pending.size()) {
+		ssize_t n = ::send(spectator.socket, &spectator.pending[sent], spectator.pending.size() - sent, MSG_NOSIGNAL);
+		if (n > 0)
+			sent += (size_t)n;
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+			return false;
+	}
+	spectator.pending.erase(spectator.pending.begin(), spectator.pending.begin() + sent);
+	return true;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// StreamSubscriber
+// -----------------------------------------------------------------------------
+
+lego::StreamSubscriber::StreamSubscriber(void)
+{
+	m_socket = -1;
+}
+
+lego::StreamSubscriber::~StreamSubscriber(void)
+{
+	close();
+}
+
+bool lego::StreamSubscriber::connect(const char* path)
+{
+	close();
+#ifdef _WIN32
+	(void)path;
+	return false;
+#else
+	sockaddr_un address;
+	if (!makeAddress(path, address))
+		return false;
+	m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (m_socket < 0)
+		return false;
+	if (::connect(m_socket, (const sockaddr*)&address, sizeof(address)) != 0) {
+		close();
+		return false;
+	}
+	return true;
+#endif
+}
+
+void lego::StreamSubscriber::close(void)
+{
+#ifndef _WIN32
+	if (m_socket >= 0)
+		::close(m_socket);
+#endif
+	m_socket = -1;
+	m_buffer.clear();
+}
+
+bool lego::StreamSubscriber::receive(StreamDecoder& decoder)
+{
+#ifdef _WIN32
+	(void)decoder;
+	return false;
+#else
+	if (m_socket < 0)
+		return false;
+	unsigned char chunk[4096];
+	ssize_t n;
+	do {
+		n = recv(m_socket, chunk, sizeof(chunk), 0);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return false;
+	m_buffer.insert(m_buffer.end(), chunk, chunk + n);
+
+	size_t used = 0;
+	for (;;) {
+		if (used == m_buffer.size())
+			break;
+		int taken = decoder.decode(&m_buffer[used], m_buffer.size() - used);
+		if (taken < 0)
+			return false;
+		if (taken == 0)
+			break;
+		used += (size_t)taken;
+	}
+	m_buffer.erase(m_buffer.begin(), m_buffer.begin() + used);
+	return true;
+#endif
+}
@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoStream.h
+//
+// Desc: Delta-compressed stream of a running game, for spectators and for
+//       archiving many tables at once. The encoder turns every tick into a
+//       frame holding only what a spectator couldn't predict; the decoder
+//       rebuilds the scene from the frames into a Game that the renderers
+//       and the HUD draw as they draw a played one.
+//
+//       Positions are quantized to 1/4096 of a unit. A ball is predicted
+//       to keep its last displacement per tick, and is only corrected once
+//       the prediction is more than streamTolerance off, or when its
+//       displacement changes for good. A tick in which nothing surprising
+//       happens costs one byte. Life, score, round state and destroyed
+//       bricks are exact.
+//
+//       stream layout, little endian:
+//         header: "LGST", u8 version, f32 tickDelta,
+//                 u32 bricks, bricks * (f32 x, f32 z) as loaded
+//         then one frame per tick: u8 mask, then for each bit set
+//           FRAME_KEY     varint tick, the status, both balls as positions
+//                         and displacements, the alive bricks as runs
+//                         alternately alive and dead, and the extra balls
+//                         as on a count change; nothing else follows
+//           FRAME_RED     the red ball's update, see below
+//           FRAME_GREY    the grey ball's update
+//           FRAME_STATUS  varint life, varint score, u8 round flags
+//           FRAME_BRICKS  varint count, the bricks destroyed as increasing
+//                         indices, each a varint from the one before
+//           FRAME_EXTRA   varint count; with the count unchanged an update
+//                         per ball, otherwise each ball's position
+//         a ball update: u8 (1 = correction, 2 = new displacement), then
+//         the displacement and the correction, each two zigzag varints.
+//
+//       On POSIX systems StreamPublisher serves the stream on a Unix
+//       socket; a spectator that connects gets the header, then frames
+//       from the next keyframe on. StreamSubscriber reads one.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoStreamH__
+#define __legoStreamH__
+
+#include "legoGame.h"
+#include <string>
+#include <vector>
+
+namespace lego
+{
+	// quanta per unit of length
+	const int streamScale = 4096;
+	// quanta a predicted ball may be off before it is corrected
+	const int streamTolerance = 16;
+	// ticks between keyframes by default, 10 s of the game window's ticks
+	const int streamKeyframeInterval = 2400;
+
+	enum StreamFrameBits
+	{
+		FRAME_KEY = 1,
+		FRAME_RED = 2,
+		FRAME_GREY = 4,
+		FRAME_STATUS = 8,
+		FRAME_BRICKS = 16,
+		FRAME_EXTRA = 32
+	};
+
+	// a ball as the decoder sees it, in quanta
+	struct StreamBall
+	{
+		int		x, z;		// where the decoder has it
+		int		dx, dz;		// displacement the decoder predicts per tick
+		// encoder only: the last actual position and displacement
+		int		lastX, lastZ;
+		int		lastDx, lastDz;
+	};
+
+	class StreamEncoder {
+	public:
+		StreamEncoder(void);
+
+		void setKeyframeInterval(int ticks) { m_interval = ticks; }
+		// the next frame is a keyframe, e.g. for a spectator that just came
+		void requestKeyframe(void) { m_keyRequested = true; }
+
+		// header of a stream of game, which must be freshly set up. resets
+		// the encoder, so the first frame is a keyframe.
+		void begin(const Game& game, float tickDelta, std::vector<unsigned char>& header);
+		// appends to out the frame of the tick game just finished. true
+		// when the frame is a keyframe.
+		bool encode(const Game& game, std::vector<unsigned char>& out);
+
+	private:
+		int				m_interval;
+		bool			m_keyRequested;
+		unsigned int	m_tick;
+		unsigned int	m_lastKey;
+
+		// what the decoder has
+		int				m_life, m_score;
+		unsigned char	m_flags;
+		StreamBall		m_red, m_grey;
+		std::vector<StreamBall>		m_extra;
+		std::vector<unsigned char>	m_alive;
+		int				m_aliveCount;
+
+		std::vector<unsigned char>	m_payload;	// scratch
+		std::vector<unsigned int>	m_runs;		// scratch
+
+		void writeKeyframe(const Game& game, std::vector<unsigned char>& out);
+		void writeExtraBalls(const Game& game, std::vector<unsigned char>& out);
+	};
+
+	class StreamDecoder {
+	public:
+		StreamDecoder(void);
+
+		// decodes the header or the frame at the start of data: returns the
+		// bytes it took, 0 if data doesn't hold all of it yet, -1 if data
+		// isn't a stream
+		int decode(const unsigned char* data, size_t size);
+
+		bool hasHeader(void) const { return m_hasHeader; }
+		// false until the first keyframe, the scene is empty before
+		bool isSynced(void) const { return m_synced; }
+		float getTickDelta(void) const { return m_tickDelta; }
+		unsigned int getTick(void) const { return m_tick; }
+
+		// the scene as of the last frame, to draw
+		const Game& getGame(void) const { return m_game; }
+
+	private:
+		bool			m_hasHeader;
+		bool			m_synced;
+		float			m_tickDelta;
+		unsigned int	m_tick;
+		Game			m_game;
+		StreamBall		m_red, m_grey;
+		std::vector<StreamBall>	m_extra;
+		std::vector<Vector3>	m_centers;	// scratch
+
+		int decodeHeader(const unsigned char* data, size_t size);
+		// puts the balls where the decoder has them
+		void place(void);
+
+		StreamDecoder(const StreamDecoder&);
+		StreamDecoder& operator=(const StreamDecoder&);
+	};
+
+	class StreamPublisher {
+	public:
+		StreamPublisher(void);
+		~StreamPublisher(void);
+
+		// listens on a Unix socket at path, replacing what is there. false
+		// on failure, and always where there are no Unix sockets.
+		bool open(const char* path, const std::vector<unsigned char>& header);
+		void close(void);
+
+		// lets in the spectators waiting to connect and sends them the
+		// header. true if any came: the next frame should be a keyframe.
+		bool accept(void);
+		// sends a frame to every spectator that has seen a keyframe, never
+		// waiting. one that falls more than streamBacklog bytes behind is
+		// dropped.
+		void send(const unsigned char* frame, size_t size, bool keyframe);
+
+		int getSpectatorCount(void) const { return (int)m_spectators.size(); }
+
+	private:
+		struct Spectator
+		{
+			int			socket;
+			bool		synced;
+			std::vector<unsigned char>	pending;
+		};
+
+		int			m_listener;
+		std::string	m_path;
+		std::vector<unsigned char>	m_header;
+		std::vector<Spectator>		m_spectators;
+
+		// false once the spectator is gone
+		bool flush(Spectator& spectator);
+
+		StreamPublisher(const StreamPublisher&);
+		StreamPublisher& operator=(const StreamPublisher&);
+	};
+
+	const size_t streamBacklog = 1 << 20;
+
+	class StreamSubscriber {
+	public:
+		StreamSubscriber(void);
+		~StreamSubscriber(void);
+
+		// false on failure, and always where there are no Unix sockets
+		bool connect(const char* path);
+		void close(void);
+
+		// waits for more of the stream and decodes all of it that is
+		// complete. false once the publisher is gone.
+		bool receive(StreamDecoder& decoder);
+
+	private:
+		int			m_socket;
+		std::vector<unsigned char>	m_buffer;	// bytes not decoded yet
+
+		StreamSubscriber(const StreamSubscriber&);
+		StreamSubscriber& operator=(const StreamSubscriber&);
+	};
+}
+
+#endif // __legoStreamH__
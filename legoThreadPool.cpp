@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoThreadPool.cpp
+//
+// Desc: Work-stealing thread pool.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "legoThreadPool.h"
+
+lego::ThreadPool::ThreadPool(int threads)
+	: m_queued(0), m_quit(false)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+
+	// one extra deque for tasks pushed by threads outside the pool
+	for (int i = 0; i <= threads; i++)
+		m_workers.push_back(new Worker);
+	for (int i = 0; i < threads; i++)
+		m_threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+lego::ThreadPool::~ThreadPool(void)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_sleepLock);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	for (size_t i = 0; i < m_workers.size(); i++)
+		delete m_workers[i];
+}
+
+void lego::ThreadPool::push(int worker, const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_workers[worker]->lock);
+		m_workers[worker]->tasks.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> guard(m_sleepLock);
+		m_queued++;
+	}
+	m_wake.notify_one();
+}
+
+bool lego::ThreadPool::take(int worker, Task& task)
+{
+	const int count = (int)m_workers.size();
+
+	// newest of our own tasks, it's still warm in the cache
+	{
+		Worker* own = m_workers[worker];
+		std::lock_guard<std::mutex> guard(own->lock);
+		if (!own->tasks.empty()) {
+			task = own->tasks.back();
+			own->tasks.pop_back();
+			m_queued--;
+			return true;
+		}
+	}
+
+	// steal the oldest task of somebody else
+	for (int i = 1; i < count; i++) {
+		Worker* victim = m_workers[(worker + i) % count];
+		std::lock_guard<std::mutex> guard(victim->lock);
+		if (!victim->tasks.empty()) {
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			m_queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void lego::ThreadPool::workerLoop(int worker)
+{
+	Task task;
+	while (true) {
+		if (take(worker, task)) {
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(m_sleepLock);
+		m_wake.wait(guard, [this] { return m_quit || m_queued > 0; });
+		if (m_quit)
+			return;
+	}
+}
+
+void lego::ThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& body)
+{
+	if (count <= 0)
+		return;
+	if (grain <= 0)
+		grain = 1;
+
+	std::atomic<int> pending((count + grain - 1) / grain);
+
+	// deal the pieces out round-robin, stealing evens out the rest
+	const int external = getThreadCount();
+	int piece = 0;
+	for (int begin = 0; begin < count; begin += grain, piece++) {
+		int end = begin + grain < count ? begin + grain : count;
+		push(piece % (external + 1), [&body, &pending, begin, end] {
+			body(begin, end);
+			pending--;
+		});
+	}
+
+	// help instead of just waiting
+	Task task;
+	while (pending > 0) {
+		if (take(external, task))
+			task();
+		else
+			std::this_thread::yield();
+	}
+}
@@ -0,0 +1,60 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoThreadPool.h
+//
+// Desc: Work-stealing thread pool. Every worker owns a deque of tasks; it
+//       takes work from the back of its own deque and, when that runs dry,
+//       steals from the front of the others, so uneven tasks still keep
+//       all cores busy.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoThreadPoolH__
+#define __legoThreadPoolH__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lego
+{
+	class ThreadPool {
+	public:
+		// threads == 0 uses one thread per core
+		explicit ThreadPool(int threads = 0);
+		~ThreadPool(void);
+
+		int getThreadCount(void) const { return (int)m_threads.size(); }
+
+		// runs body(begin, end) over [0, count) in pieces of at most grain
+		// and returns once all of them are done. the calling thread helps.
+		void parallelFor(int count, int grain, const std::function<void(int, int)>& body);
+
+	private:
+		typedef std::function<void(void)> Task;
+
+		struct Worker
+		{
+			std::mutex			lock;
+			std::deque<Task>	tasks;
+		};
+
+		std::vector<std::thread>	m_threads;
+		std::vector<Worker*>		m_workers;
+		std::mutex					m_sleepLock;
+		std::condition_variable		m_wake;
+		std::atomic<int>			m_queued;
+		std::atomic<bool>			m_quit;
+
+		void push(int worker, const Task& task);
+		// own deque first, then the others
+		bool take(int worker, Task& task);
+		void workerLoop(int worker);
+	};
+}
+
+#endif // __legoThreadPoolH__
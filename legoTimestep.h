@@ -0,0 +1,64 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// File: legoTimestep.h
+//
+// Desc: Fixed-tick accumulator. Real elapsed time is fed in, and the number
+//       of constant-size simulation ticks to run is handed back, together
+//       with how far the frame lies between the last two ticks so that the
+//       renderer can interpolate instead of forcing extra physics work.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __legoTimestepH__
+#define __legoTimestepH__
+
+#include <cmath>
+
+namespace lego
+{
+	class FixedTimestep {
+	public:
+		FixedTimestep(float tickRate = 240.0f, int maxTicksPerFrame = 8)
+		{
+			setTickRate(tickRate);
+			m_maxTicksPerFrame = maxTicksPerFrame;
+			m_accumulator = 0.0;
+		}
+
+		void setTickRate(float tickRate) { m_tickDelta = 1.0 / tickRate; }
+		float getTickDelta(void) const { return (float)m_tickDelta; }
+
+		// catch-up limit: if a frame took too long the excess time is dropped
+		// instead of being simulated, so a slow frame can't snowball
+		void setMaxTicksPerFrame(int maxTicks) { m_maxTicksPerFrame = maxTicks; }
+
+		// feed the real time since the last call, returns ticks to simulate
+		int advance(double elapsed)
+		{
+			if (elapsed > 0.0)
+				m_accumulator += elapsed;
+
+			int ticks = (int)(m_accumulator / m_tickDelta);
+			if (ticks > m_maxTicksPerFrame) {
+				ticks = m_maxTicksPerFrame;
+				m_accumulator = fmod(m_accumulator, m_tickDelta);
+			}
+			else {
+				m_accumulator -= ticks * m_tickDelta;
+			}
+			return ticks;
+		}
+
+		// 0 = state of the previous tick, 1 = state of the last tick
+		float getAlpha(void) const { return (float)(m_accumulator / m_tickDelta); }
+
+		void reset(void) { m_accumulator = 0.0; }
+
+	private:
+		double	m_tickDelta;
+		double	m_accumulator;
+		int		m_maxTicksPerFrame;
+	};
+}
+
+#endif // __legoTimestepH__
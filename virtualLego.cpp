@@ -11,10 +11,18 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include "legoGame.h"
+#include "legoHud.h"
+#include "legoProfile.h"
+#include "legoRender.h"
+#include "legoReplay.h"
+#include "legoSimThread.h"
+#include "legoTimestep.h"
 #include <vector>
 #include <ctime>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 #include <cmath>
 
@@ -24,376 +32,181 @@ IDirect3DDevice9* Device = NULL;
 const int Width  = 1024;
 const int Height = 768;
 
-// There are 20 balls
-// initialize the position (coordinate) of each ball
-const int totalBalls = 20;
-const float spherePos[totalBalls][2] = {
-	{-2.f, 4.0f} , {-1.5f,4.0f} , {0.0f,4.0f} , {1.5f,4.0f}, {2.0f,4.0f},
-	{-2.f,3.0f} , {-1.0f,3.0f} , {0.0f,3.0f} , {1.0f,3.0f}, {2.0f,3.0f},
-	{-2.f,2.0f} , {-1.0f,2.0f} , {0.0f,2.0f} , {1.0f,2.0f}, {2.0f,2.0f},
-	{-2.f,1.0f} , {-1.5f,1.0f} , {0.0f,1.0f} , {1.5f,1.0f}, {2.0f,1.0f},
-}; 
-// initialize the color of each ball
-const D3DXCOLOR ballColor = d3d::YELLOW;
-
 // -----------------------------------------------------------------------------
 // Transform matrices
 // -----------------------------------------------------------------------------
 D3DXMATRIX g_mWorld;
-D3DXMATRIX g_mView;
-D3DXMATRIX g_mProj;
-
-#define M_RADIUS 0.21   // ball radius
-#define PI 3.14159265
-#define M_HEIGHT 0.01
-#define DECREASE_RATE 0.9982
-
-#define KEYSTEP 0.1
-#define REDBALLSPEED 30.0
-#define MAXSCORE 200
-
-// global constants
-const float initialGreyBallPosZ = -4.0f + (float)M_RADIUS + 0.05f;
-const float initialRedBallPosZ = initialGreyBallPosZ + (float)M_RADIUS * 2 + 0.05f;
-const float horizontalBarWidth = 6.0f;
-const float verticalBarDepth = 9.0f;
-const float wallThickness = 0.12f;
-int life = 5;
-int score = 0;
-bool isRoundStarted = false;
-bool isGameEnded = false;
+lego::Matrix4 g_mView;
+lego::Matrix4 g_mProj;
+
+// lego matrices share the layout of D3DMATRIX and go to the device as they are
+static_assert(sizeof(lego::Matrix4) == sizeof(D3DMATRIX), "lego::Matrix4 must match D3DMATRIX");
+
+// all game rules live in the portable core, this file only draws them
+lego::Game g_game;
+
+// the simulation runs at a fixed rate on a thread of its own, independent of
+// how fast frames are presented
+const float SIM_TICK_RATE = 240.0f;			// ticks per second
+const int   SIM_MAX_TICKS_PER_FRAME = 8;	// catch-up limit
+const float SIM_TIME_SCALE = 0.1f;			// game time per second of real time
+
+// balls released by a power-up brick, 0 for the classic single ball game.
+// the multi-ball mode is only played when asked for on the command line:
+// virtualLego -m balls [log]
+int g_multiBall = 0;
+const int MAX_MULTI_BALL = 255;
+
+// every key press is logged with its tick, so the session can be replayed
+// headless with legoHeadless -r. saved on exit when a path is given on the
+// command line.
+lego::InputRecorder g_recorder;
+const char* g_recordPath = NULL;
+
+// owns g_game and g_recorder while the message loop runs.
+// frames draw its snapshots, key presses are posted to it.
+lego::SimulationThread g_sim(g_game, g_recorder);
+
+// F2 turns the profiler on: a rolling breakdown of the frame in the top
+// right corner, and a Chrome trace of every zone it timed, written to
+// PROFILE_TRACE_PATH when F2 turns it off again
+const char* PROFILE_TRACE_PATH = "virtualLego.trace.json";
+const size_t PROFILE_MAX_TRACE_ZONES = 1 << 20;		// the first minute or so
+const long long PROFILE_OVERLAY_PERIOD = 500000000;	// ns between updates of the breakdown
+lego::ProfileSummary g_profileSummary;
+std::vector<lego::ProfileZone> g_profileFrame;
+std::vector<lego::ProfileZone> g_profileTrace;
+long long g_profileShown = 0;
 
 // -----------------------------------------------------------------------------
-// CSphere class definition
+// CD3DBackend class definition
 // -----------------------------------------------------------------------------
 
-class CSphere {
-private :
-	float					center_x, center_y, center_z;
-    float                   m_radius;
-	float					m_velocity_x;
-	float					m_velocity_z;
-
+// plays the sorted draw commands of a frame on the device, with one mesh per
+// shape and one material per color shared by every object using them. the
+// fixed-function pipeline has no instancing, so an instanced draw is one
+// SetTransform and DrawSubset per copy, without any state change in between.
+class CD3DBackend : public lego::RenderBackend {
 public:
-    CSphere(void)
+    CD3DBackend(void)
     {
-        D3DXMatrixIdentity(&m_mLocal);
-        ZeroMemory(&m_mtrl, sizeof(m_mtrl));
-        m_radius = 0;
-		m_velocity_x = 0;
-		m_velocity_z = 0;
-        m_pSphereMesh = NULL;
+        m_pDevice = NULL;
+        m_pMesh = NULL;
+        ZeroMemory(m_pMeshes, sizeof(m_pMeshes));
+        ZeroMemory(m_mtrl, sizeof(m_mtrl));
     }
-    ~CSphere(void) {}
-
+    ~CD3DBackend(void) {}
 public:
-    bool create(IDirect3DDevice9* pDevice, D3DXCOLOR color = d3d::WHITE)
+    bool create(IDirect3DDevice9* pDevice)
     {
+        int i;
+
         if (NULL == pDevice)
             return false;
-		
-        m_mtrl.Ambient  = color;
-        m_mtrl.Diffuse  = color;
-        m_mtrl.Specular = color;
-        m_mtrl.Emissive = d3d::BLACK;
-        m_mtrl.Power    = 5.0f;
-		
-        if (FAILED(D3DXCreateSphere(pDevice, getRadius(), 50, 50, &m_pSphereMesh, NULL)))
-            return false;
+        m_pDevice = pDevice;
+
+        // every level of detail; the boxes have one, shared by all levels
+        for (i = 0; i < lego::MESH_COUNT; i++) {
+            const lego::MeshData* pPrevious = NULL;
+            for (int lod = 0; lod < lego::meshLodCount; lod++) {
+                const lego::MeshData& data = m_meshCache.get(lego::getMeshShape((lego::RenderMesh)i, lod));
+                if (&data == pPrevious) {
+                    m_pMeshes[i][lod] = m_pMeshes[i][lod - 1];
+                    m_pMeshes[i][lod]->AddRef();
+                    continue;
+                }
+                if (!createMesh(data, &m_pMeshes[i][lod]))
+                    return false;
+                pPrevious = &data;
+            }
+        }
+
+        for (i = 0; i < lego::MATERIAL_COUNT; i++) {
+            lego::MaterialDesc desc = lego::getMaterial((lego::RenderMaterial)i);
+            D3DXCOLOR color((D3DCOLOR)(0xff000000 | desc.color));
+            m_mtrl[i] = d3d::InitMtrl(color, color, color, d3d::BLACK, desc.power);
+        }
         return true;
     }
-	
+
     void destroy(void)
     {
-        if (m_pSphereMesh != NULL) {
-            m_pSphereMesh->Release();
-            m_pSphereMesh = NULL;
+        for (int i = 0; i < lego::MESH_COUNT; i++) {
+            for (int lod = 0; lod < lego::meshLodCount; lod++) {
+                if (m_pMeshes[i][lod] != NULL) {
+                    m_pMeshes[i][lod]->Release();
+                    m_pMeshes[i][lod] = NULL;
+                }
+            }
         }
+        m_pMesh = NULL;
     }
 
-    void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
+    virtual void setMesh(lego::RenderMesh mesh, int lod)
     {
-        if (NULL == pDevice)
-            return;
-        pDevice->SetTransform(D3DTS_WORLD, &mWorld);
-        pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-        pDevice->SetMaterial(&m_mtrl);
-		m_pSphereMesh->DrawSubset(0);
+        m_pMesh = m_pMeshes[mesh][lod];
     }
-	
-    bool hasIntersected(CSphere& ball) 
-	{
-		// Insert your code here.
-		if (originDistanceFrom(ball) <= 0.42) {
-			return true;
-		}
-		else {
-			return false;
-		}
-	}
-	
-	void hitBy(CSphere& ball) 
-	{ 
-		// Insert your code here.
-		if (hasIntersected(ball)) {
-			// I think that if one of the ball intersected is yellow, then distroy that and save the grey ball.
-			float vXAfterCollision = (ball.getVelocity_X() + m_velocity_x) * ball.getVelocity_X()/ball.getVelocity_Z();
-			float vZAfterCollision = (ball.getVelocity_Z() + m_velocity_z);
-			if ((D3DXCOLOR)m_mtrl.Ambient == (D3DXCOLOR)d3d::YELLOW) {
-				ball.setPower(-vXAfterCollision, -vZAfterCollision);
-				this->setCenter(center_x, -500.0f, center_z);
-				score += 10;
-			}
-			else if ((D3DXCOLOR)ball.m_mtrl.Ambient == (D3DXCOLOR)d3d::YELLOW) {
-				this->setPower(-vXAfterCollision, -vZAfterCollision);
-				ball.setCenter(center_x, -500.0f, center_z);
-				score += 10;
-			}
-			// else, it is collision of grey and red balls.
-			else {
-				if ((D3DXCOLOR)ball.m_mtrl.Ambient == (D3DXCOLOR)d3d::RED) {
-					ball.setPower(ball.m_velocity_x, -1 * ball.m_velocity_z);
-				}
-			}
-			if (score >= (int)MAXSCORE) {
-				ball.setPower(0.0, 0.0);
-				isRoundStarted = false;
-				isGameEnded = true;
-			}
-		}
-	}
-
-	void ballUpdate(float timeDiff) 
-	{
-		const float TIME_SCALE = 3.3;
-		D3DXVECTOR3 cord = this->getCenter();
-		double vx = abs(this->getVelocity_X());
-		double vz = abs(this->getVelocity_Z());
-
-		if(vx > 0.01 || vz > 0.01)
-		{
-			float tX = cord.x + TIME_SCALE*timeDiff*m_velocity_x;
-			float tZ = cord.z + TIME_SCALE*timeDiff*m_velocity_z;
-
-			//correction of position of ball
-			// Please uncomment this part because this correction of ball position is necessary when a ball collides with a wall
-			float xBound = horizontalBarWidth / 2 - wallThickness / 2;
-			float zBound = verticalBarDepth / 2 - wallThickness / 2;
-			if(tX >= (xBound - M_RADIUS))
-				tX = xBound - M_RADIUS;
-			else if(tX <= (-1 * xBound + M_RADIUS))
-				tX = -xBound + M_RADIUS;
-			else if(tZ <= (-1 * zBound + M_RADIUS))
-				tZ = -zBound + M_RADIUS;
-			else if(tZ >= (zBound - M_RADIUS))
-				tZ = zBound - M_RADIUS;
-			
-			this->setCenter(tX, cord.y, tZ);
-		}
-		else { this->setPower(0,0);}
-		double rate = 1 -  (1 - DECREASE_RATE)*timeDiff;
-		if(rate < 0 )
-			rate = 0;
-		this->setPower(getVelocity_X(), getVelocity_Z());
-	}
 
-	double getVelocity_X() { return this->m_velocity_x;	}
-	void setVelocity_X(float velocity_x) {
-		this->m_velocity_x = velocity_x;
-	}
-	double getVelocity_Z() { return this->m_velocity_z; }
-	void setVelocity_Z(float velocity_z) {
-		this->m_velocity_z = velocity_z;
-	}
-
-	void setPower(double vx, double vz)
-	{
-		this->m_velocity_x = vx;
-		this->m_velocity_z = vz;
-	}
-
-	void setCenter(float x, float y, float z)
-	{
-		D3DXMATRIX m;
-		center_x=x;	center_y=y;	center_z=z;
-		D3DXMatrixTranslation(&m, x, y, z);
-		setLocalTransform(m);
-	}
-	
-	float getRadius(void)  const { return (float)(M_RADIUS);  }
-    const D3DXMATRIX& getLocalTransform(void) const { return m_mLocal; }
-    void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
-    D3DXVECTOR3 getCenter(void) const
+    virtual void setMaterial(lego::RenderMaterial material)
     {
-        D3DXVECTOR3 org(center_x, center_y, center_z);
-        return org;
+        m_pDevice->SetMaterial(&m_mtrl[material]);
     }
 
-	D3DXCOLOR getColor(void) {
-		return (D3DXCOLOR)m_mtrl.Ambient;
-	}
-	
-private:
-    D3DXMATRIX              m_mLocal;
-    D3DMATERIAL9            m_mtrl;
-    ID3DXMesh*              m_pSphereMesh;
-	
-	float originDistanceFrom(CSphere& ball) {
-		double xSq = pow((center_x - ball.center_x), 2);
-		double ySq = pow((center_y - ball.center_y), 2);
-		double zSq = pow((center_z - ball.center_z), 2);
-		float centerDistance = (float)sqrt((xSq + ySq + zSq));
-		return centerDistance;
-	};
-};
-
-
-
-// -----------------------------------------------------------------------------
-// CWall class definition
-// -----------------------------------------------------------------------------
-
-class CWall {
-
-private:
-	
-    float					m_x;
-	float					m_z;
-	float                   m_width;
-    float                   m_depth;
-	float					m_height;
-	
-public:
-    CWall(void)
+    virtual void drawInstances(const float* positions, int count)
     {
-        D3DXMatrixIdentity(&m_mLocal);
-        ZeroMemory(&m_mtrl, sizeof(m_mtrl));
-        m_width = 0;
-        m_depth = 0;
-        m_pBoundMesh = NULL;
-    }
-    ~CWall(void) {}
-public:
-    bool create(IDirect3DDevice9* pDevice, float ix, float iz, float iwidth, float iheight, float idepth, D3DXCOLOR color = d3d::WHITE)
-    {
-        if (NULL == pDevice)
-            return false;
-		
-        m_mtrl.Ambient  = color;
-        m_mtrl.Diffuse  = color;
-        m_mtrl.Specular = color;
-        m_mtrl.Emissive = d3d::BLACK;
-        m_mtrl.Power    = 5.0f;
-		
-        m_width = iwidth;
-        m_depth = idepth;
-		
-        if (FAILED(D3DXCreateBox(pDevice, iwidth, iheight, idepth, &m_pBoundMesh, NULL)))
-            return false;
-        return true;
-    }
-    void destroy(void)
-    {
-        if (m_pBoundMesh != NULL) {
-            m_pBoundMesh->Release();
-            m_pBoundMesh = NULL;
+        if (m_world.size() < (size_t)count)
+            m_world.resize(count);
+        lego::makeTranslations(positions, count, &m_world[0]);
+        for (int i = 0; i < count; i++) {
+            m_pDevice->SetTransform(D3DTS_WORLD, (const D3DMATRIX*)&m_world[i]);
+            m_pMesh->DrawSubset(0);
         }
     }
-    void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
+
+private:
+    // copies a cache mesh into a managed ID3DXMesh, keeping its optimized order
+    bool createMesh(const lego::MeshData& data, ID3DXMesh** ppMesh)
     {
-        if (NULL == pDevice)
-            return;
-        pDevice->SetTransform(D3DTS_WORLD, &mWorld);
-        pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-        pDevice->SetMaterial(&m_mtrl);
-		m_pBoundMesh->DrawSubset(0);
-    }
-	
-	bool hasIntersected(CSphere& ball)
-	{
-		// Insert your code here.
-		D3DXVECTOR3 ballCenter = ball.getCenter();
-		if (isWide()) {
-			float distance = abs(ballCenter.z - m_z);
-			if (distance <= (float)(M_RADIUS + m_depth/2)) {
-				return true;
-			}
-			else {
-				return false;
-			}
-		}
-		else if (isTall()) {
-			float distance = abs(ballCenter.x - m_x);
-			if (distance <= (float)(M_RADIUS + m_width/2)) {
-				return true;
-			}
-			else {
-				return false;
-			}
-		}
-	}
+        struct Vertex { float x, y, z, nx, ny, nz; };
+        const int vertices = data.getVertexCount();
+        const int triangles = data.getTriangleCount();
+        int i;
 
-	void hitBy(CSphere& ball) 
-	{
-		// Insert your code here.
-		if (hasIntersected(ball)) {
-			// reflect the ball.
-			if (isWide()) {
-				D3DXVECTOR3 ballCenter = ball.getCenter();
-				float zBound = (float)(m_z - wallThickness); 
-				ball.setVelocity_Z(-1 * ball.getVelocity_Z());
-				ball.setCenter(ballCenter.x, ballCenter.y, zBound - M_RADIUS - 0.05);
-			}
-			else if (isTall()) {
-				D3DXVECTOR3 ballCenter = ball.getCenter();
-				float intersectedBallPos = m_x > 0 ? m_x - wallThickness/2 - M_RADIUS - 0.05 : m_x + wallThickness/2 + M_RADIUS + 0.05;
-				ball.setVelocity_X(-1 * ball.getVelocity_X());
-				ball.setCenter(intersectedBallPos, ballCenter.y, ballCenter.z);
-			}
-		}
-	}    
-	
-	void setPosition(float x, float y, float z)
-	{
-		D3DXMATRIX m;
-		this->m_x = x;
-		this->m_z = z;
+        if (FAILED(D3DXCreateMeshFVF(triangles, vertices, D3DXMESH_MANAGED,
+                D3DFVF_XYZ | D3DFVF_NORMAL, m_pDevice, ppMesh)))
+            return false;
 
-		D3DXMatrixTranslation(&m, x, y, z);
-		setLocalTransform(m);
-	}
+        Vertex* pVertices = NULL;
+        (*ppMesh)->LockVertexBuffer(0, (void**)&pVertices);
+        for (i = 0; i < vertices; i++) {
+            pVertices[i].x = data.position[i * 3];
+            pVertices[i].y = data.position[i * 3 + 1];
+            pVertices[i].z = data.position[i * 3 + 2];
+            pVertices[i].nx = data.normal[i * 3];
+            pVertices[i].ny = data.normal[i * 3 + 1];
+            pVertices[i].nz = data.normal[i * 3 + 2];
+        }
+        (*ppMesh)->UnlockVertexBuffer();
+
+        WORD* pIndices = NULL;
+        (*ppMesh)->LockIndexBuffer(0, (void**)&pIndices);
+        memcpy(pIndices, &data.index[0], data.index.size() * sizeof(WORD));
+        (*ppMesh)->UnlockIndexBuffer();
+
+        DWORD* pAttributes = NULL;
+        (*ppMesh)->LockAttributeBuffer(0, &pAttributes);
+        for (i = 0; i < triangles; i++)
+            pAttributes[i] = 0;
+        (*ppMesh)->UnlockAttributeBuffer();
+        return true;
+    }
 
-	float getPositionX(void) const { return m_x; }
-	float getPositionZ(void) const { return m_z; }
-	
-    float getHeight(void) const { return M_HEIGHT; }
-	float getWidth(void) const { return m_width; }
-	
-	
-	
-private :
-    void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
-	
-	D3DXMATRIX              m_mLocal;
-    D3DMATERIAL9            m_mtrl;
-    ID3DXMesh*              m_pBoundMesh;
-
-	bool isWide() {
-		if (m_width > m_depth) {
-			return true;
-		}
-		else {
-			return false;
-		}
-	};
-	bool isTall() {
-		if (m_depth > m_width) {
-			return true;
-		}
-		else {
-			return false;
-		}
-	};
+    IDirect3DDevice9*       m_pDevice;
+    lego::MeshCache         m_meshCache;
+    ID3DXMesh*              m_pMeshes[lego::MESH_COUNT][lego::meshLodCount];
+    ID3DXMesh*              m_pMesh;
+    D3DMATERIAL9            m_mtrl[lego::MATERIAL_COUNT];
+    std::vector<lego::Matrix4>  m_world;    // one per instance of the current draw
 };
 
 // -----------------------------------------------------------------------------
@@ -408,7 +221,6 @@ public:
         m_index = i++;
         D3DXMatrixIdentity(&m_mLocal);
         ::ZeroMemory(&m_lit, sizeof(m_lit));
-        m_pMesh = NULL;
         m_bound._center = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
         m_bound._radius = 0.0f;
     }
@@ -418,12 +230,10 @@ public:
     {
         if (NULL == pDevice)
             return false;
-        if (FAILED(D3DXCreateSphere(pDevice, radius, 10, 10, &m_pMesh, NULL)))
-            return false;
-		
+
         m_bound._center = lit.Position;
         m_bound._radius = radius;
-		
+
         m_lit.Type          = lit.Type;
         m_lit.Diffuse       = lit.Diffuse;
         m_lit.Specular      = lit.Specular;
@@ -439,62 +249,235 @@ public:
         m_lit.Phi           = lit.Phi;
         return true;
     }
-    void destroy(void)
-    {
-        if (m_pMesh != NULL) {
-            m_pMesh->Release();
-            m_pMesh = NULL;
-        }
-    }
     bool setLight(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
     {
         if (NULL == pDevice)
             return false;
-		
+
         D3DXVECTOR3 pos(m_bound._center);
         D3DXVec3TransformCoord(&pos, &pos, &m_mLocal);
         D3DXVec3TransformCoord(&pos, &pos, &mWorld);
         m_lit.Position = pos;
-		
+
         pDevice->SetLight(m_index, &m_lit);
         pDevice->LightEnable(m_index, TRUE);
         return true;
     }
 
-    void draw(IDirect3DDevice9* pDevice)
-    {
-        if (NULL == pDevice)
-            return;
-        D3DXMATRIX m;
-        D3DXMatrixTranslation(&m, m_lit.Position.x, m_lit.Position.y, m_lit.Position.z);
-        pDevice->SetTransform(D3DTS_WORLD, &m);
-        pDevice->SetMaterial(&d3d::WHITE_MTRL);
-        m_pMesh->DrawSubset(0);
-    }
-
     D3DXVECTOR3 getPosition(void) const { return D3DXVECTOR3(m_lit.Position); }
 
 private:
     DWORD               m_index;
     D3DXMATRIX          m_mLocal;
     D3DLIGHT9           m_lit;
-    ID3DXMesh*          m_pMesh;
     d3d::BoundingSphere m_bound;
 };
 
+// -----------------------------------------------------------------------------
+// CGdiGlyphSource class definition
+// -----------------------------------------------------------------------------
+
+// rasterizes the HUD glyphs with GDI in bold Arial, as D3DXCreateFont did
+class CGdiGlyphSource : public lego::GlyphSource {
+public:
+    CGdiGlyphSource(void)
+    {
+        m_hdc = CreateCompatibleDC(NULL);
+        for (int i = 0; i < lego::HUD_FONT_COUNT; i++) {
+            m_hFonts[i] = CreateFont(lego::getHudFontHeight((lego::HudFont)i), 0, 0, 0, FW_BOLD,
+                FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                ANTIALIASED_QUALITY, DEFAULT_PITCH | FF_DONTCARE, TEXT("Arial"));
+        }
+    }
+    ~CGdiGlyphSource(void)
+    {
+        for (int i = 0; i < lego::HUD_FONT_COUNT; i++)
+            DeleteObject(m_hFonts[i]);
+        DeleteDC(m_hdc);
+    }
+public:
+    virtual int getAscent(lego::HudFont font)
+    {
+        TEXTMETRIC tm;
+        SelectObject(m_hdc, m_hFonts[font]);
+        GetTextMetrics(m_hdc, &tm);
+        return tm.tmAscent;
+    }
+
+    virtual bool rasterize(lego::HudFont font, char c, lego::GlyphBitmap& glyph)
+    {
+        static const MAT2 identity = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+        GLYPHMETRICS gm;
+
+        SelectObject(m_hdc, m_hFonts[font]);
+        DWORD size = GetGlyphOutlineA(m_hdc, (UCHAR)c, GGO_GRAY8_BITMAP, &gm, 0, NULL, &identity);
+        if (size == GDI_ERROR)
+            return false;
+
+        glyph.originX = gm.gmptGlyphOrigin.x;
+        glyph.originY = gm.gmptGlyphOrigin.y;
+        glyph.advance = gm.gmCellIncX;
+        glyph.width = glyph.height = 0;
+        glyph.alpha.clear();
+        if (size == 0)      // blank, like a space
+            return true;
+
+        std::vector<BYTE> buffer(size);
+        if (GetGlyphOutlineA(m_hdc, (UCHAR)c, GGO_GRAY8_BITMAP, &gm, size, &buffer[0], &identity) == GDI_ERROR)
+            return false;
+
+        // 65 levels of gray, rows padded to a DWORD
+        const int pitch = (gm.gmBlackBoxX + 3) & ~3;
+        glyph.width = gm.gmBlackBoxX;
+        glyph.height = gm.gmBlackBoxY;
+        glyph.alpha.resize(glyph.width * glyph.height);
+        for (int y = 0; y < glyph.height; y++) {
+            for (int x = 0; x < glyph.width; x++)
+                glyph.alpha[y * glyph.width + x] = (unsigned char)(buffer[y * pitch + x] * 255 / 64);
+        }
+        return true;
+    }
+
+private:
+    HDC     m_hdc;
+    HFONT   m_hFonts[lego::HUD_FONT_COUNT];
+};
+
+// -----------------------------------------------------------------------------
+// CHudRenderer class definition
+// -----------------------------------------------------------------------------
+
+// the HUD texts as textured quads over the scene, all in one draw. the
+// vertices are only rebuilt when the HUD lays something out again.
+class CHudRenderer {
+public:
+    CHudRenderer(void)
+    {
+        m_pTexture = NULL;
+        m_pHud = NULL;
+    }
+    ~CHudRenderer(void) {}
+public:
+    bool create(IDirect3DDevice9* pDevice)
+    {
+        if (NULL == pDevice)
+            return false;
+
+        CGdiGlyphSource source;
+        if (!m_atlas.build(source))
+            return false;
+
+        if (FAILED(pDevice->CreateTexture(m_atlas.getWidth(), m_atlas.getHeight(), 1, 0,
+                D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &m_pTexture, NULL)))
+            return false;
+
+        // white, the coverage in alpha; the color comes from the vertices
+        D3DLOCKED_RECT locked;
+        if (FAILED(m_pTexture->LockRect(0, &locked, NULL, 0)))
+            return false;
+        const unsigned char* pAlpha = m_atlas.getPixels();
+        for (int y = 0; y < m_atlas.getHeight(); y++) {
+            DWORD* pRow = (DWORD*)((BYTE*)locked.pBits + y * locked.Pitch);
+            for (int x = 0; x < m_atlas.getWidth(); x++)
+                pRow[x] = ((DWORD)pAlpha[y * m_atlas.getWidth() + x] << 24) | 0x00ffffff;
+        }
+        m_pTexture->UnlockRect(0);
+
+        m_pHud = new lego::Hud(m_atlas);
+        return true;
+    }
+
+    void destroy(void)
+    {
+        if (m_pTexture != NULL) {
+            m_pTexture->Release();
+            m_pTexture = NULL;
+        }
+        delete m_pHud;
+        m_pHud = NULL;
+    }
+
+    void draw(IDirect3DDevice9* pDevice, const lego::RenderState& state)
+    {
+        if (m_pHud->update(state))
+            buildVertices();
+        if (m_vertices.empty())
+            return;
+
+        pDevice->SetRenderState(D3DRS_LIGHTING, FALSE);
+        pDevice->SetRenderState(D3DRS_ZENABLE, FALSE);
+        pDevice->SetRenderState(D3DRS_ALPHABLENDENABLE, TRUE);
+        pDevice->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_SRCALPHA);
+        pDevice->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+        pDevice->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_SELECTARG2);
+        pDevice->SetTextureStageState(0, D3DTSS_COLORARG2, D3DTA_DIFFUSE);
+        pDevice->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_MODULATE);
+        pDevice->SetTextureStageState(0, D3DTSS_ALPHAARG1, D3DTA_TEXTURE);
+        pDevice->SetTextureStageState(0, D3DTSS_ALPHAARG2, D3DTA_DIFFUSE);
+        pDevice->SetTexture(0, m_pTexture);
+        pDevice->SetFVF(HudVertex::FVF);
+
+        pDevice->DrawPrimitiveUP(D3DPT_TRIANGLELIST, (UINT)m_vertices.size() / 3,
+            &m_vertices[0], sizeof(HudVertex));
+
+        pDevice->SetTexture(0, NULL);
+        pDevice->SetTextureStageState(0, D3DTSS_COLOROP, D3DTOP_MODULATE);
+        pDevice->SetTextureStageState(0, D3DTSS_COLORARG2, D3DTA_CURRENT);
+        pDevice->SetTextureStageState(0, D3DTSS_ALPHAOP, D3DTOP_SELECTARG1);
+        pDevice->SetTextureStageState(0, D3DTSS_ALPHAARG2, D3DTA_CURRENT);
+        pDevice->SetRenderState(D3DRS_ALPHABLENDENABLE, FALSE);
+        pDevice->SetRenderState(D3DRS_ZENABLE, TRUE);
+        pDevice->SetRenderState(D3DRS_LIGHTING, TRUE);
+    }
+
+    void setOverlay(const char* text)
+    {
+        if (m_pHud->setOverlay(text))
+            buildVertices();
+    }
+
+private:
+    struct HudVertex
+    {
+        float   x, y, z, rhw;
+        DWORD   color;
+        float   u, v;
+        enum { FVF = D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_TEX1 };
+    };
+
+    // two triangles per quad, moved half a pixel so texels map to pixels
+    void buildVertices(void)
+    {
+        const std::vector<lego::HudQuad>& quads = m_pHud->getQuads();
+        m_vertices.resize(quads.size() * 6);
+        for (size_t i = 0; i < quads.size(); i++) {
+            const lego::HudQuad& q = quads[i];
+            const HudVertex corners[4] = {
+                { q.left - 0.5f, q.top - 0.5f, 0.0f, 1.0f, q.color, q.u0, q.v0 },
+                { q.right - 0.5f, q.top - 0.5f, 0.0f, 1.0f, q.color, q.u1, q.v0 },
+                { q.right - 0.5f, q.bottom - 0.5f, 0.0f, 1.0f, q.color, q.u1, q.v1 },
+                { q.left - 0.5f, q.bottom - 0.5f, 0.0f, 1.0f, q.color, q.u0, q.v1 },
+            };
+            HudVertex* v = &m_vertices[i * 6];
+            v[0] = corners[0];  v[1] = corners[1];  v[2] = corners[2];
+            v[3] = corners[0];  v[4] = corners[2];  v[5] = corners[3];
+        }
+    }
+
+    lego::GlyphAtlas        m_atlas;
+    lego::Hud*              m_pHud;
+    IDirect3DTexture9*      m_pTexture;
+    std::vector<HudVertex>  m_vertices;
+};
+
 
 // -----------------------------------------------------------------------------
 // Global variables
 // -----------------------------------------------------------------------------
-CWall	g_legoPlane;
-CWall	g_legowall[3];
-CSphere	g_sphere[totalBalls];
-CSphere	g_target_greyball;
-CSphere g_target_redball;
+CD3DBackend	g_backend;
+lego::CommandBuffer	g_commands;	// recorded again every frame
 CLight	g_light;
-CWall g_legoLine;
-
-LPD3DXFONT g_Lifecount, g_gameover, g_LifeLabel, g_StartLabel, g_gameclear;
+CHudRenderer	g_hud;
 
 double g_camera_pos[3] = {0.0, 5.0, -8.0};
 
@@ -503,311 +486,163 @@ double g_camera_pos[3] = {0.0, 5.0, -8.0};
 // -----------------------------------------------------------------------------
 
 
-void destroyAllLegoBlock(void)
+// blend between the previous and the current tick. a ball that was reset
+// jumps instead of sliding across the table.
+lego::Vector3 interpolateCenter(const lego::Vector3& prev, const lego::Vector3& curr, float alpha)
 {
-	for (int i = 0; i < totalBalls; i++) {
-		g_sphere[i].destroy();
-	}
+	float dx = curr.x - prev.x;
+	float dz = curr.z - prev.z;
+	if (dx * dx + dz * dz > 1.0f)
+		return curr;
+	return lego::Vector3(prev.x + dx * alpha, prev.y + (curr.y - prev.y) * alpha, prev.z + dz * alpha);
 }
 
 // initialization
 bool Setup()
 {
-	int i;
-	
     D3DXMatrixIdentity(&g_mWorld);
-    D3DXMatrixIdentity(&g_mView);
-    D3DXMatrixIdentity(&g_mProj);
-		
-	// create plane and set the position
-    if (false == g_legoPlane.create(Device, -1, -1, 6, 0.03f, 9, d3d::GREEN)) return false;
-    g_legoPlane.setPosition(0.0f, -0.0006f / 5, 0.0f);
-
-	// create line and set the postion
-	if (false == g_legoLine.create(Device, -1, -1, 6, 0.1f, 0.1f, d3d::BLUE)) return false;
-	g_legoLine.setPosition(0.0f, -0.0006f / 5, initialGreyBallPosZ);
-	
-	// create walls and set the position. note that there are four walls
-	if (false == g_legowall[0].create(Device, -1, -1, horizontalBarWidth, 0.3f, wallThickness, d3d::DARKRED)) return false;
-	g_legowall[0].setPosition(0.0f, wallThickness, verticalBarDepth/2);
-	if (false == g_legowall[1].create(Device, -1, -1, wallThickness, 0.3f, verticalBarDepth, d3d::DARKRED)) return false;
-	g_legowall[1].setPosition(horizontalBarWidth/2, wallThickness, 0.0f);
-	if (false == g_legowall[2].create(Device, -1, -1, wallThickness, 0.3f, verticalBarDepth, d3d::DARKRED)) return false;
-	g_legowall[2].setPosition(-horizontalBarWidth/2, wallThickness, 0.0f);
-
-	// create all balls and set the position
-	for (i=0;i<totalBalls;i++) {
-		if (false == g_sphere[i].create(Device, ballColor)) return false;
-		g_sphere[i].setCenter(spherePos[i][0], (float)M_RADIUS , spherePos[i][1]);
-		g_sphere[i].setPower(0,0);
-	}
-	
-	// create red ball for set direction
-	if (false == g_target_redball.create(Device, d3d::RED)) return false;
-	g_target_redball.setCenter(.0f, (float)M_RADIUS, initialRedBallPosZ);
-
-	// create grey ball for set direction
-    if (false == g_target_greyball.create(Device, d3d::GREY)) return false;
-	g_target_greyball.setCenter(.0f, (float)M_RADIUS, initialGreyBallPosZ);
-	
-	// light setting 
+
+	g_game.setup();
+	g_game.setMultiBall(g_multiBall);
+	g_recorder.start(g_game, lego::FixedTimestep(SIM_TICK_RATE).getTickDelta() * SIM_TIME_SCALE);
+
+	// one mesh per shape and one material per color, shared by all objects
+	if (false == g_backend.create(Device)) return false;
+
+	// light setting
     D3DLIGHT9 lit;
     ::ZeroMemory(&lit, sizeof(lit));
     lit.Type         = D3DLIGHT_POINT;
-    lit.Diffuse      = d3d::WHITE; 
+    lit.Diffuse      = d3d::WHITE;
 	lit.Specular     = d3d::WHITE * 0.9f;
     lit.Ambient      = d3d::WHITE * 0.9f;
-    lit.Position     = D3DXVECTOR3(0.0f, 3.0f, 0.0f);
+    lit.Position     = D3DXVECTOR3(0.0f, lego::sceneLightHeight, 0.0f);
     lit.Range        = 100.0f;
     lit.Attenuation0 = 0.0f;
     lit.Attenuation1 = 0.9f;
     lit.Attenuation2 = 0.0f;
     if (false == g_light.create(Device, lit, (float)0.0))
         return false;
-	
+
 	// Position and aim the camera.
-	D3DXVECTOR3 pos(0.0f, 10.0f, -9.0f);
-	D3DXVECTOR3 target(0.0f, 0.0f, 0.0f);
-	D3DXVECTOR3 up(0.0f, 2.0f, 0.0f);
-	D3DXMatrixLookAtLH(&g_mView, &pos, &target, &up);
-	Device->SetTransform(D3DTS_VIEW, &g_mView);
-	
+	g_mView = lego::Matrix4::lookAtLH(lego::sceneCameraPosition, lego::sceneCameraTarget, lego::sceneCameraUp);
+	Device->SetTransform(D3DTS_VIEW, (const D3DMATRIX*)&g_mView);
+
 	// Set the projection matrix.
-	D3DXMatrixPerspectiveFovLH(&g_mProj, D3DX_PI / 4,
-        (float)Width / (float)Height, 1.0f, 100.0f);
-	Device->SetTransform(D3DTS_PROJECTION, &g_mProj);
-	
+	g_mProj = lego::Matrix4::perspectiveFovLH(lego::sceneFieldOfView,
+        (float)Width / (float)Height, lego::sceneNearPlane, lego::sceneFarPlane);
+	Device->SetTransform(D3DTS_PROJECTION, (const D3DMATRIX*)&g_mProj);
+
     // Set render states.
     Device->SetRenderState(D3DRS_LIGHTING, TRUE);
     Device->SetRenderState(D3DRS_SPECULARENABLE, TRUE);
     Device->SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
-	
-	// render texts
-	D3DXCreateFont(Device, 50, 0, FW_BOLD, 0, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, TEXT("Arial"), &g_Lifecount);
-	D3DXCreateFont(Device, 40, 0, FW_BOLD, 0, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, TEXT("Arial"), &g_gameover);
-	D3DXCreateFont(Device, 60, 0, FW_BOLD, 0, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, TEXT("Arial"), &g_LifeLabel);
-	D3DXCreateFont(Device, 30, 0, FW_BOLD, 0, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, TEXT("Arial"), &g_StartLabel);
-	D3DXCreateFont(Device, 50, 0, FW_BOLD, 0, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, DEFAULT_QUALITY, DEFAULT_PITCH | FF_DONTCARE, TEXT("Arial"), &g_gameclear);
+
+	// bake the HUD glyphs
+	if (false == g_hud.create(Device)) return false;
 	// set light
 	g_light.setLight(Device, g_mWorld);
 	return true;
 }
 
-// reset all position
-void resetAllPositions(void) {
-	// reset positions
-	for (int i = 0; i < totalBalls; i++) {
-		g_sphere[i].setCenter(spherePos[i][0], (float)M_RADIUS, spherePos[i][1]);
-		g_sphere[i].setPower(0, 0);
-	}
-
-	// reset red ball
-	g_target_redball.setCenter(.0f, (float)M_RADIUS, initialRedBallPosZ);
-	g_target_redball.setPower(0.0, 0.0);
-
-	// reset grey ball
-	g_target_greyball.setCenter(.0f, (float)M_RADIUS, initialGreyBallPosZ);
-	g_target_greyball.setPower(0.0, 0.0);
-}
-
-void resetRedAndGreyBalls(void) {
-	g_target_redball.setCenter(.0f, (float)M_RADIUS, initialRedBallPosZ);
-	g_target_redball.setPower(0.0, 0.0);
-
-	g_target_greyball.setCenter(.0f, (float)M_RADIUS, initialGreyBallPosZ);
-	g_target_greyball.setPower(0.0, 0.0);
+void Cleanup(void)
+{
+    g_backend.destroy();
+    g_hud.destroy();
 }
 
-void renderTexts(void) {
-	// render texts
-	//Set text
-	D3DCOLOR fontColor = D3DCOLOR_ARGB(255, 166, 234, 93);
-	D3DCOLOR fontColorstart = D3DCOLOR_ARGB(255, 0, 0, 0);
-	RECT LifeLabelRect;
-	RECT LifecountLabelRect;
-	RECT ScoreLabelRect;
-	RECT gameoverRect;
-	RECT gamestart;
-	RECT gameclear;
-
-	LifeLabelRect.left = 20;
-	LifeLabelRect.right = 150;
-	LifeLabelRect.top = 20;
-	LifeLabelRect.bottom = 100;
-
-	LifecountLabelRect.left = 55;
-	LifecountLabelRect.right = 200;
-	LifecountLabelRect.top = 70;
-	LifecountLabelRect.bottom = 180;
-
-	gameoverRect.left = 410;
-	gameoverRect.right = 650;
-	gameoverRect.top = 500;
-	gameoverRect.bottom = 580;
-
-	gameclear.left = 440;
-	gameclear.right = 650;
-	gameclear.top = 500;
-	gameclear.bottom = 580;
-
-	gamestart.left = 380;
-	gamestart.right = 680;
-	gamestart.top = 400;
-	gamestart.bottom = 480;
-
-	// Draw some text
-	char LifeLabelBuffer[20] = "Lives Left";
-	char ScoreLabelBuffer[20] = "Score";
-	char gameoverBuffer[10] = "Game over";
-	char gameclearBuffer[10] = "CLEAR";
-	char gamestartBuffer[30] = "Press SPACE to start";
-
-	switch (life)
-	{
-	case 5:
-		g_Lifecount->DrawText(NULL, "5", -1, &LifecountLabelRect, 0, fontColor);
-		break;
-	case 4:
-		g_Lifecount->DrawText(NULL, "4", -1, &LifecountLabelRect, 0, fontColor);
-		break;
-	case 3:
-		g_Lifecount->DrawText(NULL, "3", -1, &LifecountLabelRect, 0, fontColor);
-		break;
-	case 2:
-		g_Lifecount->DrawText(NULL, "2", -1, &LifecountLabelRect, 0, fontColor);
-		break;
-	case 1:
-		g_Lifecount->DrawText(NULL, "1", -1, &LifecountLabelRect, 0, fontColor);
-		break;
-	case 0:
-		g_Lifecount->DrawText(NULL, "0", -1, &LifecountLabelRect, 0, fontColor);
-		break;
-	}
-
-	g_LifeLabel->DrawText(NULL, LifeLabelBuffer, -1, &LifeLabelRect, 0, fontColor);
 
-
-	if (!isRoundStarted && life > 0 && score < (int)MAXSCORE) {
-		// when a round is ended but still has lives and score is not MAX
-		// draw start text
-		g_StartLabel->DrawText(NULL, gamestartBuffer, -1, &gamestart, 0, fontColorstart);
-	}
-	if (life <= 0) {
-		// if no lives left, all rounds are ended
-		fontColor = D3DCOLOR_ARGB(255, 255, 0, 0);
-		g_gameover->DrawTextA(NULL, gameoverBuffer, -1, &gameoverRect, 0, fontColor);
-		fontColor = D3DCOLOR_ARGB(255, 0, 0, 255);
-		isGameEnded = true;
-	}
-	if (score >= (int)MAXSCORE && life > 0) {
-		// when score is MAX and lives left, draw game clear message
-		g_gameclear->DrawTextA(NULL, gameclearBuffer, -1, &gameclear, 0, fontColor);
-		isGameEnded = true;
+// collects the zones of the last frame, and shows the breakdown now and then
+void updateProfiler(void)
+{
+	if (!lego::Profiler::isEnabled())
+		return;
+
+	g_profileFrame.clear();
+	lego::Profiler::collect(g_profileFrame);
+	g_profileSummary.addFrame(g_profileFrame);
+	size_t room = PROFILE_MAX_TRACE_ZONES - g_profileTrace.size();
+	g_profileTrace.insert(g_profileTrace.end(), g_profileFrame.begin(),
+		g_profileFrame.begin() + (g_profileFrame.size() < room ? g_profileFrame.size() : room));
+
+	long long now = lego::Profiler::now();
+	if (now - g_profileShown >= PROFILE_OVERLAY_PERIOD) {
+		g_profileShown = now;
+		g_hud.setOverlay(g_profileSummary.format().c_str());
 	}
 }
 
-void Cleanup(void)
+void toggleProfiler(void)
 {
-    g_legoPlane.destroy();
-	for(int i = 0 ; i < 3; i++) {
-		g_legowall[i].destroy();
+	if (!lego::Profiler::isCompiledIn())
+		return;
+
+	if (!lego::Profiler::isEnabled()) {
+		g_profileSummary = lego::ProfileSummary();
+		g_profileTrace.clear();
+		g_profileShown = 0;
+		lego::Profiler::setEnabled(true);
+		return;
 	}
-    destroyAllLegoBlock();
-    g_light.destroy();
-}
 
+	lego::Profiler::setEnabled(false);
+	g_profileFrame.clear();
+	lego::Profiler::collect(g_profileFrame);
+	if (g_profileTrace.size() + g_profileFrame.size() <= PROFILE_MAX_TRACE_ZONES)
+		g_profileTrace.insert(g_profileTrace.end(), g_profileFrame.begin(), g_profileFrame.end());
+	g_hud.setOverlay("");
+	if (!lego::writeChromeTrace(PROFILE_TRACE_PATH, g_profileTrace))
+		::MessageBox(0, "writing the profiler trace - FAILED", 0, 0);
+}
 
-// timeDelta represents the time between the current image frame and the last image frame.
-// the distance of moving balls should be "velocity * timeDelta"
-bool Display(float timeDelta)
+// draws the latest tick of the simulation thread, blended with the one before
+// by how long ago it was simulated. the recorder steps the game by
+// 1 / SIM_TICK_RATE * SIM_TIME_SCALE per tick, fixed in Setup().
+bool Display(float /*timeDelta*/)
 {
-	int i=0;
-	int j = 0;
-
-
 	if (Device)
 	{
+		LEGO_PROFILE_SCOPE("display");
+		const lego::SimSnapshot& snapshot = g_sim.getSnapshot();
+		const lego::RenderState& state = snapshot.state;
+		float alpha = g_sim.getAlpha(snapshot);
+
 		Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x00afafaf, 1.0f, 0);
 		Device->BeginScene();
 
-		if (isGameEnded) {
-			resetAllPositions();
-		}
-		else {
-			// update the red ball
-			g_target_redball.ballUpdate(timeDelta);
-			D3DXVECTOR3 redballCenter = g_target_redball.getCenter();
-			if (redballCenter.z <= -4.0f + M_RADIUS) {
-				g_target_redball.setPower(0.0, 0.0);
-				life--;
-				isRoundStarted = false;
-
-				// reset positions
-				if (life < 1) {
-					resetAllPositions();
-				}
-				else {
-					resetRedAndGreyBalls();
-				}
-			}
-			else {
-				// update the position of each ball. during update, check whether each ball hit by walls.
-				for (i = 0; i < 3; i++) {
-					for (j = 0; j < totalBalls; j++) {
-						g_legowall[i].hitBy(g_sphere[j]);
-						g_legowall[i].hitBy(g_target_redball);
-						if (life < 0) {
-							g_target_redball.setCenter(.0f, (float)M_RADIUS, initialRedBallPosZ);
-							g_target_redball.setPower(0.0, 0.0);
-							g_target_greyball.setCenter(.0f, (float)M_RADIUS, initialGreyBallPosZ);
-						}
-					}
-				}
-
-				// check whether any two balls hit together and update the direction of balls
-				for (i = 0; i < totalBalls; i++) {
-					g_sphere[i].hitBy(g_target_redball);
-				}
-			}
-		}
-		
-		// draw plane, walls, and spheres
-		g_legoPlane.draw(Device, g_mWorld);
-		for (i=0;i<3;i++) 	{
-			g_legowall[i].draw(Device, g_mWorld);
+		// draw plane, walls, spheres, line and light, sorted by mesh and material
+		{
+			LEGO_PROFILE_SCOPE("record");
+			lego::recordScene(state,
+				interpolateCenter(snapshot.prevRedCenter, state.redCenter, alpha),
+				interpolateCenter(snapshot.prevGreyCenter, state.greyCenter, alpha),
+				Height, g_commands);
+			g_commands.sort();
 		}
-		for (i = 0; i < totalBalls; i++) {
-			g_sphere[i].draw(Device, g_mWorld);
+		{
+			LEGO_PROFILE_SCOPE("submit");
+			lego::submitCommands(g_commands, g_backend);
 		}
-
-		// check if grey ball and red ball had collision
-		if (isRoundStarted) {
-			g_target_greyball.hitBy(g_target_redball);
+		{
+			LEGO_PROFILE_SCOPE("hud");
+			g_hud.draw(Device, state);
 		}
 
-		g_target_redball.draw(Device, g_mWorld);
-		g_target_greyball.draw(Device, g_mWorld);
-		g_legoLine.draw(Device, g_mWorld);
-        g_light.draw(Device);
-		
-		renderTexts();
-
 		Device->EndScene();
-		Device->Present(0, 0, 0, 0);
+		{
+			LEGO_PROFILE_SCOPE("present");
+			Device->Present(0, 0, 0, 0);
+		}
 		Device->SetTexture( 0, NULL );
 	}
+	updateProfiler();
 	return true;
 }
 
 LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
 	static bool wire = false;
-	static bool isReset = true;
-    static int old_x = 0;
-    static int old_y = 0;
-    static enum { WORLD_MOVE, LIGHT_MOVE, BLOCK_MOVE } move = WORLD_MOVE;
-	
-	D3DXVECTOR3 ballCenter;
+
 	switch (msg) {
 	case WM_DESTROY:
 	{
@@ -828,27 +663,16 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 			}
 			break;
 		case VK_SPACE:
-
-			// start game on space key down
-			if (life > 0 && !isRoundStarted) {
-				g_target_redball.setPower(REDBALLSPEED, REDBALLSPEED);
-				isRoundStarted = true;
-			}
-
+			g_sim.postInput(lego::INPUT_LAUNCH);
 			break;
 		case VK_LEFT:
-			ballCenter = g_target_greyball.getCenter();
-			if ((ballCenter.x - KEYSTEP) > (g_legowall[2].getPositionX() + g_legowall[2].getWidth() / 2)) {
-				g_target_greyball.setCenter(ballCenter.x - KEYSTEP, ballCenter.y, ballCenter.z);
-				g_target_greyball.setVelocity_X(-KEYSTEP * 5);
-			}
+			g_sim.postInput(lego::INPUT_LEFT);
 			break;
 		case VK_RIGHT:
-			ballCenter = g_target_greyball.getCenter();
-			if ((ballCenter.x + KEYSTEP) < (g_legowall[1].getPositionX() - g_legowall[1].getWidth() / 2)) {
-				g_target_greyball.setCenter(ballCenter.x + KEYSTEP, ballCenter.y, ballCenter.z);
-				g_target_greyball.setVelocity_X(KEYSTEP * 5);
-			}
+			g_sim.postInput(lego::INPUT_RIGHT);
+			break;
+		case VK_F2:
+			toggleProfiler();
 			break;
 		}
 	}
@@ -857,31 +681,50 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 }
 
 int WINAPI WinMain(HINSTANCE hinstance,
-				   HINSTANCE prevInstance, 
+				   HINSTANCE prevInstance,
 				   PSTR cmdLine,
 				   int showCmd)
 {
     srand(static_cast<unsigned int>(time(NULL)));
-	
+	if (cmdLine != NULL && strncmp(cmdLine, "-m ", 3) == 0) {
+		char* rest;
+		long balls = strtol(cmdLine + 3, &rest, 10);
+		if (balls < 0 || balls > MAX_MULTI_BALL) {
+			::MessageBox(0, "-m takes 0 to 255 balls", 0, 0);
+			return 0;
+		}
+		g_multiBall = (int)balls;
+		while (*rest == ' ')
+			rest++;
+		cmdLine = rest;
+	}
+	if (cmdLine != NULL && cmdLine[0] != '\0')
+		g_recordPath = cmdLine;
+
 	if(!d3d::InitD3D(hinstance,
 		Width, Height, true, D3DDEVTYPE_HAL, &Device))
 	{
 		::MessageBox(0, "InitD3D() - FAILED", 0, 0);
 		return 0;
 	}
-	
+
 	if(!Setup())
 	{
 		::MessageBox(0, "Setup() - FAILED", 0, 0);
 		return 0;
 	}
-	
 
+
+	g_sim.start(SIM_TICK_RATE, SIM_MAX_TICKS_PER_FRAME);
 	d3d::EnterMsgLoop( Display );
-	
+	g_sim.stop();
+
+	if (g_recordPath != NULL && !g_recorder.finish(g_game).save(g_recordPath))
+		::MessageBox(0, "saving the input log - FAILED", 0, 0);
+
 	Cleanup();
-	
+
 	Device->Release();
-	
+
 	return 0;
-}
\ No newline at end of file
+}